@@ -44,10 +44,20 @@ HEADERS +=  src/repocore.h\
             src/repocoreglobal.h \
             src/assimpwrapper.h \
             src/mongoclientwrapper.h \
+            src/repocommitpipeline.h \
             src/graph/repo_bounding_box.h \
             src/graph/repo_graph_abstract.h \
+            src/graph/repo_node_arena.h \
+            src/graph/repo_node_registry.h \
+            src/graph/repo_bvh.h \
+            src/graph/repo_path_index.h \
+            src/graph/repo_uuid_map.h \
             src/graph/repo_graph_history.h \
             src/graph/repo_graph_scene.h \
+            src/graph/repo_memory_footprint.h \
+            src/graph/repo_scene_snapshots.h \
+            src/graph/repo_scene_manager.h \
+            src/graph/repo_revision_store.h \
             src/graph/repo_node_abstract.h \
             src/graph/repo_node_camera.h \
             src/graph/repo_node_material.h \
@@ -75,6 +85,11 @@ HEADERS +=  src/repocore.h\
             src/compute/repo_eigen.h \
             src/compute/repocsv.h \
             src/compute/repographoptimizer.h \
+            src/compute/repo_triangulator.h \
+            src/compute/repo_similarity_index.h \
+            src/compute/repo_parallel.h \
+            src/compute/repo_prepared_mesh.h \
+            src/compute/repo_geometry_cache.h \
             src/graph/repo_node_types.h \
     src/primitives/repocollstats.h \
     src/primitives/repoprojectsettings.h \
@@ -86,10 +101,18 @@ SOURCES +=  src/repocore.cpp \
             src/repologger.cpp \
             src/assimpwrapper.cpp \
             src/mongoclientwrapper.cpp \
+            src/repocommitpipeline.cpp \
             src/graph/repo_bounding_box.cpp \
             src/graph/repo_graph_abstract.cpp \
+            src/graph/repo_node_arena.cpp \
+            src/graph/repo_node_registry.cpp \
+            src/graph/repo_bvh.cpp \
+            src/graph/repo_path_index.cpp \
             src/graph/repo_graph_history.cpp \
             src/graph/repo_graph_scene.cpp \
+            src/graph/repo_scene_snapshots.cpp \
+            src/graph/repo_scene_manager.cpp \
+            src/graph/repo_revision_store.cpp \
             src/graph/repo_node_abstract.cpp \
             src/graph/repo_node_camera.cpp \
             src/graph/repo_node_material.cpp \
@@ -117,6 +140,10 @@ SOURCES +=  src/repocore.cpp \
             src/compute/repo_eigen.cpp \
     src/compute/repocsv.cpp \
     src/compute/repographoptimizer.cpp \
+    src/compute/repo_triangulator.cpp \
+    src/compute/repo_similarity_index.cpp \
+    src/compute/repo_prepared_mesh.cpp \
+    src/compute/repo_geometry_cache.cpp \
     src/primitives/repocollstats.cpp \
     src/primitives/repoprojectsettings.cpp \
     src/mongo/repogridfs.cpp \
@@ -21,4 +21,5 @@ TEMPLATE = subdirs
 CONFIG += ordered
 
 SUBDIRS += 3drepocore.pro \
-           3drepocli.pro
+           3drepocli.pro \
+           3drepobench.pro
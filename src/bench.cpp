@@ -0,0 +1,662 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//------------------------------------------------------------------------------
+// Renderer benchmark. Builds scenes either from generated meshes or from BSON
+// dumps on disk (such as mongodump's scene.bson) and times PopGeometry
+// rendering, parallel scene decoding, graph optimisation and scene diffing.
+// No database connection is required.
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/uuid/uuid_io.hpp>
+
+#include "assimp/scene.h"
+
+#include "graph/repo_graph_scene.h"
+#include "compute/render.h"
+#include "compute/repographoptimizer.h"
+#include "diff/repo3ddiff.h"
+
+//------------------------------------------------------------------------------
+//
+// Allocation counting
+//
+//------------------------------------------------------------------------------
+// Replaces the global allocator for the whole process. On platforms with
+// symbol interposition (Linux, OS X) this includes allocations done inside
+// the 3drepocore shared library as well.
+static std::atomic<unsigned long long> allocationCount(0);
+static std::atomic<unsigned long long> allocationBytes(0);
+
+void *operator new(std::size_t size)
+{
+	++allocationCount;
+	allocationBytes += size;
+	void *ptr = std::malloc(size ? size : 1);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+//------------------------------------------------------------------------------
+
+const std::string GridStr("grid");
+const std::string SphereStr("sphere");
+const std::string SoupStr("soup");
+const std::string AllStr("all");
+const std::string DumpStr("dump");
+const std::string DecodeStr("decode");
+const std::string OptimizeStr("optimize");
+const std::string DiffStr("diff");
+
+//! Upper bound of triangles per generated mesh unless given explicitly.
+const unsigned long long DefaultTrianglesPerMesh = 32768;
+
+std::string prog_name;
+
+void print_usage()
+{
+	std::cout << prog_name << " [" << GridStr << "|" << SphereStr << "|" << SoupStr << "|" << AllStr << "] [min_triangles] [max_triangles] [meshes] [xyz8|oct8|oct16]" << std::endl;
+	std::cout << prog_name << " " << DumpStr << " <file.bson> [xyz8|oct8|oct16]" << std::endl;
+	std::cout << prog_name << " " << DecodeStr << " <file.bson> [max_threads]" << std::endl;
+	std::cout << prog_name << " " << OptimizeStr << " [nodes]" << std::endl;
+	std::cout << prog_name << " " << DiffStr << " [nodes] [max_threads]" << std::endl;
+}
+
+double millisecondsSince(const std::chrono::high_resolution_clock::time_point &start)
+{
+	return std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - start).count();
+}
+
+repo::core::Renderer::NormalEncoding parseNormalEncoding(const std::string &label)
+{
+	repo::core::Renderer::NormalEncoding encoding = repo::core::Renderer::XYZ_8BIT;
+	if (label == repo::core::Renderer::getNormalEncodingLabel(repo::core::Renderer::OCTAHEDRAL_8BIT))
+		encoding = repo::core::Renderer::OCTAHEDRAL_8BIT;
+	else if (label == repo::core::Renderer::getNormalEncodingLabel(repo::core::Renderer::OCTAHEDRAL_16BIT))
+		encoding = repo::core::Renderer::OCTAHEDRAL_16BIT;
+	return encoding;
+}
+
+//------------------------------------------------------------------------------
+//
+// Mesh generators
+//
+//------------------------------------------------------------------------------
+
+void setTriangle(aiFace &face, unsigned int a, unsigned int b, unsigned int c)
+{
+	face.mNumIndices = 3;
+	face.mIndices = new unsigned int[3];
+	face.mIndices[0] = a;
+	face.mIndices[1] = b;
+	face.mIndices[2] = c;
+}
+
+//! Regular n x n grid of quads in the XY plane, two triangles per quad.
+aiMesh *generateGrid(unsigned long long triangles, float offset)
+{
+	unsigned int n = std::max(1u, (unsigned int) floor(sqrt(triangles / 2.0)));
+
+	aiMesh *mesh = new aiMesh();
+	mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+	mesh->mNumVertices = (n + 1) * (n + 1);
+	mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+	mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+	for (unsigned int y = 0; y <= n; ++y)
+		for (unsigned int x = 0; x <= n; ++x)
+		{
+			mesh->mVertices[y * (n + 1) + x] = aiVector3D(offset + (float) x / n, (float) y / n, 0.0f);
+			mesh->mNormals[y * (n + 1) + x] = aiVector3D(0.0f, 0.0f, 1.0f);
+		}
+
+	mesh->mNumFaces = 2 * n * n;
+	mesh->mFaces = new aiFace[mesh->mNumFaces];
+	unsigned int f = 0;
+	for (unsigned int y = 0; y < n; ++y)
+		for (unsigned int x = 0; x < n; ++x)
+		{
+			unsigned int v = y * (n + 1) + x;
+			setTriangle(mesh->mFaces[f++], v, v + 1, v + n + 2);
+			setTriangle(mesh->mFaces[f++], v, v + n + 2, v + n + 1);
+		}
+	return mesh;
+}
+
+//! UV sphere with s stacks and 2s slices, poles are duplicated per slice.
+aiMesh *generateSphere(unsigned long long triangles, float offset)
+{
+	unsigned int stacks = std::max(2u, (unsigned int) floor(sqrt(triangles / 4.0)));
+	unsigned int slices = 2 * stacks;
+
+	aiMesh *mesh = new aiMesh();
+	mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+	mesh->mNumVertices = (stacks + 1) * (slices + 1);
+	mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+	mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+	for (unsigned int i = 0; i <= stacks; ++i)
+	{
+		float theta = (float) (M_PI * i / stacks);
+		for (unsigned int j = 0; j <= slices; ++j)
+		{
+			float phi = (float) (2.0 * M_PI * j / slices);
+			aiVector3D n(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+			mesh->mVertices[i * (slices + 1) + j] = aiVector3D(offset + n.x, n.y, n.z);
+			mesh->mNormals[i * (slices + 1) + j] = n;
+		}
+	}
+
+	mesh->mNumFaces = 2 * stacks * slices;
+	mesh->mFaces = new aiFace[mesh->mNumFaces];
+	unsigned int f = 0;
+	for (unsigned int i = 0; i < stacks; ++i)
+		for (unsigned int j = 0; j < slices; ++j)
+		{
+			unsigned int v = i * (slices + 1) + j;
+			setTriangle(mesh->mFaces[f++], v, v + slices + 1, v + 1);
+			setTriangle(mesh->mFaces[f++], v + 1, v + slices + 1, v + slices + 2);
+		}
+	return mesh;
+}
+
+//! Unconnected random triangles in a unit cube. No normals are supplied so
+//! that the renderer has to generate them.
+aiMesh *generateSoup(unsigned long long triangles, float offset, std::mt19937 &rng)
+{
+	std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+
+	aiMesh *mesh = new aiMesh();
+	mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+	mesh->mNumFaces = (unsigned int) std::max(1ull, triangles);
+	mesh->mNumVertices = 3 * mesh->mNumFaces;
+	mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+	for (unsigned int v = 0; v < mesh->mNumVertices; ++v)
+		mesh->mVertices[v] = aiVector3D(offset + dist(rng), dist(rng), dist(rng));
+
+	mesh->mFaces = new aiFace[mesh->mNumFaces];
+	for (unsigned int f = 0; f < mesh->mNumFaces; ++f)
+		setTriangle(mesh->mFaces[f], 3 * f, 3 * f + 1, 3 * f + 2);
+	return mesh;
+}
+
+//! Returns an aiScene with the requested number of triangles split into
+//! meshes all attached to the root node.
+aiScene *generateScene(
+	const std::string &generator,
+	unsigned long long triangles,
+	unsigned long long meshCount)
+{
+	std::mt19937 rng(5489u);
+
+	if (!meshCount)
+		meshCount = (triangles + DefaultTrianglesPerMesh - 1) / DefaultTrianglesPerMesh;
+	meshCount = std::max(1ull, meshCount);
+	unsigned long long perMesh = std::max(1ull, triangles / meshCount);
+
+	aiScene *scene = new aiScene();
+	scene->mNumMeshes = (unsigned int) meshCount;
+	scene->mMeshes = new aiMesh*[scene->mNumMeshes];
+	scene->mRootNode = new aiNode();
+	scene->mRootNode->mName.Set("<root>");
+	scene->mRootNode->mNumMeshes = scene->mNumMeshes;
+	scene->mRootNode->mMeshes = new unsigned int[scene->mNumMeshes];
+
+	for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+	{
+		float offset = 2.0f * i;
+		aiMesh *mesh = NULL;
+		if (generator == GridStr)
+			mesh = generateGrid(perMesh, offset);
+		else if (generator == SphereStr)
+			mesh = generateSphere(perMesh, offset);
+		else
+			mesh = generateSoup(perMesh, offset, rng);
+
+		std::stringstream name;
+		name << generator << "_" << i;
+		mesh->mName.Set(name.str());
+
+		scene->mMeshes[i] = mesh;
+		scene->mRootNode->mMeshes[i] = i;
+	}
+	return scene;
+}
+
+//! Returns an aiScene with the given number of branches under the root, each
+//! a chain of depth identity nodes with a single triangle mesh at the bottom.
+//! Every node of a chain has an empty sibling as well.
+aiScene *generateHierarchy(unsigned int branches, unsigned int depth)
+{
+	std::mt19937 rng(5489u);
+
+	aiScene *scene = new aiScene();
+	scene->mNumMeshes = branches;
+	scene->mMeshes = new aiMesh*[branches];
+	scene->mRootNode = new aiNode();
+	scene->mRootNode->mName.Set("<root>");
+	scene->mRootNode->mNumChildren = 2 * branches;
+	scene->mRootNode->mChildren = new aiNode*[2 * branches];
+
+	for (unsigned int b = 0; b < branches; ++b)
+	{
+		scene->mMeshes[b] = generateSoup(1, 2.0f * b, rng);
+
+		aiNode *parent = scene->mRootNode;
+		for (unsigned int level = 0; level < depth; ++level)
+		{
+			aiNode *node = new aiNode();
+			aiNode *empty = new aiNode();
+			std::stringstream name;
+			name << "branch_" << b << "_" << level;
+			node->mName.Set(name.str());
+			empty->mName.Set(name.str() + "_empty");
+			node->mParent = empty->mParent = parent;
+
+			if (parent != scene->mRootNode)
+			{
+				parent->mNumChildren = 2;
+				parent->mChildren = new aiNode*[2];
+				parent->mChildren[0] = node;
+				parent->mChildren[1] = empty;
+			}
+			else
+			{
+				parent->mChildren[2 * b] = node;
+				parent->mChildren[2 * b + 1] = empty;
+			}
+			parent = node;
+		}
+		parent->mNumMeshes = 1;
+		parent->mMeshes = new unsigned int[1];
+		parent->mMeshes[0] = b;
+	}
+	return scene;
+}
+
+//------------------------------------------------------------------------------
+//
+// BSON dumps
+//
+//------------------------------------------------------------------------------
+
+//! Reads consecutive BSON documents as written by mongodump.
+bool readBSONDump(const std::string &filename, std::vector<mongo::BSONObj> &out)
+{
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "Could not open " << filename << std::endl;
+		return false;
+	}
+
+	std::vector<char> buffer;
+	int32_t size = 0;
+	while (file.read(reinterpret_cast<char *>(&size), sizeof(size)))
+	{
+		if (size < 5)
+		{
+			std::cerr << "Corrupted BSON document in " << filename << std::endl;
+			return false;
+		}
+		buffer.resize(size);
+		std::memcpy(&buffer[0], &size, sizeof(size));
+		if (!file.read(&buffer[sizeof(size)], size - sizeof(size)))
+		{
+			std::cerr << "Truncated BSON document in " << filename << std::endl;
+			return false;
+		}
+		out.push_back(mongo::BSONObj(&buffer[0]).getOwned());
+	}
+	return true;
+}
+
+//! Returns a description of the scene that has to match between decodings.
+std::string describeScene(const repo::core::RepoGraphScene *scene)
+{
+	std::stringstream description;
+	if (scene->getRoot())
+		description << scene->getRoot()->getUniqueID();
+	description << " " << scene->getMeshes().size()
+		<< " " << scene->getTransformations().size()
+		<< " " << scene->getMaterials().size()
+		<< " " << scene->getTextures().size()
+		<< " " << scene->getCameras().size()
+		<< " " << scene->getReferences().size()
+		<< " " << scene->getMetadata().size();
+
+	std::set<boost::uuids::uuid> ids = scene->getUniqueIDs();
+	for (std::set<boost::uuids::uuid>::iterator it = ids.begin(); it != ids.end(); ++it)
+	{
+		repo::core::RepoNodeAbstract *node = scene->getNodeByUniqueID(*it);
+		description << " " << *it << ":" << node->getParents().size()
+			<< "/" << node->getChildren().size();
+	}
+	return description.str();
+}
+
+//! Times scene construction and teardown from the same dump on 1, 2, 4, ...
+//! threads, with nodes on the heap and in an arena.
+int decode(const std::string &filename, unsigned int maxThreads)
+{
+	std::vector<mongo::BSONObj> collection;
+	if (!readBSONDump(filename, collection))
+		return -1;
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << filename << " " << collection.size() << " BSONs" << std::endl;
+
+	std::string serial;
+	double serialMilliseconds = 0.0;
+	for (int useArena = 0; useArena < 2; ++useArena)
+		for (unsigned int threads = 1; threads <= maxThreads; threads *= 2)
+		{
+			std::chrono::high_resolution_clock::time_point start =
+				std::chrono::high_resolution_clock::now();
+			repo::core::RepoGraphScene *scene =
+				new repo::core::RepoGraphScene(collection, threads, useArena != 0);
+			double milliseconds = millisecondsSince(start);
+
+			std::string description = describeScene(scene);
+			if (serial.empty())
+			{
+				serial = description;
+				serialMilliseconds = milliseconds;
+			}
+
+			start = std::chrono::high_resolution_clock::now();
+			delete scene;
+			double teardownMilliseconds = millisecondsSince(start);
+
+			std::cout << (useArena ? "  arena" : "  heap ")
+				<< " threads " << std::setw(2) << threads << ": "
+				<< milliseconds << " ms, speedup "
+				<< (milliseconds > 0.0 ? serialMilliseconds / milliseconds : 0.0)
+				<< ", teardown " << teardownMilliseconds << " ms"
+				<< (description == serial ? "" : " MISMATCH") << std::endl;
+		}
+	return 0;
+}
+
+//! Times both optimizer passes on a deep and on a wide synthetic hierarchy.
+int optimize(unsigned int nodes)
+{
+	std::cout << std::fixed << std::setprecision(2);
+	for (int wide = 0; wide < 2; ++wide)
+	{
+		aiScene *assimpScene = wide
+			? generateHierarchy(std::max(1u, nodes / 2), 1)
+			: generateHierarchy(1, std::max(1u, nodes / 2));
+		repo::core::RepoGraphScene *scene = new repo::core::RepoGraphScene(
+			assimpScene, std::map<std::string, repo::core::RepoNodeAbstract *>());
+		delete assimpScene;
+
+		size_t transformations = scene->getTransformations().size();
+		repo::core::RepoGraphOptimizer optimizer(scene);
+		repo::core::RepoGraphOptimizerStatistics zero =
+			optimizer.collapseZeroMeshTransformations();
+		repo::core::RepoGraphOptimizerStatistics single =
+			optimizer.collapseSingleMeshTransformations();
+
+		std::cout << (wide ? "wide" : "deep") << " transformations: "
+			<< transformations << " -> " << scene->getTransformations().size()
+			<< std::endl;
+		std::cout << "  zero mesh: " << zero.totalMilliseconds << " ms"
+			<< ", visited " << zero.visitedNodes
+			<< ", removed " << zero.removedTransformations << std::endl;
+		std::cout << "  single mesh: " << single.totalMilliseconds << " ms"
+			<< ", visited " << single.visitedNodes
+			<< ", collapsed " << single.collapsedTransformations
+			<< ", reparented " << single.reparentedNodes << std::endl;
+		delete scene;
+	}
+	return 0;
+}
+
+//! Times Repo3DDiff between a wide synthetic hierarchy and the same one
+//! imported anew with every tenth mesh moved, on 1, 2, 4, ... threads.
+int diff(unsigned int nodes, unsigned int maxThreads)
+{
+	std::cout << std::fixed << std::setprecision(2);
+
+	// Each branch is a transformation with a mesh and an empty sibling
+	aiScene *assimpScene = generateHierarchy(std::max(1u, nodes / 3), 1);
+	repo::core::RepoGraphScene *a = new repo::core::RepoGraphScene(
+		assimpScene, std::map<std::string, repo::core::RepoNodeAbstract *>());
+	for (unsigned int m = 0; m < assimpScene->mNumMeshes; m += 10)
+		assimpScene->mMeshes[m]->mVertices[0].z += 0.01f;
+	repo::core::RepoGraphScene *b = new repo::core::RepoGraphScene(
+		assimpScene, std::map<std::string, repo::core::RepoNodeAbstract *>());
+	delete assimpScene;
+
+	std::cout << "diff nodes: " << a->getNodes().size() << " -> "
+		<< b->getNodes().size() << std::endl;
+	for (unsigned int threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		std::chrono::high_resolution_clock::time_point start =
+			std::chrono::high_resolution_clock::now();
+		std::map<std::string, repo::core::Repo3DDiffResult> results =
+			repo::core::Repo3DDiff(a, b).diffByType(threads);
+		double milliseconds = millisecondsSince(start);
+
+		size_t added = 0, deleted = 0, modified = 0, unmodified = 0;
+		std::map<std::string, repo::core::Repo3DDiffResult>::const_iterator it;
+		for (it = results.begin(); it != results.end(); ++it)
+		{
+			added += it->second.added.size();
+			deleted += it->second.deleted.size();
+			modified += it->second.modified.size();
+			unmodified += it->second.unmodified.size();
+		}
+		std::cout << "  threads " << std::setw(2) << threads << ": "
+			<< milliseconds << " ms"
+			<< ", added " << added << ", deleted " << deleted
+			<< ", modified " << modified << ", unmodified " << unmodified
+			<< std::endl;
+	}
+	delete a;
+	delete b;
+	return 0;
+}
+
+//------------------------------------------------------------------------------
+//
+// Reporting
+//
+//------------------------------------------------------------------------------
+
+void render(
+	const std::string &label,
+	repo::core::RepoGraphScene *scene,
+	double buildMilliseconds,
+	repo::core::Renderer::NormalEncoding encoding)
+{
+	repo::core::Renderer rend(scene, encoding);
+	std::vector<mongo::BSONObj> out;
+
+	unsigned long long allocationsBefore = allocationCount;
+	unsigned long long bytesBefore = allocationBytes;
+	rend.renderToBSONs(out);
+	unsigned long long allocations = allocationCount - allocationsBefore;
+	unsigned long long bytes = allocationBytes - bytesBefore;
+
+	const repo::core::RenderStatistics &stats = rend.getStatistics();
+	double seconds = stats.totalMilliseconds / 1000.0;
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << label
+		<< " [" << repo::core::Renderer::getNormalEncodingLabel(encoding) << "]"
+		<< " meshes: " << stats.meshes
+		<< " triangles: " << stats.triangles
+		<< " vertices: " << stats.vertices << std::endl;
+	std::cout << "  build: " << buildMilliseconds << " ms"
+		<< ", render: " << stats.totalMilliseconds << " ms"
+		<< ", triangles/s: " << (seconds > 0.0 ? stats.triangles / seconds : 0.0) << std::endl;
+	std::cout << "  allocations: " << allocations
+		<< " (" << bytes << " bytes)"
+		<< ", output: " << out.size() << " BSONs, "
+		<< stats.outputBytes << " bytes" << std::endl;
+	for (unsigned int lod = 0; lod < stats.lodMilliseconds.size(); ++lod)
+	{
+		std::cout << "  lod " << std::setw(2) << lod << ": "
+			<< stats.lodMilliseconds[lod] << " ms, "
+			<< stats.lodBytes[lod] << " bytes, "
+			<< stats.lodIndices[lod] << " indices" << std::endl;
+	}
+}
+
+enum Params
+{
+	ProgName, GeneratorParam, MinTrianglesParam, MaxTrianglesParam, MeshesParam, EncodingParam
+};
+
+enum DumpParams
+{
+	DumpProgName, DumpOperationParam, DumpFileParam, DumpEncodingParam
+};
+
+int main(int argc, char **argv)
+{
+	prog_name = std::string(argv[ProgName]);
+
+	std::string generator = (argc > GeneratorParam) ? std::string(argv[GeneratorParam]) : AllStr;
+
+	if (!generator.compare(DecodeStr))
+	{
+		if (argc < (DumpFileParam + 1))
+		{
+			print_usage();
+			return -1;
+		}
+		unsigned int maxThreads = (argc > DumpFileParam + 1)
+			? (unsigned int) strtoul(argv[DumpFileParam + 1], NULL, 10) : 32;
+		return decode(argv[DumpFileParam], std::max(1u, maxThreads));
+	}
+
+	if (!generator.compare(OptimizeStr))
+	{
+		unsigned int nodes = (argc > GeneratorParam + 1)
+			? (unsigned int) strtoul(argv[GeneratorParam + 1], NULL, 10) : 100000;
+		return optimize(nodes);
+	}
+
+	if (!generator.compare(DiffStr))
+	{
+		unsigned int nodes = (argc > GeneratorParam + 1)
+			? (unsigned int) strtoul(argv[GeneratorParam + 1], NULL, 10) : 1000000;
+		unsigned int maxThreads = (argc > GeneratorParam + 2)
+			? (unsigned int) strtoul(argv[GeneratorParam + 2], NULL, 10) : 32;
+		return diff(nodes, std::max(1u, maxThreads));
+	}
+
+	if (!generator.compare(DumpStr))
+	{
+		if (argc < (DumpFileParam + 1))
+		{
+			print_usage();
+			return -1;
+		}
+
+		repo::core::Renderer::NormalEncoding encoding = (argc > DumpEncodingParam)
+			? parseNormalEncoding(argv[DumpEncodingParam])
+			: repo::core::Renderer::XYZ_8BIT;
+
+		std::vector<mongo::BSONObj> collection;
+		std::chrono::high_resolution_clock::time_point start =
+			std::chrono::high_resolution_clock::now();
+		if (!readBSONDump(argv[DumpFileParam], collection))
+			return -1;
+		double readMilliseconds = millisecondsSince(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		repo::core::RepoGraphScene *scene = new repo::core::RepoGraphScene(collection);
+		double buildMilliseconds = millisecondsSince(start);
+
+		std::cout << "Read " << collection.size() << " BSONs in "
+			<< readMilliseconds << " ms" << std::endl;
+		render(argv[DumpFileParam], scene, buildMilliseconds, encoding);
+		delete scene;
+		return 0;
+	}
+
+	if (generator.compare(GridStr) && generator.compare(SphereStr)
+		&& generator.compare(SoupStr) && generator.compare(AllStr))
+	{
+		print_usage();
+		return -1;
+	}
+
+	unsigned long long minTriangles = (argc > MinTrianglesParam) ? strtoull(argv[MinTrianglesParam], NULL, 10) : 1000;
+	unsigned long long maxTriangles = (argc > MaxTrianglesParam) ? strtoull(argv[MaxTrianglesParam], NULL, 10) : 10000000;
+	unsigned long long meshes = (argc > MeshesParam) ? strtoull(argv[MeshesParam], NULL, 10) : 0;
+	repo::core::Renderer::NormalEncoding encoding = (argc > EncodingParam)
+		? parseNormalEncoding(argv[EncodingParam])
+		: repo::core::Renderer::XYZ_8BIT;
+
+	std::vector<std::string> generators;
+	if (!generator.compare(AllStr))
+	{
+		generators.push_back(GridStr);
+		generators.push_back(SphereStr);
+		generators.push_back(SoupStr);
+	}
+	else
+		generators.push_back(generator);
+
+	for (unsigned int g = 0; g < generators.size(); ++g)
+	{
+		// Decades from min to max triangles, ie 1k, 10k, ..., 10M
+		for (unsigned long long triangles = std::max(1ull, minTriangles);
+			triangles <= maxTriangles; triangles *= 10)
+		{
+			aiScene *assimpScene = generateScene(generators[g], triangles, meshes);
+
+			std::chrono::high_resolution_clock::time_point start =
+				std::chrono::high_resolution_clock::now();
+			repo::core::RepoGraphScene *scene = new repo::core::RepoGraphScene(
+				assimpScene, std::map<std::string, repo::core::RepoNodeAbstract *>());
+			double buildMilliseconds = millisecondsSince(start);
+			delete assimpScene;
+
+			std::stringstream label;
+			label << generators[g] << " " << triangles;
+			render(label.str(), scene, buildMilliseconds, encoding);
+			delete scene;
+		}
+	}
+	return 0;
+}
@@ -24,12 +24,13 @@ const std::string HelpStr("help");
 const std::string CacheStr("cache");
 const std::string DBListStr("dblist");
 const std::string ExportStr("export");
+const std::string MemoryStr("memory");
 
 std::string prog_name;
 
 void print_usage()
 {
-	std::cout << prog_name << " <server> <port> <username> <password> [" << HelpStr << "|" << CacheStr << "|" << DBListStr << "|" << ExportStr << "] [db_name] [export_filename]" << std::endl;
+	std::cout << prog_name << " <server> <port> <username> <password> [" << HelpStr << "|" << CacheStr << "|" << DBListStr << "|" << ExportStr << "|" << MemoryStr << "] [db_name] [export_filename]" << std::endl;
 }
 
 void getHeadRevision(repo::core::MongoClientWrapper &mongo, std::string dbname, repo::core::RepoGraphScene *& sceneLoader)
@@ -184,5 +185,18 @@ int main(int argc, char **argv)
 		  mongo.insertRecord(dbname, "repo.cache", (*it));
 		}
 
+	} else if (!operation.compare(MemoryStr)) {
+		if (argc < (DBNameParam + 1))
+		{
+			print_usage();
+			return -1;
+		}
+
+		std::string dbname = std::string(argv[DBNameParam]);
+		repo::core::RepoGraphScene *sceneLoader = NULL;
+
+		getHeadRevision(mongo, dbname, sceneLoader);
+		std::cout << sceneLoader->getFootprintReport();
+		delete sceneLoader;
 	}
 }
@@ -23,275 +23,573 @@ inline void bufferWrite(char *buf, int position, uint16_t val)
 	buf[position + 1] = (char)(val >> 8);
 }
 
+//! Maps a component in [-1, 1] to an unsigned normalised integer in [0, max].
+inline unsigned int quantizeUnitComponent(float val, float max)
+{
+	if (val < -1.0f) val = -1.0f;
+	if (val > 1.0f) val = 1.0f;
+	return (unsigned int)floor((val * 0.5f + 0.5f) * max + 0.5f);
+}
+
+//! Writes a normal in the given encoding and returns the number of bytes used.
+inline unsigned int bufferWriteNormal(
+	char *buf,
+	int position,
+	const aiVector3t<float> &normal,
+	repo::core::Renderer::NormalEncoding encoding)
+{
+	// Assimp assigns QNaN normals to points and lines
+	aiVector3t<float> n = normal;
+	if (!(std::isfinite(n.x) && std::isfinite(n.y) && std::isfinite(n.z)))
+		n = aiVector3t<float>(0.0f, 0.0f, 0.0f);
+
+	unsigned int written = 0;
+	switch (encoding)
+	{
+		case repo::core::Renderer::OCTAHEDRAL_8BIT :
+		{
+			aiVector2t<float> oct = repo::core::Renderer::octahedralEncode(n);
+			buf[position]     = (char) quantizeUnitComponent(oct.x, 255.0f);
+			buf[position + 1] = (char) quantizeUnitComponent(oct.y, 255.0f);
+			written = 2;
+			break;
+		}
+		case repo::core::Renderer::OCTAHEDRAL_16BIT :
+		{
+			aiVector2t<float> oct = repo::core::Renderer::octahedralEncode(n);
+			bufferWrite(buf, position, (uint16_t) quantizeUnitComponent(oct.x, 65535.0f));
+			bufferWrite(buf, position + 2, (uint16_t) quantizeUnitComponent(oct.y, 65535.0f));
+			written = 4;
+			break;
+		}
+		case repo::core::Renderer::XYZ_8BIT :
+		default :
+		{
+			for (unsigned int comp_idx = 0; comp_idx < 3; comp_idx++)
+				buf[position + comp_idx] = (char)(uint8_t)(floor((n[comp_idx] + 1) * 127 + 0.5));
+
+			// Padding to align with 4 bytes
+			buf[position + 3] = 0;
+			written = 4;
+			break;
+		}
+	}
+	return written;
+}
+
+//! Maps a value in [0, 1] to 10 bits, out of range values are clamped.
+inline uint32_t quantizeUnitInterval(float val)
+{
+	if (!(val > 0.0f)) return 0; // includes NaN of flat bounding boxes
+	if (val >= 1.0f) return 1023;
+	return (uint32_t) floor(val * 1023.0f + 0.5f);
+}
+
+//! Spreads the lower 10 bits of a value so that they occupy every third bit.
+inline uint32_t mortonSpread(uint32_t val)
+{
+	val &= 0x3FF;
+	val = (val | (val << 16)) & 0x030000FF;
+	val = (val | (val << 8))  & 0x0300F00F;
+	val = (val | (val << 4))  & 0x030C30C3;
+	val = (val | (val << 2))  & 0x09249249;
+	return val;
+}
+
+std::string repo::core::Renderer::getNormalEncodingLabel(NormalEncoding encoding)
+{
+	switch (encoding)
+	{
+		case OCTAHEDRAL_8BIT  : return "oct8";
+		case OCTAHEDRAL_16BIT : return "oct16";
+		case XYZ_8BIT         :
+		default               : return "xyz8";
+	}
+}
+
+aiVector2t<float> repo::core::Renderer::octahedralEncode(const aiVector3t<float> &normal)
+{
+	// Project onto the octahedron |x| + |y| + |z| = 1
+	float l1 = fabs(normal.x) + fabs(normal.y) + fabs(normal.z);
+	if (!(l1 > 0.0f))
+		return aiVector2t<float>(0.0f, 0.0f); // degenerate normal decodes as +Z
+
+	float u = normal.x / l1;
+	float v = normal.y / l1;
+
+	// Fold the lower hemisphere over the diagonals
+	if (normal.z < 0.0f)
+	{
+		float foldedU = (1.0f - fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		float foldedV = (1.0f - fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		u = foldedU;
+		v = foldedV;
+	}
+	return aiVector2t<float>(u, v);
+}
+
+aiVector3t<float> repo::core::Renderer::octahedralDecode(const aiVector2t<float> &oct)
+{
+	aiVector3t<float> normal(oct.x, oct.y, 1.0f - fabs(oct.x) - fabs(oct.y));
+	if (normal.z < 0.0f)
+	{
+		normal.x = (1.0f - fabs(oct.y)) * (oct.x >= 0.0f ? 1.0f : -1.0f);
+		normal.y = (1.0f - fabs(oct.x)) * (oct.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return normal.Normalize();
+}
+
+std::vector<std::vector<unsigned int> > repo::core::Renderer::splitIntoChunks(
+    const std::vector<aiVector3t<float> > &vertices,
+    const std::vector<aiFace> &faces,
+    const RepoBoundingBox &bbox,
+    unsigned int maxVertices)
+{
+    std::vector<std::vector<unsigned int> > chunks;
+    if (maxVertices < 3)
+        return chunks;
+
+    //--------------------------------------------------------------------------
+    // Order triangles along a Morton curve through their centroids so that
+    // spatially close triangles, and hence shared vertices, end up together.
+    float sizeX = bbox.getMax()[0] - bbox.getMin()[0];
+    float sizeY = bbox.getMax()[1] - bbox.getMin()[1];
+    float sizeZ = bbox.getMax()[2] - bbox.getMin()[2];
+
+    std::vector<std::pair<uint32_t, unsigned int> > order;
+    order.reserve(faces.size());
+    for (unsigned int f = 0; f < faces.size(); ++f)
+    {
+        const aiFace &face = faces[f];
+        if (face.mNumIndices != 3)
+            continue;
+
+        aiVector3t<float> centroid = (vertices[face.mIndices[0]]
+            + vertices[face.mIndices[1]] + vertices[face.mIndices[2]]) / 3.0f;
+
+        uint32_t code =
+            mortonSpread(quantizeUnitInterval((centroid.x - bbox.getMin()[0]) / sizeX)) |
+            (mortonSpread(quantizeUnitInterval((centroid.y - bbox.getMin()[1]) / sizeY)) << 1) |
+            (mortonSpread(quantizeUnitInterval((centroid.z - bbox.getMin()[2]) / sizeZ)) << 2);
+        order.push_back(std::make_pair(code, f));
+    }
+    std::stable_sort(order.begin(), order.end());
+
+    //--------------------------------------------------------------------------
+    // Greedily fill chunks up to the vertex limit
+    const unsigned int none = std::numeric_limits<unsigned int>::max();
+    std::vector<unsigned int> vertexChunk(vertices.size(), none);
+    unsigned int chunkVertices = 0;
+
+    for (unsigned int i = 0; i < order.size(); ++i)
+    {
+        const aiFace &face = faces[order[i].second];
+        unsigned int current = chunks.empty() ? none : (unsigned int) chunks.size() - 1;
+
+        unsigned int added = 0;
+        for (unsigned int vert_idx = 0; vert_idx < 3; vert_idx++)
+            if (vertexChunk[face.mIndices[vert_idx]] != current)
+                added++;
+
+        if (chunks.empty() || chunkVertices + added > maxVertices)
+        {
+            chunks.push_back(std::vector<unsigned int>());
+            current = (unsigned int) chunks.size() - 1;
+            chunkVertices = 0;
+        }
+
+        for (unsigned int vert_idx = 0; vert_idx < 3; vert_idx++)
+        {
+            unsigned int vert_num = face.mIndices[vert_idx];
+            if (vertexChunk[vert_num] != current)
+            {
+                vertexChunk[vert_num] = current;
+                chunkVertices++;
+            }
+        }
+        chunks.back().push_back(order[i].second);
+    }
+    return chunks;
+}
+
 void repo::core::Renderer::renderToBSONs(std::vector<mongo::BSONObj> &out)
 {
     //const std::vector<RepoNodeAbstract *> &meshesAlias = scene->getMeshesVector();
     const RepoNodeAbstractSet &meshesAlias = scene->getMeshes();
 
+    statistics = RenderStatistics();
+    std::chrono::high_resolution_clock::time_point renderStart =
+        std::chrono::high_resolution_clock::now();
+
     // Process all the meshes and compute PopBuffers
     for(RepoNodeAbstractSet::const_iterator it = meshesAlias.begin();
         it != meshesAlias.end(); ++it)
     {
-        RepoNodeMesh *mesh = dynamic_cast<RepoNodeMesh *>(*it);
+        RepoPreparedMesh prepared(RepoNodeAbstract::castNode<RepoNodeMesh *>(*it));
+        renderMesh(prepared, out);
+    }
+
+    statistics.totalMilliseconds =
+        std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - renderStart).count();
+}
+
+void repo::core::Renderer::renderMesh(
+    const RepoPreparedMesh &prepared,
+    std::vector<mongo::BSONObj> &out)
+{
+    if (!prepared.isValid())
+        return;
+
+    const RepoNodeMesh *mesh = prepared.getMesh();
+    const std::vector<aiVector3t<float> > *verts = &prepared.getVertices();
+    const std::vector<aiVector3t<uint16_t> > *quantized = &prepared.getQuantizedVertices();
+    const std::vector<aiVector3t<float> > *normals = &prepared.getNormals();
+    const std::vector<aiVector3t<float> > *uvChannel = prepared.getUVChannel();
+    const std::vector<aiFace> *faces = &prepared.getFaces();
+    bool has_generated_normals = prepared.hasGeneratedNormals();
+
+    size_t num_verts = verts->size();
+
+    statistics.meshes++;
+    statistics.vertices += num_verts;
+    statistics.triangles += faces->size();
+
+    //--------------------------------------------------------------------------
+    // Meshes addressable by 16-bit indices are written as a single chunk
+    // in their original order, larger ones are split.
+    std::vector<std::vector<unsigned int> > chunks;
+    if (num_verts > REPO_RENDER_MAX_CHUNK_VERTICES)
+        chunks = splitIntoChunks(*verts, *faces, mesh->getBoundingBox());
+
+    std::vector<boost::uuids::uuid> chunkIDs;
+    for (unsigned int chunk = 0; chunk < std::max<size_t>(1, chunks.size()); ++chunk)
+        chunkIDs.push_back(boost::uuids::random_generator()());
+
+    //--------------------------------------------------------------------------
+    // Remap every chunk to its own vertex range in order of first use
+    const unsigned int none = std::numeric_limits<unsigned int>::max();
+    std::vector<unsigned int> localIndices(chunks.empty() ? 0 : num_verts, none);
+    std::vector<std::vector<unsigned int> > chunkVertices(chunks.size());
+    std::vector<std::vector<aiFace> > chunkFaces(chunks.size());
+
+    for (unsigned int chunk = 0; chunk < chunks.size(); ++chunk)
+    {
+        chunkFaces[chunk].reserve(chunks[chunk].size());
+        for (unsigned int i = 0; i < chunks[chunk].size(); ++i)
+        {
+            const aiFace &face = (*faces)[chunks[chunk][i]];
+            chunkFaces[chunk].push_back(aiFace());
+            aiFace &chunkFace = chunkFaces[chunk].back();
+            chunkFace.mNumIndices = 3;
+            chunkFace.mIndices = new unsigned int[3];
 
-        // PopBuffer Code
-        unsigned int stride = 12;
-        const RepoBoundingBox &bbox = mesh->getBoundingBox();
+            for (unsigned int vert_idx = 0; vert_idx < 3; vert_idx++)
+            {
+                unsigned int vert_num = face.mIndices[vert_idx];
+                if (localIndices[vert_num] == none)
+                {
+                    localIndices[vert_num] = (unsigned int) chunkVertices[chunk].size();
+                    chunkVertices[chunk].push_back(vert_num);
+                }
+                chunkFace.mIndices[vert_idx] = localIndices[vert_num];
+            }
+        }
 
-        float bboxSizeX = (bbox.getMax()[0] - bbox.getMin()[0]);
-        float bboxSizeY = (bbox.getMax()[1] - bbox.getMin()[1]);
-        float bboxSizeZ = (bbox.getMax()[2] - bbox.getMin()[2]);
+        for (unsigned int i = 0; i < chunkVertices[chunk].size(); ++i)
+            localIndices[chunkVertices[chunk][i]] = none;
+    }
 
-        const std::vector<aiVector3t<float> > * verts = mesh->getVertices();
+    std::vector<aiVector3t<uint16_t> > chunkQuantized;
+    std::vector<aiVector3t<float> > chunkNormals, chunkUVs;
 
-        if (verts != NULL)
+    for (unsigned int chunk = 0; chunk < chunkIDs.size(); ++chunk)
+    {
+        mongo::BSONObjBuilder head_bson;
+        head_bson.append("normals_generated", has_generated_normals);
+        head_bson.append("chunk", chunk);
+        head_bson.append("num_chunks", (unsigned int) chunkIDs.size());
+
+        // Chunk table, identical in all the chunks of a mesh
+        mongo::BSONObjBuilder chunks_bson;
+        for (unsigned int i = 0; i < chunkIDs.size(); ++i)
         {
-            size_t num_verts = verts->size();
+            mongo::BSONObjBuilder chunk_bson;
+            RepoTranscoderBSON::append("_id", chunkIDs[i], chunk_bson);
+            chunk_bson.append("num_vertices", chunks.empty()
+                ? (unsigned int) num_verts : (unsigned int) chunkVertices[i].size());
+            chunk_bson.append("num_faces", chunks.empty()
+                ? (unsigned int) faces->size() : (unsigned int) chunkFaces[i].size());
+            chunks_bson.append(RepoTranscoderString::toString(i), chunk_bson.obj());
+        }
+        head_bson.appendArray("chunks", chunks_bson.obj());
 
-            std::vector<int> vertex_map(num_verts, -1);
-            std::vector<int64_t> vertex_quant_idx(num_verts, 0);
-            std::vector<aiVector3t<uint16_t> > vertex_quant;
-            vertex_quant.resize(num_verts);
+        if (chunks.empty())
+        {
+            renderPopGeometry(mesh, chunkIDs[chunk], *quantized, *normals,
+                uvChannel, *faces, head_bson, out);
+            continue;
+        }
 
-            unsigned int vert_buf_ptr = 0;
-            unsigned int idx_buf_ptr = 0;
-            unsigned int buf_offset = 0;
+        chunkQuantized.clear();
+        chunkNormals.clear();
+        chunkUVs.clear();
+        for (unsigned int i = 0; i < chunkVertices[chunk].size(); ++i)
+        {
+            unsigned int vert_num = chunkVertices[chunk][i];
+            chunkQuantized.push_back((*quantized)[vert_num]);
+            chunkNormals.push_back((*normals)[vert_num]);
+            if (uvChannel)
+                chunkUVs.push_back((*uvChannel)[vert_num]);
+        }
+
+        renderPopGeometry(mesh, chunkIDs[chunk], chunkQuantized, chunkNormals,
+            uvChannel ? &chunkUVs : NULL, chunkFaces[chunk], head_bson, out);
+    }
+}
+
+void repo::core::Renderer::renderPopGeometry(
+    const RepoNodeMesh *mesh,
+    const boost::uuids::uuid &chunkID,
+    const std::vector<aiVector3t<uint16_t> > &vertex_quant,
+    const std::vector<aiVector3t<float> > &normals,
+    const std::vector<aiVector3t<float> > *uvChannel,
+    const std::vector<aiFace> &faces,
+    mongo::BSONObjBuilder &head_bson,
+    std::vector<mongo::BSONObj> &out)
+{
+    statistics.chunks++;
 
-            const std::vector<aiVector3t<float> > *uvChannel = mesh->getUVChannel(0);
+    // PopBuffer Code
+    // Quantized position (3 x 16-bit) followed by the normal. XYZ and
+    // 16-bit octahedral normals keep the position padded to 4 bytes,
+    // 8-bit octahedral normals fill the padding instead.
+    unsigned int stride = (OCTAHEDRAL_8BIT == normalEncoding) ? 8 : 12;
 
-            const unsigned int max_bits = 16;
-            float max_quant = powf(2.0f, (float)max_bits) - 1.0f;
+    size_t num_verts = vertex_quant.size();
 
-            bool has_tex = (uvChannel != NULL);
-            float min_texcoordu = 0.0f, max_texcoordu = 0.0f;
-            float min_texcoordv = 0.0f, max_texcoordv = 0.0f;
+    std::vector<int> vertex_map(num_verts, -1);
+    std::vector<int64_t> vertex_quant_idx(num_verts, 0);
 
-            if (has_tex)
+    unsigned int vert_buf_ptr = 0;
+    unsigned int idx_buf_ptr = 0;
+    unsigned int buf_offset = 0;
+
+    const unsigned int max_bits = 16;
+
+    bool has_tex = (uvChannel != NULL);
+    float min_texcoordu = 0.0f, max_texcoordu = 0.0f;
+    float min_texcoordv = 0.0f, max_texcoordv = 0.0f;
+
+    if (has_tex)
+    {
+        for(unsigned int vert_num = 0; vert_num < num_verts; vert_num++)
+        {
+            for(unsigned int comp_idx = 0; comp_idx < 2; comp_idx++)
             {
-                for(unsigned int vert_num = 0; vert_num < num_verts; vert_num++)
-                {
-                    for(unsigned int comp_idx = 0; comp_idx < 2; comp_idx++)
-                    {
-                        if (comp_idx == 0) {
-                            if (vert_num == 0) {
-                                min_texcoordu = (*uvChannel)[vert_num][comp_idx];
-                                max_texcoordu = (*uvChannel)[vert_num][comp_idx];
-                            } else {
-                                if ((*uvChannel)[vert_num][comp_idx] < min_texcoordu)
-                                    min_texcoordu = (*uvChannel)[vert_num][comp_idx];
-                                if ((*uvChannel)[vert_num][comp_idx] > max_texcoordu)
-                                    max_texcoordu = (*uvChannel)[vert_num][comp_idx];
-                            }
-                        }
+                if (comp_idx == 0) {
+                    if (vert_num == 0) {
+                        min_texcoordu = (*uvChannel)[vert_num][comp_idx];
+                        max_texcoordu = (*uvChannel)[vert_num][comp_idx];
+                    } else {
+                        if ((*uvChannel)[vert_num][comp_idx] < min_texcoordu)
+                            min_texcoordu = (*uvChannel)[vert_num][comp_idx];
+                        if ((*uvChannel)[vert_num][comp_idx] > max_texcoordu)
+                            max_texcoordu = (*uvChannel)[vert_num][comp_idx];
+                    }
+                }
 
-                        if (comp_idx == 1) {
-                            if (vert_num == 0) {
-                                min_texcoordv = (*uvChannel)[vert_num][comp_idx];
-                                max_texcoordv = (*uvChannel)[vert_num][comp_idx];
-                            } else {
-                                if ((*uvChannel)[vert_num][comp_idx] < min_texcoordv)
-                                    min_texcoordv = (*uvChannel)[vert_num][comp_idx];
-                                if ((*uvChannel)[vert_num][comp_idx] > max_texcoordv)
-                                    max_texcoordv = (*uvChannel)[vert_num][comp_idx];
-                            }
-                        }
+                if (comp_idx == 1) {
+                    if (vert_num == 0) {
+                        min_texcoordv = (*uvChannel)[vert_num][comp_idx];
+                        max_texcoordv = (*uvChannel)[vert_num][comp_idx];
+                    } else {
+                        if ((*uvChannel)[vert_num][comp_idx] < min_texcoordv)
+                            min_texcoordv = (*uvChannel)[vert_num][comp_idx];
+                        if ((*uvChannel)[vert_num][comp_idx] > max_texcoordv)
+                            max_texcoordv = (*uvChannel)[vert_num][comp_idx];
                     }
                 }
-                stride = 16;
-           }
+            }
+        }
+        stride += 4;
+    }
 
-			for(unsigned int vert_num = 0; vert_num < num_verts; vert_num++)
-			{
-				uint16_t vert_x_normal = (uint16_t)floor((((*verts)[vert_num][0] - bbox.getMin()[0]) / bboxSizeX) * max_quant + 0.5f);
-				uint16_t vert_y_normal = (uint16_t)floor((((*verts)[vert_num][1] - bbox.getMin()[1]) / bboxSizeY) * max_quant + 0.5f);
-				uint16_t vert_z_normal = (uint16_t)floor((((*verts)[vert_num][2] - bbox.getMin()[2]) / bboxSizeZ) * max_quant + 0.5f);
+    unsigned int num_faces = faces.size();
 
-				vertex_quant[vert_num][0] = vert_x_normal;
-				vertex_quant[vert_num][1] = vert_y_normal;
-				vertex_quant[vert_num][2] = vert_z_normal;
+    std::vector<bool> valid_tri(num_faces, false);
+    unsigned int new_vertex_id = 0;
+    unsigned int added_verts = 0;
+    unsigned int prev_added_verts = 0;
 
-			}
+    char *idx_buf;
+    char *vert_buf;
 
-            const std::vector<aiFace> *faces = mesh->getFaces();
-            const std::vector<aiVector3t<float> > *normals = mesh->getNormals();
-        
-            if (faces != NULL)
-            {
-                unsigned int num_faces = faces->size();
-		
-				//std::cout << "#FACES " << num_faces << std::endl;
+    unsigned int lod = 0;
 
-                std::vector<bool> valid_tri(num_faces, false);
-                unsigned int new_vertex_id = 0;
-                unsigned int added_verts = 0;
-                unsigned int prev_added_verts = 0;
+    repo::core::RepoTranscoderBSON::append("mesh_id", mesh->getUniqueID(), head_bson);
+    repo::core::RepoTranscoderBSON::append("_id", chunkID, head_bson);
+    head_bson.append("stride", stride);
+    head_bson.append("type", "PopGeometry");
+    head_bson.append("normal_encoding", getNormalEncodingLabel(normalEncoding));
 
-                char *idx_buf;
-                char *vert_buf;
+    if (has_tex)
+    {
+        head_bson.append("min_texcoordu", min_texcoordu);
+        head_bson.append("max_texcoordu", max_texcoordu);
+        head_bson.append("min_texcoordv", min_texcoordv);
+        head_bson.append("max_texcoordv", max_texcoordv);
+    }
 
-                unsigned int lod = 0;
-                mongo::BSONObjBuilder head_bson;
+    out.push_back(head_bson.obj());
+    statistics.outputBytes += out.back().objsize();
 
-                repo::core::RepoTranscoderBSON::append("mesh_id", mesh->getUniqueID(), head_bson);
-				repo::core::RepoTranscoderBSON::append("_id", boost::uuids::random_generator()(), head_bson);
-                head_bson.append("stride", stride);
-                head_bson.append("type", "PopGeometry");
+    prev_added_verts = added_verts;
+    buf_offset += vert_buf_ptr;
 
-                if (has_tex) 
-                {
-                    head_bson.append("min_texcoordu", min_texcoordu);
-                    head_bson.append("max_texcoordu", max_texcoordu);
-                    head_bson.append("min_texcoordv", min_texcoordv);
-                    head_bson.append("max_texcoordv", max_texcoordv);
-                }
+    while((new_vertex_id < num_verts) && (lod < 16))
+    {
+        vert_buf_ptr = 0;
+        idx_buf_ptr = 0;
 
-                out.push_back(head_bson.obj());
+        std::chrono::high_resolution_clock::time_point lodStart =
+            std::chrono::high_resolution_clock::now();
 
-                prev_added_verts = added_verts;
-                buf_offset += vert_buf_ptr;
+        idx_buf  = new char[2 * 3 * num_faces];
+        vert_buf = new char[stride * num_verts];
 
-                while((new_vertex_id < num_verts) && (lod < 16))
-                {
-				  vert_buf_ptr = 0;
-				  idx_buf_ptr = 0;
+        int num_indices = 0;
 
-                  idx_buf  = new char[2 * 3 * num_faces];
-                  vert_buf = new char[stride * num_verts];
+        float dim = powf(2.0, (float)(max_bits - lod));
 
-                  int num_indices = 0;
+        for(unsigned int vert_num = 0; vert_num < num_verts; vert_num++)
+        {
+            float vert_x = floor((float)vertex_quant[vert_num][0] / dim) * dim;
+            float vert_y = floor((float)vertex_quant[vert_num][1] / dim) * dim;
+            float vert_z = floor((float)vertex_quant[vert_num][2] / dim) * dim;
 
-                  float dim = powf(2.0, (float)(max_bits - lod));
+            uint64_t quant_idx = (uint64_t)(vert_x + vert_y * dim + vert_z * dim * dim);
 
-                  for(unsigned int vert_num = 0; vert_num < num_verts; vert_num++)
-                  {
-					float vert_x = floor((float)vertex_quant[vert_num][0] / dim) * dim;
-					float vert_y = floor((float)vertex_quant[vert_num][1] / dim) * dim;
-					float vert_z = floor((float)vertex_quant[vert_num][2] / dim) * dim;
+            vertex_quant_idx[vert_num] = quant_idx;
+        }
 
-					uint64_t quant_idx = (uint64_t)(vert_x + vert_y * dim + vert_z * dim * dim);
+        for(unsigned int tri_num = 0; tri_num < num_faces; tri_num++)
+        {
+            const aiFace &curr_face = faces[tri_num];
 
-					vertex_quant_idx[vert_num] = quant_idx;
-                  }
+            if (!valid_tri[tri_num])
+            {
+                std::set<uint64_t> quant_map;
+                bool is_valid = true;
 
-                  for(unsigned int tri_num = 0; tri_num < num_faces; tri_num++)
-                  {
-					const aiFace &curr_face = (*faces)[tri_num];
+                for(unsigned int vert_idx = 0; vert_idx < 3; vert_idx++) {
+                    unsigned int vert_num = curr_face.mIndices[vert_idx];
+                    uint64_t curr_quant = vertex_quant_idx[vert_num];
 
-                    if (!valid_tri[tri_num])
+                    if (quant_map.find(curr_quant) != quant_map.end())
                     {
-                        std::set<uint64_t> quant_map;
-                        bool is_valid = true;
-                        
-                        for(unsigned int vert_idx = 0; vert_idx < 3; vert_idx++) {
-							unsigned int vert_num = curr_face.mIndices[vert_idx];
-                            uint64_t curr_quant = vertex_quant_idx[vert_num];
-
-                            if (quant_map.find(curr_quant) != quant_map.end())
-                            {
-                                is_valid = false;
-                                break;
-                            } else {
-                                quant_map.insert(curr_quant);
+                        is_valid = false;
+                        break;
+                    } else {
+                        quant_map.insert(curr_quant);
+                    }
+                }
+
+                if (is_valid) {
+                    valid_tri[tri_num] = true;
+
+                    for(unsigned int vert_idx = 0; vert_idx < 3; vert_idx++){
+                        unsigned int vert_num = curr_face.mIndices[vert_idx];
+
+                        if (vertex_map[vert_num] == -1) {
+
+                            // Store quantized coordinates
+                            for (unsigned int comp_idx = 0; comp_idx < 3; comp_idx++) {
+                                bufferWrite(vert_buf, vert_buf_ptr, vertex_quant[vert_num][comp_idx]);
+                                vert_buf_ptr+=2;
                             }
-                        }
 
-                        if (is_valid) {
-                            valid_tri[tri_num] = true;
-
-                            for(unsigned int vert_idx = 0; vert_idx < 3; vert_idx++){
-                                unsigned int vert_num = curr_face.mIndices[vert_idx];
-
-                                if (vertex_map[vert_num] == -1) {
-
-                                    // Store quantized coordinates
-                                    for (unsigned int comp_idx = 0; comp_idx < 3; comp_idx++) {
-										bufferWrite(vert_buf, vert_buf_ptr, vertex_quant[vert_num][comp_idx]);
-										vert_buf_ptr+=2;
-                                    }
-
-                                    // Padding to align with 4 bytes
-									bufferWrite(vert_buf, vert_buf_ptr, 0);
-									vert_buf_ptr += 2;
-
-                                    // Write normals in 8-bit
-                                    for (unsigned int comp_idx = 0; comp_idx < 3; comp_idx++) {
-                                        uint8_t comp = (uint8_t)(floor(((*normals)[vert_num][comp_idx] + 1) * 127 + 0.5));
-                                        vert_buf[vert_buf_ptr] = comp;
-                                        vert_buf_ptr++;
-                                    }
-
-                                    // Padding to align with 4 bytes
-                                    vert_buf[vert_buf_ptr] = 0;
-                                    vert_buf_ptr++;
-                                    
-                                    if (has_tex) {
-                                        for (unsigned int comp_idx = 0; comp_idx < 2; comp_idx++) {
-                                            float wrap_tex = (*uvChannel)[vert_num][comp_idx];
-
-                                            if (comp_idx == 0)
-                                                wrap_tex = (wrap_tex - min_texcoordu) / (max_texcoordu - min_texcoordu);
-                                            else
-                                                wrap_tex = (wrap_tex - min_texcoordv) / (max_texcoordv - min_texcoordv);
-
-                                            uint16_t comp = (uint16_t)(floor((wrap_tex * 65535) + 0.5));
-                                           
-											bufferWrite(vert_buf, vert_buf_ptr, comp);
-											vert_buf_ptr += 2;
-                                        }
-                                    }
-									
-									//std::cout << "VN [" << vert_num << "] = [" << new_vertex_id << "];" << std::endl;
-									//std::cout << "v " << vertex_quant[vert_num][0] << " " << vertex_quant[vert_num][1] << " " << vertex_quant[vert_num][2] << std::endl;
-									vertex_map[vert_num] = new_vertex_id;
-                                    new_vertex_id += 1;
-                                    added_verts += 1;
-                                }
+                            // Padding to align with 4 bytes
+                            if (OCTAHEDRAL_8BIT != normalEncoding) {
+                                bufferWrite(vert_buf, vert_buf_ptr, 0);
+                                vert_buf_ptr += 2;
                             }
 
-							//std::cout << "f ";
+                            // Write normals in the requested encoding
+                            vert_buf_ptr += bufferWriteNormal(vert_buf, vert_buf_ptr,
+                                normals[vert_num], normalEncoding);
 
-                            for(unsigned int vert_idx = 0; vert_idx < 3; vert_idx++) {
-                                unsigned int vert_num = curr_face.mIndices[vert_idx];
-								//std::cout << "(" << vert_num << ")";
-								//if (vertex_map[vert_num] > 65535)
-								//	std::cout << "Not WebGL compatible = " << vertex_map[vert_num] << std::endl;
+                            if (has_tex) {
+                                for (unsigned int comp_idx = 0; comp_idx < 2; comp_idx++) {
+                                    float wrap_tex = (*uvChannel)[vert_num][comp_idx];
 
-								//std::cout << (vertex_map[vert_num] + 1) << " ";
+                                    if (comp_idx == 0)
+                                        wrap_tex = (wrap_tex - min_texcoordu) / (max_texcoordu - min_texcoordu);
+                                    else
+                                        wrap_tex = (wrap_tex - min_texcoordv) / (max_texcoordv - min_texcoordv);
 
-                                uint16_t mapped_id = (uint16_t)vertex_map[vert_num];
+                                    uint16_t comp = (uint16_t)(floor((wrap_tex * 65535) + 0.5));
 
-								bufferWrite(idx_buf, idx_buf_ptr, mapped_id);
-								idx_buf_ptr+=2;
+                                    bufferWrite(vert_buf, vert_buf_ptr, comp);
+                                    vert_buf_ptr += 2;
+                                }
                             }
 
-							//std::cout << std::endl;
-
-                            num_indices += 3;
+                            vertex_map[vert_num] = new_vertex_id;
+                            new_vertex_id += 1;
+                            added_verts += 1;
                         }
                     }
 
-                  }
-
-                  mongo::BSONObjBuilder lod_bson;
-
-                  repo::core::RepoTranscoderBSON::append("mesh_id", mesh->getUniqueID(), lod_bson);
-				  repo::core::RepoTranscoderBSON::append("_id", boost::uuids::random_generator()(), lod_bson);
-				  lod_bson.append("level", lod);
-                  lod_bson.append("num_idx", num_indices);
-                  lod_bson.append("type", "PopGeometryLevel");
-                  lod_bson.append("vert_buf", mongo::BSONBinData((void *)vert_buf, vert_buf_ptr, mongo::BinDataGeneral));
-                  lod_bson.append("idx_buf", mongo::BSONBinData((void *)idx_buf, idx_buf_ptr, mongo::BinDataGeneral));
-                  lod_bson.append("vert_buf_offset", buf_offset);
-                  lod_bson.append("num_vertices", prev_added_verts);
-                  prev_added_verts = added_verts;
-                  buf_offset += vert_buf_ptr;
-                    
-                  out.push_back(lod_bson.obj());
-
-                  lod++;
+                    for(unsigned int vert_idx = 0; vert_idx < 3; vert_idx++) {
+                        unsigned int vert_num = curr_face.mIndices[vert_idx];
+
+                        // Chunks never exceed REPO_RENDER_MAX_CHUNK_VERTICES
+                        uint16_t mapped_id = (uint16_t)vertex_map[vert_num];
+
+                        bufferWrite(idx_buf, idx_buf_ptr, mapped_id);
+                        idx_buf_ptr+=2;
+                    }
+
+                    num_indices += 3;
                 }
             }
         }
+
+        mongo::BSONObjBuilder lod_bson;
+
+        repo::core::RepoTranscoderBSON::append("mesh_id", mesh->getUniqueID(), lod_bson);
+        repo::core::RepoTranscoderBSON::append("_id", boost::uuids::random_generator()(), lod_bson);
+        repo::core::RepoTranscoderBSON::append("chunk_id", chunkID, lod_bson);
+        lod_bson.append("level", lod);
+        lod_bson.append("num_idx", num_indices);
+        lod_bson.append("type", "PopGeometryLevel");
+        lod_bson.append("vert_buf", mongo::BSONBinData((void *)vert_buf, vert_buf_ptr, mongo::BinDataGeneral));
+        lod_bson.append("idx_buf", mongo::BSONBinData((void *)idx_buf, idx_buf_ptr, mongo::BinDataGeneral));
+        lod_bson.append("vert_buf_offset", buf_offset);
+        lod_bson.append("num_vertices", prev_added_verts);
+        prev_added_verts = added_verts;
+        buf_offset += vert_buf_ptr;
+
+        out.push_back(lod_bson.obj());
+
+        // BSON builder keeps its own copy of the binary data
+        delete[] vert_buf;
+        delete[] idx_buf;
+
+        if (statistics.lodMilliseconds.size() <= lod)
+        {
+            statistics.lodMilliseconds.resize(lod + 1, 0.0);
+            statistics.lodBytes.resize(lod + 1, 0);
+            statistics.lodIndices.resize(lod + 1, 0);
+        }
+        statistics.lodMilliseconds[lod] +=
+            std::chrono::duration<double, std::milli>(
+                std::chrono::high_resolution_clock::now() - lodStart).count();
+        statistics.lodBytes[lod] += out.back().objsize();
+        statistics.lodIndices[lod] += num_indices;
+        statistics.outputBytes += out.back().objsize();
+
+        lod++;
     }
 }
-
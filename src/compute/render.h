@@ -23,6 +23,9 @@
 #include "../graph/repo_node_abstract.h"
 #include "../graph/repo_node_mesh.h"
 #include "../conversion/repo_transcoder_bson.h"
+#include "../conversion/repo_transcoder_string.h"
+#include "repo_triangulator.h"
+#include "repo_prepared_mesh.h"
 #include "mongo/bson/bsontypes.h"
 
 
@@ -31,6 +34,9 @@
 #include <set>
 #include <iostream>
 #include <bitset>
+#include <limits>
+#include <algorithm>
+#include <chrono>
 
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
@@ -42,15 +48,116 @@
 namespace repo {
 namespace core {
 
+//! Largest number of vertices addressable by 16-bit PopGeometry indices.
+#define REPO_RENDER_MAX_CHUNK_VERTICES 65535
+
+//! Timings and sizes collected by the last call to Renderer::renderToBSONs.
+struct REPO_CORE_EXPORT RenderStatistics
+{
+    unsigned long long meshes; //!< Number of meshes rendered
+    unsigned long long chunks; //!< Number of PopGeometries written
+    unsigned long long triangles; //!< Number of input faces processed
+    unsigned long long vertices; //!< Number of input vertices processed
+    unsigned long long outputBytes; //!< Total size of the produced BSONs
+    double totalMilliseconds; //!< Wall clock time of the whole render
+
+    //! Accumulated over all meshes, indexed by the LOD level.
+    std::vector<double> lodMilliseconds;
+    std::vector<unsigned long long> lodBytes;
+    std::vector<unsigned long long> lodIndices;
+
+    RenderStatistics()
+        : meshes(0)
+        , chunks(0)
+        , triangles(0)
+        , vertices(0)
+        , outputBytes(0)
+        , totalMilliseconds(0.0) {}
+};
+
 class REPO_CORE_EXPORT Renderer
 {
+    public:
+
+        //! Per vertex normal encodings supported by the PopGeometry output.
+        /*!
+         * XYZ_8BIT is the original 3 x 8-bit (n + 1) * 127 encoding padded
+         * to 4 bytes. OCTAHEDRAL_8BIT and OCTAHEDRAL_16BIT map the unit normal
+         * onto an octahedron unfolded into the [-1, 1] square and store it as
+         * two unsigned normalised components.
+         */
+        enum NormalEncoding { XYZ_8BIT = 0, OCTAHEDRAL_8BIT, OCTAHEDRAL_16BIT };
+
     private:
         RepoGraphScene *scene;
 
+        NormalEncoding normalEncoding;
+
+        RenderStatistics statistics;
+
+        //! Writes a PopGeometry header and its LOD levels for one chunk.
+        /*!
+         * Vertices are quantised within the bounding box of the whole mesh
+         * (see RepoPreparedMesh) so that all chunks of a mesh share the same
+         * quantisation space.
+         */
+        void renderPopGeometry(
+            const RepoNodeMesh *mesh,
+            const boost::uuids::uuid &chunkID,
+            const std::vector<aiVector3t<uint16_t> > &vertex_quant,
+            const std::vector<aiVector3t<float> > &normals,
+            const std::vector<aiVector3t<float> > *uvChannel,
+            const std::vector<aiFace> &faces,
+            mongo::BSONObjBuilder &head_bson,
+            std::vector<mongo::BSONObj> &out);
+
     public:
-        Renderer(RepoGraphScene *scene) : scene(scene) {}
+        Renderer(RepoGraphScene *scene,
+                 NormalEncoding normalEncoding = XYZ_8BIT)
+            : scene(scene)
+            , normalEncoding(normalEncoding) {}
 
+        //! Renders all meshes of the scene into PopGeometry BSONs.
+        /*!
+         * Meshes with more than REPO_RENDER_MAX_CHUNK_VERTICES vertices are
+         * split into chunks, each written as a separate PopGeometry. Every
+         * header carries its "chunk" index, "num_chunks" and a "chunks" table
+         * listing the ids and sizes of all the chunks of the mesh. LOD levels
+         * reference their PopGeometry by "chunk_id".
+         */
         void renderToBSONs(std::vector<mongo::BSONObj> &out);
+
+        //! Renders a single preprocessed mesh, statistics are accumulated.
+        void renderMesh(
+            const RepoPreparedMesh &prepared,
+            std::vector<mongo::BSONObj> &out);
+
+        //! Splits triangles into chunks of at most maxVertices vertices.
+        /*!
+         * Triangles are ordered along a Morton curve through their centroids
+         * and greedily assigned to chunks so that each chunk covers a compact
+         * region and shares as many vertices as possible.
+         *
+         * \return Indices of faces per chunk, non-triangles are skipped
+         */
+        static std::vector<std::vector<unsigned int> > splitIntoChunks(
+            const std::vector<aiVector3t<float> > &vertices,
+            const std::vector<aiFace> &faces,
+            const RepoBoundingBox &bbox,
+            unsigned int maxVertices = REPO_RENDER_MAX_CHUNK_VERTICES);
+
+        //! Returns statistics of the last renderToBSONs call.
+        const RenderStatistics &getStatistics() const
+        { return statistics; }
+
+        //! Returns the label stored in the PopGeometry header for an encoding.
+        static std::string getNormalEncodingLabel(NormalEncoding encoding);
+
+        //! Encodes a unit normal into octahedral coordinates in [-1, 1].
+        static aiVector2t<float> octahedralEncode(const aiVector3t<float> &normal);
+
+        //! Decodes octahedral coordinates in [-1, 1] back to a unit normal.
+        static aiVector3t<float> octahedralDecode(const aiVector2t<float> &oct);
 };
 
 }
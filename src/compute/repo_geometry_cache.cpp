@@ -0,0 +1,188 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "repo_geometry_cache.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+//------------------------------------------------------------------------------
+// glTF accessor component types
+#define REPO_GLTF_UNSIGNED_SHORT 5123
+#define REPO_GLTF_UNSIGNED_INT   5125
+
+//! Writes a little endian value of type T at the given byte position.
+template <class T>
+inline void bufferWriteLE(std::vector<char> &buf, size_t position, T val)
+{
+	for (unsigned int i = 0; i < sizeof(T); ++i)
+		buf[position + i] = (char)((val >> (8 * i)) & 0xFF);
+}
+
+inline void bufferWriteFloat(std::vector<char> &buf, size_t position, float val)
+{
+	uint32_t bits;
+	memcpy(&bits, &val, sizeof(bits));
+	bufferWriteLE(buf, position, bits);
+}
+
+//! Maps a normal component in [-1, 1] to a normalised signed byte.
+inline char quantizeSignedByte(float val)
+{
+	if (!std::isfinite(val)) val = 0.0f;
+	if (val < -1.0f) val = -1.0f;
+	if (val > 1.0f) val = 1.0f;
+	return (char)(int8_t) floor(val * 127.0f + 0.5f);
+}
+
+inline mongo::BSONObj toBSONArray(float x, float y, float z)
+{
+	mongo::BSONObjBuilder builder;
+	builder.append("0", x);
+	builder.append("1", y);
+	builder.append("2", z);
+	return builder.obj();
+}
+
+void repo::core::RepoGLTFBufferEncoder::encode(
+	const RepoPreparedMesh &mesh,
+	std::vector<mongo::BSONObj> &out)
+{
+	const std::vector<aiVector3t<uint16_t> > &quantized = mesh.getQuantizedVertices();
+	const std::vector<aiVector3t<float> > &normals = mesh.getNormals();
+	const std::vector<aiVector3t<float> > *uvChannel = mesh.getUVChannel();
+	const std::vector<aiFace> &faces = mesh.getFaces();
+
+	size_t num_verts = quantized.size();
+	size_t num_indices = 3 * faces.size();
+	bool shortIndices = num_verts <= 65536;
+
+	//--------------------------------------------------------------------------
+	// Attributes
+	std::vector<char> positions(8 * num_verts, 0);
+	std::vector<char> normalBuf(4 * num_verts, 0);
+	std::vector<char> texcoords(uvChannel ? 8 * num_verts : 0, 0);
+	for (size_t vert_num = 0; vert_num < num_verts; ++vert_num)
+	{
+		for (unsigned int comp_idx = 0; comp_idx < 3; comp_idx++)
+		{
+			bufferWriteLE(positions, 8 * vert_num + 2 * comp_idx,
+				quantized[vert_num][comp_idx]);
+			normalBuf[4 * vert_num + comp_idx] =
+				quantizeSignedByte(normals[vert_num][comp_idx]);
+		}
+
+		if (uvChannel)
+		{
+			bufferWriteFloat(texcoords, 8 * vert_num, (*uvChannel)[vert_num][0]);
+			bufferWriteFloat(texcoords, 8 * vert_num + 4, 1.0f - (*uvChannel)[vert_num][1]);
+		}
+	}
+
+	//--------------------------------------------------------------------------
+	// Indices
+	std::vector<char> indices(num_indices * (shortIndices ? 2 : 4), 0);
+	for (size_t f = 0; f < faces.size(); ++f)
+		for (unsigned int vert_idx = 0; vert_idx < 3; vert_idx++)
+		{
+			size_t i = 3 * f + vert_idx;
+			if (shortIndices)
+				bufferWriteLE(indices, 2 * i, (uint16_t) faces[f].mIndices[vert_idx]);
+			else
+				bufferWriteLE(indices, 4 * i, (uint32_t) faces[f].mIndices[vert_idx]);
+		}
+
+	//--------------------------------------------------------------------------
+	const RepoBoundingBox &bbox = mesh.getBoundingBox();
+
+	mongo::BSONObjBuilder builder;
+	RepoTranscoderBSON::append("mesh_id", mesh.getMesh()->getUniqueID(), builder);
+	RepoTranscoderBSON::append("_id", boost::uuids::random_generator()(), builder);
+	builder.append("type", "GLTFBuffer");
+	builder.append("num_vertices", (unsigned int) num_verts);
+	builder.append("num_indices", (unsigned int) num_indices);
+	builder.append("index_component_type", shortIndices
+		? REPO_GLTF_UNSIGNED_SHORT : REPO_GLTF_UNSIGNED_INT);
+	builder.appendArray("decode_offset", toBSONArray(
+		bbox.getMin()[0], bbox.getMin()[1], bbox.getMin()[2]));
+	builder.appendArray("decode_scale", toBSONArray(
+		bbox.getLengthX(), bbox.getLengthY(), bbox.getLengthZ()));
+	builder.append("normals_generated", mesh.hasGeneratedNormals());
+
+	if (num_verts)
+	{
+		builder.append("positions", mongo::BSONBinData((void *) &positions[0], (int) positions.size(), mongo::BinDataGeneral));
+		builder.append("normals", mongo::BSONBinData((void *) &normalBuf[0], (int) normalBuf.size(), mongo::BinDataGeneral));
+		if (uvChannel)
+			builder.append("texcoords", mongo::BSONBinData((void *) &texcoords[0], (int) texcoords.size(), mongo::BinDataGeneral));
+	}
+	if (num_indices)
+		builder.append("indices", mongo::BSONBinData((void *) &indices[0], (int) indices.size(), mongo::BinDataGeneral));
+
+	out.push_back(builder.obj());
+}
+
+//------------------------------------------------------------------------------
+
+void repo::core::RepoGeometryCache::registerEncoder(
+	RepoAbstractCacheEncoder *encoder)
+{
+	if (encoder)
+		encoders.push_back(encoder);
+}
+
+void repo::core::RepoGeometryCache::generate(
+	const RepoGraphScene *scene,
+	std::map<std::string, std::vector<mongo::BSONObj> > &out)
+{
+	timings.clear();
+	if (NULL == scene)
+		return;
+
+	for (unsigned int e = 0; e < encoders.size(); ++e)
+	{
+		timings[encoders[e]->getName()] = 0.0;
+		encoders[e]->begin(scene);
+	}
+	timings["preprocessing"] = 0.0;
+
+	const RepoNodeAbstractSet meshes = scene->getMeshes();
+	for (RepoNodeAbstractSet::const_iterator it = meshes.begin();
+		it != meshes.end(); ++it)
+	{
+		std::chrono::high_resolution_clock::time_point start =
+			std::chrono::high_resolution_clock::now();
+		RepoPreparedMesh prepared(RepoNodeAbstract::castNode<const RepoNodeMesh *>(*it));
+		timings["preprocessing"] += std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - start).count();
+
+		if (!prepared.isValid())
+			continue;
+
+		for (unsigned int e = 0; e < encoders.size(); ++e)
+		{
+			start = std::chrono::high_resolution_clock::now();
+			encoders[e]->encode(prepared, out[encoders[e]->getName()]);
+			timings[encoders[e]->getName()] += std::chrono::duration<double, std::milli>(
+				std::chrono::high_resolution_clock::now() - start).count();
+		}
+	}
+
+	for (unsigned int e = 0; e < encoders.size(); ++e)
+		encoders[e]->end(out[encoders[e]->getName()]);
+}
@@ -0,0 +1,171 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_GEOMETRY_CACHE_H
+#define REPO_GEOMETRY_CACHE_H
+//------------------------------------------------------------------------------
+#include <map>
+#include <string>
+#include <vector>
+//------------------------------------------------------------------------------
+#include "render.h"
+#include "repo_prepared_mesh.h"
+#include "../graph/repo_graph_scene.h"
+//------------------------------------------------------------------------------
+#include "../repocoreglobal.h"
+
+namespace repo {
+namespace core {
+
+//------------------------------------------------------------------------------
+//
+// Encoders
+//
+//------------------------------------------------------------------------------
+
+//! Output format of the geometry cache.
+/*!
+ * Encoders receive every mesh of a scene already preprocessed and append
+ * their representation of it to the output.
+ */
+class REPO_CORE_EXPORT RepoAbstractCacheEncoder
+{
+
+public :
+
+	virtual ~RepoAbstractCacheEncoder() {}
+
+	//! Unique name of the format, used to key the outputs.
+	virtual std::string getName() const = 0;
+
+	//! Called once before the first mesh of a scene.
+	virtual void begin(const RepoGraphScene *) {}
+
+	//! Encodes a single mesh.
+	virtual void encode(
+		const RepoPreparedMesh &mesh,
+		std::vector<mongo::BSONObj> &out) = 0;
+
+	//! Called once after the last mesh of a scene.
+	virtual void end(std::vector<mongo::BSONObj> &) {}
+
+}; // end class
+
+//! PopGeometry progressive buffers as produced by the Renderer.
+class REPO_CORE_EXPORT RepoPopGeometryEncoder : public RepoAbstractCacheEncoder
+{
+
+public :
+
+	RepoPopGeometryEncoder(
+		Renderer::NormalEncoding normalEncoding = Renderer::XYZ_8BIT)
+		: renderer(NULL, normalEncoding) {}
+
+	std::string getName() const { return "popgeometry"; }
+
+	void encode(
+		const RepoPreparedMesh &mesh,
+		std::vector<mongo::BSONObj> &out)
+	{ renderer.renderMesh(mesh, out); }
+
+	//! Returns statistics accumulated over all encoded meshes.
+	const RenderStatistics &getStatistics() const
+	{ return renderer.getStatistics(); }
+
+private :
+
+	Renderer renderer;
+
+}; // end class
+
+//! Quantised vertex buffers laid out for glTF with KHR_mesh_quantization.
+/*!
+ * Per mesh writes a single document with separate binary buffers:
+ * "positions" as normalised unsigned shorts padded to 8 bytes, "normals" as
+ * normalised signed bytes padded to 4 bytes, optional "texcoords" as floats
+ * with the V coordinate flipped to the glTF convention and "indices" as
+ * unsigned shorts or ints depending on the number of vertices. Positions
+ * are decoded as decode_offset + position * decode_scale.
+ */
+class REPO_CORE_EXPORT RepoGLTFBufferEncoder : public RepoAbstractCacheEncoder
+{
+
+public :
+
+	std::string getName() const { return "gltf"; }
+
+	void encode(
+		const RepoPreparedMesh &mesh,
+		std::vector<mongo::BSONObj> &out);
+
+}; // end class
+
+//------------------------------------------------------------------------------
+//
+// Cache
+//
+//------------------------------------------------------------------------------
+
+//! Generates several geometry cache formats in a single pass over a scene.
+/*!
+ * Each mesh is loaded and preprocessed (triangulation, normals,
+ * quantisation) exactly once and the shared result is handed to all the
+ * registered encoders before moving on to the next mesh.
+ */
+class REPO_CORE_EXPORT RepoGeometryCache
+{
+
+public :
+
+	RepoGeometryCache() {}
+
+	~RepoGeometryCache() {}
+
+	//! Adds an encoder, the caller retains ownership.
+	void registerEncoder(RepoAbstractCacheEncoder *encoder);
+
+	const std::vector<RepoAbstractCacheEncoder *> &getEncoders() const
+	{ return encoders; }
+
+	//! Encodes all meshes of the scene with all registered encoders.
+	/*!
+	 * \param scene Scene to be cached
+	 * \param out Produced documents keyed by the encoder name
+	 */
+	void generate(
+		const RepoGraphScene *scene,
+		std::map<std::string, std::vector<mongo::BSONObj> > &out);
+
+	//! Returns milliseconds spent in the last generate call.
+	/*!
+	 * Keyed by the encoder name, preprocessing is under "preprocessing".
+	 */
+	const std::map<std::string, double> &getTimings() const
+	{ return timings; }
+
+private :
+
+	std::vector<RepoAbstractCacheEncoder *> encoders;
+
+	std::map<std::string, double> timings;
+
+}; // end class
+
+} // end namespace core
+} // end namespace repo
+
+#endif // REPO_GEOMETRY_CACHE_H
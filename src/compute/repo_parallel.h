@@ -0,0 +1,116 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_PARALLEL_H
+#define REPO_PARALLEL_H
+
+//------------------------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <vector>
+//------------------------------------------------------------------------------
+#include <boost/thread.hpp>
+//------------------------------------------------------------------------------
+#include "../repocoreglobal.h"
+
+namespace repo {
+namespace core {
+
+//! Runs work on short-lived threads shared by all parallel passes.
+/*!
+ * An exception escaping a function run on a worker is passed back and the
+ * first one rethrown on the calling thread once all workers have finished.
+ * Functions which must clean up or recover per item catch within.
+ */
+class REPO_CORE_EXPORT RepoParallel
+{
+
+public :
+
+	//! Returns the given number of threads, the hardware concurrency if 0.
+	static unsigned int getThreadCount(unsigned int threads)
+	{
+		return threads ? threads
+			: std::max(1u, boost::thread::hardware_concurrency());
+	}
+
+	//! Calls the function with every worker index below workers, each on a
+	//! thread of its own, and waits for all of them.
+	template <class Function>
+	static void run(unsigned int workers, const Function &function)
+	{
+		std::vector<std::exception_ptr> errors(workers);
+		boost::thread_group group;
+		try
+		{
+			for (unsigned int w = 0; w < workers; ++w)
+				group.create_thread([&function, &errors, w]()
+				{
+					try
+					{
+						function(w);
+					}
+					catch (...)
+					{
+						errors[w] = std::current_exception();
+					}
+				});
+		}
+		catch (...)
+		{
+			// Threads already started refer to this frame
+			group.join_all();
+			throw;
+		}
+		group.join_all();
+
+		for (unsigned int w = 0; w < workers; ++w)
+			if (errors[w])
+				std::rethrow_exception(errors[w]);
+	}
+
+	//! Calls the function with every index below count and waits for all.
+	/*!
+	 * Workers pull the next index from a shared counter so that uneven costs
+	 * balance out. No more threads than indices are started.
+	 *
+	 * \param threads Number of threads, 0 uses the hardware concurrency
+	 */
+	template <class Function>
+	static void forEach(
+		size_t count,
+		unsigned int threads,
+		const Function &function)
+	{
+		std::atomic<size_t> next(0);
+		run(static_cast<unsigned int>(
+			std::min<size_t>(getThreadCount(threads), count)),
+			[&](unsigned int)
+			{
+				for (size_t i = next++; i < count; i = next++)
+					function(i);
+			});
+	}
+
+}; // end class
+
+} // end namespace core
+} // end namespace repo
+
+#endif // end REPO_PARALLEL_H
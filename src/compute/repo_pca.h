@@ -149,6 +149,20 @@ public :
     RepoBoundingBox getUVWBoundingBox() const
     { return RepoBoundingBox(uvwMin, uvwMax); }
 
+    //! Returns bytes of heap memory held by the UVW vertices and components.
+    size_t getHeapSize() const
+    {
+        return getVerticesHeapSize()
+            + principalComponents.capacity() * sizeof(RepoPrincipalComponent);
+    }
+
+    //! Returns bytes of heap memory held by the UVW vertices alone.
+    size_t getVerticesHeapSize() const
+    { return uvwVertices.capacity() * sizeof(RepoVertex); }
+
+    //! Deallocates the UVW vertices, keeps the components and bounding boxes.
+    void releaseVertices() { std::vector<RepoVertex>().swap(uvwVertices); }
+
     //--------------------------------------------------------------------------
 	//
 	// Transformations
@@ -0,0 +1,76 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "repo_prepared_mesh.h"
+#include "repo_triangulator.h"
+
+#include <cmath>
+
+repo::core::RepoPreparedMesh::RepoPreparedMesh(const RepoNodeMesh *mesh)
+	: mesh(mesh)
+	, vertices(NULL)
+	, normals(NULL)
+	, uvChannel(NULL)
+	, faces(NULL)
+{
+	if (NULL == mesh)
+		return;
+
+	vertices = mesh->getVertices();
+	faces = mesh->getFaces();
+	if (!isValid())
+		return;
+
+	size_t num_verts = vertices->size();
+	uvChannel = mesh->getUVChannel(0);
+
+	//--------------------------------------------------------------------------
+	// Generate normals on the fly if the mesh does not have any
+	normals = mesh->getNormals();
+	if (normals == NULL || normals->size() < num_verts)
+	{
+		generatedNormals = mesh->calculateNormals();
+		normals = &generatedNormals;
+	}
+
+	//--------------------------------------------------------------------------
+	// Cache outputs index triangles only
+	if (!RepoTriangulator::isTriangulated(*faces))
+	{
+		triangulatedFaces = RepoTriangulator::triangulate(*vertices, *faces);
+		faces = &triangulatedFaces;
+	}
+
+	//--------------------------------------------------------------------------
+	// Quantise vertices to 16 bits per component within the bounding box
+	const RepoBoundingBox &bbox = mesh->getBoundingBox();
+	float bboxSizeX = (bbox.getMax()[0] - bbox.getMin()[0]);
+	float bboxSizeY = (bbox.getMax()[1] - bbox.getMin()[1]);
+	float bboxSizeZ = (bbox.getMax()[2] - bbox.getMin()[2]);
+
+	const unsigned int max_bits = 16;
+	float max_quant = powf(2.0f, (float)max_bits) - 1.0f;
+
+	quantizedVertices.resize(num_verts);
+	for (unsigned int vert_num = 0; vert_num < num_verts; vert_num++)
+	{
+		const aiVector3t<float> &v = (*vertices)[vert_num];
+		quantizedVertices[vert_num][0] = (uint16_t)floor(((v[0] - bbox.getMin()[0]) / bboxSizeX) * max_quant + 0.5f);
+		quantizedVertices[vert_num][1] = (uint16_t)floor(((v[1] - bbox.getMin()[1]) / bboxSizeY) * max_quant + 0.5f);
+		quantizedVertices[vert_num][2] = (uint16_t)floor(((v[2] - bbox.getMin()[2]) / bboxSizeZ) * max_quant + 0.5f);
+	}
+}
@@ -0,0 +1,110 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_PREPARED_MESH_H
+#define REPO_PREPARED_MESH_H
+//------------------------------------------------------------------------------
+#include <vector>
+#include <stdint.h>
+//------------------------------------------------------------------------------
+#include "../graph/repo_node_mesh.h"
+#include "../graph/repo_bounding_box.h"
+//------------------------------------------------------------------------------
+#include "../repocoreglobal.h"
+
+namespace repo {
+namespace core {
+
+//! Mesh preprocessed once for all geometry cache outputs.
+/*!
+ * Holds the intermediate buffers every cache encoder needs: triangulated
+ * faces, per vertex normals (generated if the mesh has none) and vertices
+ * quantised to 16 bits within the mesh bounding box. Buffers that can be
+ * used as they are, such as the vertices and texture coordinates, are
+ * referenced from the mesh rather than copied, hence the mesh has to
+ * outlive this object.
+ */
+class REPO_CORE_EXPORT RepoPreparedMesh
+{
+
+public :
+
+	//! Preprocesses the given mesh.
+	RepoPreparedMesh(const RepoNodeMesh *mesh);
+
+	//! Returns false if the mesh has no vertices or faces to be cached.
+	bool isValid() const
+	{ return NULL != vertices && NULL != faces; }
+
+	const RepoNodeMesh *getMesh() const
+	{ return mesh; }
+
+	const RepoBoundingBox &getBoundingBox() const
+	{ return mesh->getBoundingBox(); }
+
+	//! Returns vertices of the mesh.
+	const std::vector<aiVector3t<float> > &getVertices() const
+	{ return *vertices; }
+
+	//! Returns one normal per vertex.
+	const std::vector<aiVector3t<float> > &getNormals() const
+	{ return *normals; }
+
+	//! Returns true if the normals had to be calculated.
+	bool hasGeneratedNormals() const
+	{ return normals == &generatedNormals; }
+
+	//! Returns the first UV channel or NULL if there is none.
+	const std::vector<aiVector3t<float> > *getUVChannel() const
+	{ return uvChannel; }
+
+	//! Returns triangles only.
+	const std::vector<aiFace> &getFaces() const
+	{ return *faces; }
+
+	//! Returns vertices quantised to [0, 65535] within the bounding box.
+	const std::vector<aiVector3t<uint16_t> > &getQuantizedVertices() const
+	{ return quantizedVertices; }
+
+private :
+
+	//! Buffers point into this object, copying is not supported.
+	RepoPreparedMesh(const RepoPreparedMesh &);
+	RepoPreparedMesh &operator=(const RepoPreparedMesh &);
+
+	const RepoNodeMesh *mesh;
+
+	const std::vector<aiVector3t<float> > *vertices;
+
+	const std::vector<aiVector3t<float> > *normals;
+
+	const std::vector<aiVector3t<float> > *uvChannel;
+
+	const std::vector<aiFace> *faces;
+
+	std::vector<aiVector3t<float> > generatedNormals;
+
+	std::vector<aiFace> triangulatedFaces;
+
+	std::vector<aiVector3t<uint16_t> > quantizedVertices;
+
+}; // end class
+
+} // end namespace core
+} // end namespace repo
+
+#endif // REPO_PREPARED_MESH_H
@@ -0,0 +1,284 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "repo_similarity_index.h"
+#include "repo_parallel.h"
+#include "repo_pca.h"
+
+#include <algorithm>
+#include <functional>
+#include <set>
+
+//------------------------------------------------------------------------------
+
+//! Orders entries of the order vector by one dimension of their features.
+struct RepoSimilarityAxisLess
+{
+	const std::vector<repo::core::RepoSimilarityFeatures> &features;
+	unsigned int axis;
+
+	bool operator()(size_t a, size_t b) const
+	{ return features[a].values[axis] < features[b].values[axis]; }
+};
+
+//------------------------------------------------------------------------------
+//
+// Construction
+//
+//------------------------------------------------------------------------------
+
+void repo::core::RepoSimilarityIndex::build(
+	const std::vector<const RepoNodeMesh *> &meshes,
+	unsigned int threads)
+{
+	std::vector<RepoSimilarityFeatures> computed(meshes.size());
+	std::vector<char> valid(meshes.size(), 0);
+	RepoParallel::forEach(meshes.size(), threads, [&](size_t i)
+	{
+		valid[i] = getFeatures(meshes[i], computed[i]);
+	});
+
+	features.clear();
+	std::vector<const RepoNodeMesh *> indexed;
+	for (size_t i = 0; i < meshes.size(); ++i)
+		if (valid[i])
+		{
+			features.push_back(computed[i]);
+			indexed.push_back(meshes[i]);
+		}
+
+	std::vector<size_t> order(indexed.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+	axes.assign(order.size(), 0);
+	build(order, 0, order.size());
+
+	// Entries are stored in the order of the tree
+	this->meshes.resize(order.size());
+	computed.resize(order.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		this->meshes[i] = indexed[order[i]];
+		computed[i] = features[order[i]];
+	}
+	features.swap(computed);
+}
+
+void repo::core::RepoSimilarityIndex::build(
+	std::vector<size_t> &order,
+	size_t first,
+	size_t last)
+{
+	if (last - first < 2)
+		return;
+
+	//--------------------------------------------------------------------------
+	// Split along the dimension of the largest spread at the median
+	double min[REPO_SIMILARITY_DIMENSIONS];
+	double max[REPO_SIMILARITY_DIMENSIONS];
+	for (unsigned int d = 0; d < REPO_SIMILARITY_DIMENSIONS; ++d)
+		min[d] = max[d] = features[order[first]].values[d];
+	for (size_t i = first + 1; i < last; ++i)
+		for (unsigned int d = 0; d < REPO_SIMILARITY_DIMENSIONS; ++d)
+		{
+			double value = features[order[i]].values[d];
+			min[d] = std::min(min[d], value);
+			max[d] = std::max(max[d], value);
+		}
+	unsigned int axis = 0;
+	for (unsigned int d = 1; d < REPO_SIMILARITY_DIMENSIONS; ++d)
+		if (max[d] - min[d] > max[axis] - min[axis])
+			axis = d;
+
+	size_t middle = first + (last - first) / 2;
+	RepoSimilarityAxisLess less = { features, axis };
+	std::nth_element(order.begin() + first, order.begin() + middle,
+		order.begin() + last, less);
+	axes[middle] = static_cast<uint8_t>(axis);
+
+	build(order, first, middle);
+	build(order, middle + 1, last);
+}
+
+//------------------------------------------------------------------------------
+//
+// Queries
+//
+//------------------------------------------------------------------------------
+
+void repo::core::RepoSimilarityIndex::queryNearest(
+	const RepoSimilarityFeatures &features,
+	unsigned int k,
+	std::vector<const RepoNodeMesh *> &result) const
+{
+	if (0 == k)
+		return;
+	std::vector<std::pair<double, size_t> > heap;
+	heap.reserve(k + 1);
+	queryNearest(0, meshes.size(), features, k, heap);
+
+	std::sort_heap(heap.begin(), heap.end());
+	for (size_t i = 0; i < heap.size(); ++i)
+		result.push_back(meshes[heap[i].second]);
+}
+
+void repo::core::RepoSimilarityIndex::queryNearest(
+	size_t first,
+	size_t last,
+	const RepoSimilarityFeatures &features,
+	unsigned int k,
+	std::vector<std::pair<double, size_t> > &heap) const
+{
+	if (first >= last)
+		return;
+
+	size_t middle = first + (last - first) / 2;
+	double distance = features.getSquaredDistance(this->features[middle]);
+	if (heap.size() < k || distance < heap.front().first)
+	{
+		heap.push_back(std::make_pair(distance, middle));
+		std::push_heap(heap.begin(), heap.end());
+		if (heap.size() > k)
+		{
+			std::pop_heap(heap.begin(), heap.end());
+			heap.pop_back();
+		}
+	}
+
+	//--------------------------------------------------------------------------
+	// Nearer side first, the other only if the splitting plane is closer
+	// than the farthest of the entries found so far
+	unsigned int axis = axes[middle];
+	double offset = features.values[axis] - this->features[middle].values[axis];
+	if (offset < 0)
+		queryNearest(first, middle, features, k, heap);
+	else
+		queryNearest(middle + 1, last, features, k, heap);
+
+	if (heap.size() < k || offset * offset < heap.front().first)
+	{
+		if (offset < 0)
+			queryNearest(middle + 1, last, features, k, heap);
+		else
+			queryNearest(first, middle, features, k, heap);
+	}
+}
+
+//------------------------------------------------------------------------------
+//
+// Static helpers
+//
+//------------------------------------------------------------------------------
+
+bool repo::core::RepoSimilarityIndex::getFeatures(
+	const RepoNodeMesh *mesh,
+	RepoSimilarityFeatures &features)
+{
+	const std::vector<aiVector3D> *vertices = mesh->getVertices();
+	if (!vertices || vertices->empty())
+		return false;
+
+	RepoPCA pca;
+	pca.initialize(*vertices);
+	std::vector<RepoPrincipalComponent> components = pca.getPrincipalComponents();
+	double magnitudes[3] = { 0, 0, 0 };
+	for (unsigned int i = 0; i < 3 && i < components.size(); ++i)
+		magnitudes[i] = components[i].magnitude;
+	std::sort(magnitudes, magnitudes + 3, std::greater<double>());
+
+	aiVector3D centroid = mesh->getWorldMatrix() * aiVector3D(pca.getCentroid());
+	const RepoBoundingBox &box = mesh->getWorldBoundingBox();
+	aiVector3D extents = box.getMax() - box.getMin();
+
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+		features.values[i] = magnitudes[i];
+		features.values[3 + i] = centroid[i];
+		features.values[6 + i] = extents[i];
+	}
+	return true;
+}
+
+bool repo::core::RepoSimilarityIndex::isSimilar(
+	const RepoNodeMesh *a,
+	const RepoNodeMesh *b,
+	double tolerance)
+{
+	const std::vector<aiVector3D> *verticesA = a->getVertices();
+	const std::vector<aiVector3D> *verticesB = b->getVertices();
+	if (!verticesA || !verticesB || verticesA->size() != verticesB->size())
+		return false;
+
+	size_t facesA = a->getFaces() ? a->getFaces()->size() : 0;
+	size_t facesB = b->getFaces() ? b->getFaces()->size() : 0;
+	if (facesA != facesB)
+		return false;
+
+	const RepoBoundingBox &box = a->getWorldBoundingBox();
+	double limit = tolerance * (box.getMax() - box.getMin()).Length();
+	limit *= limit;
+
+	const aiMatrix4x4 &worldA = a->getWorldMatrix();
+	const aiMatrix4x4 &worldB = b->getWorldMatrix();
+	for (size_t i = 0; i < verticesA->size(); ++i)
+	{
+		aiVector3D offset = worldA * (*verticesA)[i] - worldB * (*verticesB)[i];
+		if (offset.SquareLength() > limit)
+			return false;
+	}
+	return true;
+}
+
+std::map<boost::uuids::uuid, boost::uuids::uuid>
+	repo::core::RepoSimilarityIndex::match(
+	const std::vector<const RepoNodeMesh *> &a,
+	const std::vector<const RepoNodeMesh *> &b,
+	double tolerance,
+	unsigned int threads)
+{
+	RepoSimilarityIndex index;
+	index.build(a, threads);
+
+	//--------------------------------------------------------------------------
+	// Candidates are verified in parallel, nearest first
+	std::vector<std::vector<const RepoNodeMesh *> > similar(b.size());
+	if (!index.empty())
+		RepoParallel::forEach(b.size(), threads, [&](size_t j)
+		{
+			RepoSimilarityFeatures features;
+			if (!getFeatures(b[j], features))
+				return;
+			std::vector<const RepoNodeMesh *> candidates;
+			index.queryNearest(features, REPO_SIMILARITY_CANDIDATES, candidates);
+			for (size_t c = 0; c < candidates.size(); ++c)
+				if (isSimilar(candidates[c], b[j], tolerance))
+					similar[j].push_back(candidates[c]);
+		});
+
+	//--------------------------------------------------------------------------
+	// Assigned in order so that the result does not depend on the threads
+	std::map<boost::uuids::uuid, boost::uuids::uuid> correspondence;
+	std::set<const RepoNodeMesh *> assigned;
+	for (size_t j = 0; j < b.size(); ++j)
+		for (size_t c = 0; c < similar[j].size(); ++c)
+			if (assigned.insert(similar[j][c]).second)
+			{
+				correspondence[b[j]->getSharedID()] = similar[j][c]->getSharedID();
+				break;
+			}
+	return correspondence;
+}
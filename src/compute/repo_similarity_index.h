@@ -0,0 +1,209 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_SIMILARITY_INDEX_H
+#define REPO_SIMILARITY_INDEX_H
+
+//------------------------------------------------------------------------------
+#include <map>
+#include <stdint.h>
+#include <vector>
+//------------------------------------------------------------------------------
+#include <boost/uuid/uuid.hpp>
+//------------------------------------------------------------------------------
+#include "../graph/repo_node_mesh.h"
+#include "../repocoreglobal.h"
+
+namespace repo {
+namespace core {
+
+//! Number of features describing the shape and placement of a mesh.
+#define REPO_SIMILARITY_DIMENSIONS 9
+
+//! Number of nearest meshes verified as matches of a mesh.
+#define REPO_SIMILARITY_CANDIDATES 4
+
+//! Default distance of matching vertices relative to the size of the mesh.
+#define REPO_SIMILARITY_TOLERANCE 1e-4
+
+//! Shape and placement of a mesh in world coordinates.
+/*!
+ * Features are the extents of the PCA oriented bounding box in descending
+ * order, the centre of that box and the extents of the axis aligned world
+ * bounding box. All of them are lengths in the units of the model, hence
+ * the Euclidean distance between features is meaningful.
+ */
+struct REPO_CORE_EXPORT RepoSimilarityFeatures
+{
+	double values[REPO_SIMILARITY_DIMENSIONS];
+
+	//! Returns the squared Euclidean distance from the other features.
+	double getSquaredDistance(const RepoSimilarityFeatures &other) const
+	{
+		double distance = 0;
+		for (unsigned int i = 0; i < REPO_SIMILARITY_DIMENSIONS; ++i)
+			distance += (values[i] - other.values[i])
+				* (values[i] - other.values[i]);
+		return distance;
+	}
+};
+
+//! K-d tree over geometric features of meshes.
+/*!
+ * Finds meshes of similar shape at a similar place regardless of their IDs
+ * or names, such as meshes of a model re-exported from the authoring tool.
+ * Candidates are nearest neighbours in the feature space and are confirmed
+ * by isSimilar() which compares the vertices themselves.
+ *
+ * Features use world matrices of the meshes, which have to be up to date
+ * before the index is built from several threads, see
+ * RepoGraphScene::updateWorld(). Meshes without vertices, including those
+ * whose geometry has been released, are left out.
+ */
+class REPO_CORE_EXPORT RepoSimilarityIndex
+{
+
+public :
+
+	RepoSimilarityIndex() {}
+
+	~RepoSimilarityIndex() {}
+
+	//--------------------------------------------------------------------------
+	//
+	// Construction
+	//
+	//--------------------------------------------------------------------------
+
+	//! Builds the tree over features of the meshes.
+	/*!
+	 * \param meshes Meshes to index, they have to outlive the index
+	 * \param threads Number of threads computing the features, 0 uses the
+	 * hardware concurrency
+	 */
+	void build(
+		const std::vector<const RepoNodeMesh *> &meshes,
+		unsigned int threads = 0);
+
+	//--------------------------------------------------------------------------
+	//
+	// Getters
+	//
+	//--------------------------------------------------------------------------
+
+	//! Returns the number of indexed meshes.
+	size_t size() const { return meshes.size(); }
+
+	bool empty() const { return meshes.empty(); }
+
+	//! Returns the meshes in the order of the tree.
+	const std::vector<const RepoNodeMesh *> &getMeshes() const { return meshes; }
+
+	//! Returns bytes of heap memory held by the tree.
+	size_t getHeapSize() const
+	{
+		return meshes.capacity() * sizeof(const RepoNodeMesh *)
+			+ features.capacity() * sizeof(RepoSimilarityFeatures)
+			+ axes.capacity() * sizeof(uint8_t);
+	}
+
+	//--------------------------------------------------------------------------
+	//
+	// Queries
+	//
+	//--------------------------------------------------------------------------
+
+	//! Appends up to k meshes with features closest to the given ones.
+	/*!
+	 * Meshes are appended nearest first.
+	 */
+	void queryNearest(
+		const RepoSimilarityFeatures &features,
+		unsigned int k,
+		std::vector<const RepoNodeMesh *> &result) const;
+
+	//--------------------------------------------------------------------------
+	//
+	// Static helpers
+	//
+	//--------------------------------------------------------------------------
+
+	//! Computes features of the mesh, returns false if it has no vertices.
+	static bool getFeatures(
+		const RepoNodeMesh *mesh,
+		RepoSimilarityFeatures &features);
+
+	//! Returns true if the meshes have the same geometry within tolerance.
+	/*!
+	 * Meshes are similar if they have the same number of vertices and faces
+	 * and each vertex in world coordinates is within the tolerance, relative
+	 * to the diagonal of the world bounding box, of the vertex of the same
+	 * index of the other mesh. Exporters keep the order of vertices, hence
+	 * a reordered mesh is not similar.
+	 */
+	static bool isSimilar(
+		const RepoNodeMesh *a,
+		const RepoNodeMesh *b,
+		double tolerance = REPO_SIMILARITY_TOLERANCE);
+
+	//! Returns shared IDs of meshes of b mapped to those of similar meshes of a.
+	/*!
+	 * Each mesh of b is compared to its REPO_SIMILARITY_CANDIDATES nearest
+	 * meshes of a, in parallel. Meshes of b are then assigned the nearest
+	 * similar mesh in their order, every mesh of a being assigned at most
+	 * once.
+	 *
+	 * \param threads Number of threads, 0 uses the hardware concurrency
+	 */
+	static std::map<boost::uuids::uuid, boost::uuids::uuid> match(
+		const std::vector<const RepoNodeMesh *> &a,
+		const std::vector<const RepoNodeMesh *> &b,
+		double tolerance = REPO_SIMILARITY_TOLERANCE,
+		unsigned int threads = 0);
+
+private :
+
+	//! Orders the range into a subtree, its root being the middle entry.
+	/*!
+	 * Entries are positions in the order vector which maps them to indices
+	 * of the features as computed.
+	 */
+	void build(std::vector<size_t> &order, size_t first, size_t last);
+
+	//! Keeps the k nearest entries of the subtree of the range in the heap.
+	void queryNearest(
+		size_t first,
+		size_t last,
+		const RepoSimilarityFeatures &features,
+		unsigned int k,
+		std::vector<std::pair<double, size_t> > &heap) const;
+
+	//! Indexed meshes in the order of the tree.
+	std::vector<const RepoNodeMesh *> meshes;
+
+	//! Features of the meshes.
+	std::vector<RepoSimilarityFeatures> features;
+
+	//! Splitting dimension of the subtree rooted at each entry.
+	std::vector<uint8_t> axes;
+
+}; // end class
+
+} // end namespace core
+} // end namespace repo
+
+#endif // end REPO_SIMILARITY_INDEX_H
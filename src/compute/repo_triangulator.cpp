@@ -0,0 +1,234 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "repo_triangulator.h"
+#include "repo_parallel.h"
+#include "../graph/repo_graph_scene.h"
+#include "../graph/repo_node_mesh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+//! 2D cross product of (b - a) x (c - b), positive for a left turn.
+inline double turn(
+	const aiVector2t<double> &a,
+	const aiVector2t<double> &b,
+	const aiVector2t<double> &c)
+{
+	return (b.x - a.x) * (c.y - b.y) - (b.y - a.y) * (c.x - b.x);
+}
+
+//! Returns true if p lies inside or on the boundary of CCW triangle abc.
+inline bool isInsideTriangle(
+	const aiVector2t<double> &p,
+	const aiVector2t<double> &a,
+	const aiVector2t<double> &b,
+	const aiVector2t<double> &c)
+{
+	return turn(a, b, p) >= 0 && turn(b, c, p) >= 0 && turn(c, a, p) >= 0;
+}
+
+inline void appendTriangle(
+	std::vector<aiFace> &triangles,
+	unsigned int a,
+	unsigned int b,
+	unsigned int c)
+{
+	triangles.push_back(aiFace());
+	aiFace &triangle = triangles.back();
+	triangle.mNumIndices = 3;
+	triangle.mIndices = new unsigned int[3];
+	triangle.mIndices[0] = a;
+	triangle.mIndices[1] = b;
+	triangle.mIndices[2] = c;
+}
+
+bool repo::core::RepoTriangulator::isTriangulated(
+	const std::vector<aiFace> &faces)
+{
+	for (unsigned int f = 0; f < faces.size(); ++f)
+		if (3 != faces[f].mNumIndices)
+			return false;
+	return true;
+}
+
+std::vector<aiFace> repo::core::RepoTriangulator::triangulate(
+	const std::vector<aiVector3t<float> > &vertices,
+	const std::vector<aiFace> &faces)
+{
+	// aiFace copies are deep, reserve up front to avoid reallocations
+	size_t count = 0;
+	for (unsigned int f = 0; f < faces.size(); ++f)
+		if (faces[f].mNumIndices >= 3)
+			count += faces[f].mNumIndices - 2;
+
+	std::vector<aiFace> triangles;
+	triangles.reserve(count);
+	for (unsigned int f = 0; f < faces.size(); ++f)
+		triangulate(vertices, faces[f], triangles);
+	return triangles;
+}
+
+void repo::core::RepoTriangulator::triangulate(
+	const std::vector<aiVector3t<float> > &vertices,
+	const aiFace &face,
+	std::vector<aiFace> &triangles)
+{
+	const unsigned int n = face.mNumIndices;
+	if (n < 3)
+		return;
+	else if (3 == n)
+	{
+		appendTriangle(triangles,
+			face.mIndices[0], face.mIndices[1], face.mIndices[2]);
+		return;
+	}
+
+	for (unsigned int i = 0; i < n; ++i)
+		if (face.mIndices[i] >= vertices.size())
+			return; // corrupted face
+
+	//--------------------------------------------------------------------------
+	// Newell's normal decides the dominant plane to project onto
+	double nx = 0, ny = 0, nz = 0;
+	for (unsigned int i = 0; i < n; ++i)
+	{
+		const aiVector3t<float> &a = vertices[face.mIndices[i]];
+		const aiVector3t<float> &b = vertices[face.mIndices[(i + 1) % n]];
+		nx += ((double) a.y - b.y) * ((double) a.z + b.z);
+		ny += ((double) a.z - b.z) * ((double) a.x + b.x);
+		nz += ((double) a.x - b.x) * ((double) a.y + b.y);
+	}
+
+	// Cyclic axis order keeps the handedness, flipping u makes it CCW
+	unsigned int uAxis = 0, vAxis = 1;
+	double sign = nz;
+	if (fabs(nx) >= fabs(ny) && fabs(nx) >= fabs(nz))
+	{
+		uAxis = 1; vAxis = 2; sign = nx;
+	}
+	else if (fabs(ny) >= fabs(nz))
+	{
+		uAxis = 2; vAxis = 0; sign = ny;
+	}
+
+	std::vector<aiVector2t<double> > points(n);
+	for (unsigned int i = 0; i < n; ++i)
+	{
+		const aiVector3t<float> &v = vertices[face.mIndices[i]];
+		points[i] = aiVector2t<double>(
+			sign < 0 ? -v[uAxis] : v[uAxis],
+			v[vAxis]);
+	}
+
+	//--------------------------------------------------------------------------
+	// Convex polygons are fanned
+	bool isConvex = true;
+	for (unsigned int i = 0; i < n && isConvex; ++i)
+		isConvex = turn(points[i], points[(i + 1) % n], points[(i + 2) % n]) >= 0;
+
+	if (isConvex)
+	{
+		for (unsigned int i = 1; i + 1 < n; ++i)
+			appendTriangle(triangles,
+				face.mIndices[0], face.mIndices[i], face.mIndices[i + 1]);
+		return;
+	}
+
+	//--------------------------------------------------------------------------
+	// Concave polygons are ear clipped
+	std::vector<unsigned int> remaining(n);
+	for (unsigned int i = 0; i < n; ++i)
+		remaining[i] = i;
+
+	while (remaining.size() > 3)
+	{
+		const size_t size = remaining.size();
+		bool clipped = false;
+		for (size_t i = 0; i < size && !clipped; ++i)
+		{
+			unsigned int prev = remaining[(i + size - 1) % size];
+			unsigned int curr = remaining[i];
+			unsigned int next = remaining[(i + 1) % size];
+
+			if (turn(points[prev], points[curr], points[next]) <= 0)
+				continue; // reflex or degenerate corner
+
+			bool isEar = true;
+			for (size_t j = 0; j < size && isEar; ++j)
+			{
+				unsigned int other = remaining[j];
+				if (other == prev || other == curr || other == next)
+					continue;
+				const aiVector2t<double> &p = points[other];
+				// Duplicated positions (bridged holes) do not block an ear
+				if (p == points[prev] || p == points[curr] || p == points[next])
+					continue;
+				isEar = !isInsideTriangle(p,
+					points[prev], points[curr], points[next]);
+			}
+
+			if (isEar)
+			{
+				appendTriangle(triangles, face.mIndices[prev],
+					face.mIndices[curr], face.mIndices[next]);
+				remaining.erase(remaining.begin() + i);
+				clipped = true;
+			}
+		}
+
+		// Self-intersecting or non-planar input, fan whatever is left
+		if (!clipped)
+		{
+			for (size_t i = 1; i + 1 < remaining.size(); ++i)
+				appendTriangle(triangles, face.mIndices[remaining[0]],
+					face.mIndices[remaining[i]],
+					face.mIndices[remaining[i + 1]]);
+			return;
+		}
+	}
+
+	appendTriangle(triangles, face.mIndices[remaining[0]],
+		face.mIndices[remaining[1]], face.mIndices[remaining[2]]);
+}
+
+unsigned int repo::core::RepoTriangulator::triangulate(
+	RepoGraphScene *scene,
+	unsigned int threads)
+{
+	if (NULL == scene)
+		return 0;
+
+	std::vector<RepoNodeMesh *> meshes;
+	const RepoNodeAbstractSet sceneMeshes = scene->getMeshes();
+	for (RepoNodeAbstractSet::const_iterator it = sceneMeshes.begin();
+		it != sceneMeshes.end(); ++it)
+	{
+		RepoNodeMesh *mesh = RepoNodeAbstract::castNode<RepoNodeMesh *>(*it);
+		if (mesh)
+			meshes.push_back(mesh);
+	}
+
+	std::atomic<unsigned int> modified(0);
+	RepoParallel::forEach(meshes.size(), threads, [&meshes, &modified](size_t i)
+	{
+		if (meshes[i]->triangulate())
+			++modified;
+	});
+	return modified;
+}
@@ -0,0 +1,78 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_TRIANGULATOR_H
+#define REPO_TRIANGULATOR_H
+//------------------------------------------------------------------------------
+#include <vector>
+//------------------------------------------------------------------------------
+#include "assimp/scene.h"
+//------------------------------------------------------------------------------
+#include "../repocoreglobal.h"
+
+namespace repo {
+namespace core {
+
+class RepoGraphScene;
+
+//! Converts polygonal faces into triangles.
+/*!
+ * Convex polygons are split into a triangle fan, concave planar polygons are
+ * projected onto their dominant plane and ear clipped. Points and lines
+ * (faces with less than 3 indices) are dropped as they cannot be rendered
+ * as triangles.
+ */
+class REPO_CORE_EXPORT RepoTriangulator
+{
+
+public :
+
+	//! Returns true if all faces are triangles.
+	static bool isTriangulated(const std::vector<aiFace> &faces);
+
+	//! Returns triangles covering the given faces in the original order.
+	/*!
+	 * Triangles keep the winding of the polygon they originate from.
+	 */
+	static std::vector<aiFace> triangulate(
+		const std::vector<aiVector3t<float> > &vertices,
+		const std::vector<aiFace> &faces);
+
+	//! Appends triangles of a single polygon to the triangles vector.
+	static void triangulate(
+		const std::vector<aiVector3t<float> > &vertices,
+		const aiFace &face,
+		std::vector<aiFace> &triangles);
+
+	//! Triangulates all meshes of a scene in place.
+	/*!
+	 * Meshes are distributed over a pool of worker threads.
+	 *
+	 * \param scene Scene whose meshes are to be triangulated
+	 * \param threads Number of workers, 0 uses the hardware concurrency
+	 * \return Number of meshes that had to be modified
+	 */
+	static unsigned int triangulate(
+		RepoGraphScene *scene,
+		unsigned int threads = 0);
+
+}; // end class
+
+} // end namespace core
+} // end namespace repo
+
+#endif // REPO_TRIANGULATOR_H
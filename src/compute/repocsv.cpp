@@ -79,7 +79,7 @@ void repo::core::RepoCSV::print(RepoNodeAbstractSet& set)
 {
     for (const RepoNodeAbstract* node : set)
     {
-        const RepoNodeMetadata* meta = dynamic_cast<const RepoNodeMetadata*>(node);
+        const RepoNodeMetadata* meta = RepoNodeAbstract::castNode<const RepoNodeMetadata*>(node);
         std::cerr << (meta ? meta->toString(", ") : node->toString()) << std::endl;
     }
 }
@@ -16,71 +16,149 @@
  */
 
 
+
 #include "repographoptimizer.h"
 
+#include <chrono>
+#include <cstring>
+#include <set>
+#include <unordered_map>
+
+//! Folds the bytes into a 64-bit FNV-1a hash.
+inline void hashBytes(uint64_t &hash, const void *data, size_t bytes)
+{
+    const unsigned char *ptr = (const unsigned char *) data;
+    for (size_t i = 0; i < bytes; ++i)
+        hash = (hash ^ ptr[i]) * 0x100000001B3ULL;
+}
+
+//! Drops the low mantissa bits, i.e. keeps about three significant digits.
+inline uint32_t quantizeRelative(double value)
+{
+    float f = (float) value;
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits & 0xFFFFF000u;
+}
+
+//! Applies the affine part of the matrix to the point.
+inline aiVector3D transformPoint(const aiMatrix4x4 &m, const aiVector3D &p)
+{
+    return aiVector3D(
+        m.a1 * p.x + m.a2 * p.y + m.a3 * p.z + m.a4,
+        m.b1 * p.x + m.b2 * p.y + m.b3 * p.z + m.b4,
+        m.c1 * p.x + m.c2 * p.y + m.c3 * p.z + m.c4);
+}
+
+//! Applies the linear part of the matrix to the direction.
+inline aiVector3D transformDirection(const aiMatrix4x4 &m, const aiVector3D &d)
+{
+    return aiVector3D(
+        m.a1 * d.x + m.a2 * d.y + m.a3 * d.z,
+        m.b1 * d.x + m.b2 * d.y + m.b3 * d.z,
+        m.c1 * d.x + m.c2 * d.y + m.c3 * d.z);
+}
+
+//! Returns material children of the node in a canonical order.
+inline std::vector<const repo::core::RepoNodeAbstract *> getMaterials(
+        const repo::core::RepoNodeAbstract *node)
+{
+    std::vector<const repo::core::RepoNodeAbstract *> materials;
+    for (const repo::core::RepoNodeMaterial *material :
+         node->getChildren<const repo::core::RepoNodeMaterial*>())
+        materials.push_back(material);
+    std::sort(materials.begin(), materials.end(),
+              [](const repo::core::RepoNodeAbstract *a,
+                 const repo::core::RepoNodeAbstract *b)
+              { return a->getUniqueID() < b->getUniqueID(); });
+    return materials;
+}
+
 repo::core::RepoGraphOptimizer::RepoGraphOptimizer(RepoGraphScene *scene)
     : scene(scene)
 {}
 
-void repo::core::RepoGraphOptimizer::collapseSingleMeshTransformations()
+repo::core::RepoGraphOptimizerStatistics
+    repo::core::RepoGraphOptimizer::collapseSingleMeshTransformations()
 {
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+
+    RepoGraphOptimizerStatistics passStatistics;
     for (RepoNodeAbstract* node : scene->getMeshes())
     {
-        RepoNodeMesh* mesh = dynamic_cast<RepoNodeMesh*>(node);
+        RepoNodeMesh* mesh = RepoNodeAbstract::castNode<RepoNodeMesh*>(node);
         if (mesh)
-            collapseSingleMeshTransformations(mesh);
+            passStatistics += collapseSingleMeshTransformations(mesh);
     }
+
+    // Per mesh calls have accumulated their own share of the time already
+    double meshMilliseconds = passStatistics.totalMilliseconds;
+    passStatistics.totalMilliseconds =
+        std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+    statistics.totalMilliseconds +=
+        passStatistics.totalMilliseconds - meshMilliseconds;
+    return passStatistics;
 }
 
-void repo::core::RepoGraphOptimizer::collapseSingleMeshTransformations(
+repo::core::RepoGraphOptimizerStatistics
+    repo::core::RepoGraphOptimizer::collapseSingleMeshTransformations(
         RepoNodeMesh* mesh)
 {
-    RepoNodeTransformation* parentTransformation = getSingleParentTransformation(mesh);
-    if (parentTransformation && !parentTransformation->isRoot() && parentTransformation->isIdentity())
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+
+    RepoGraphOptimizerStatistics passStatistics;
+    while (true)
     {
-        std::set<const RepoNodeMesh*> siblingMeshes = parentTransformation->getChildren<const RepoNodeMesh*>();
-        std::set<const RepoNodeTransformation*> siblingTransformations = parentTransformation->getChildren<const RepoNodeTransformation*>();
+        ++passStatistics.visitedNodes;
 
+        RepoNodeTransformation* parentTransformation = getSingleParentTransformation(mesh);
+        if (!parentTransformation || parentTransformation->isRoot() || !parentTransformation->isIdentity())
+            break;
 
         RepoNodeTransformation* grandParentTransformation = getSingleParentTransformation(parentTransformation);
-        if (1 == (siblingMeshes.size() + siblingTransformations.size()) && grandParentTransformation)
-        {
+        if (!grandParentTransformation || 1 != countMeshesAndTransformations(parentTransformation, 2))
+            break;
 
-            std::cerr << "Reparenting " << mesh->getName() << " from " << parentTransformation->getName() << " to " << grandParentTransformation->getName() << std::endl;
+        mesh->setName(parentTransformation->getName());
 
+        grandParentTransformation->removeChild(parentTransformation);
+        parentTransformation->removeParent(grandParentTransformation);
 
-            mesh->setName(parentTransformation->getName());
-
-
-            grandParentTransformation->removeChild(parentTransformation);
-            parentTransformation->removeParent(grandParentTransformation);
+        const std::vector<const RepoNodeAbstract *> children = parentTransformation->getChildren();
+        for (const RepoNodeAbstract* n : children)
+        {
+            RepoNodeAbstract* node = const_cast<RepoNodeAbstract*>(n);
+            parentTransformation->removeChild(node);
+            node->removeParent(parentTransformation);
 
-            for (const RepoNodeAbstract* n : parentTransformation->getChildren())
+            if (RepoNodeAbstract::isOfType<RepoNodeMetadata*>(node))
             {
-                RepoNodeAbstract* node = const_cast<RepoNodeAbstract*>(n);
-                parentTransformation->removeChild(node);
-                node->removeParent(parentTransformation);
-
-                if (dynamic_cast<RepoNodeMetadata*>(node))
-                {
-                    mesh->addChild(node);
-                    node->addParent(mesh);
-                }
-                else
-                {
-                    grandParentTransformation->addChild(node);
-                    node->addParent(grandParentTransformation);
-                }
+                if (!node->hasParent(mesh))
+                    RepoNodeAbstract::link(mesh, node);
             }
+            else
+            {
+                if (!node->hasParent(grandParentTransformation))
+                    RepoNodeAbstract::link(grandParentTransformation, node);
+            }
+            ++passStatistics.reparentedNodes;
+        }
 
-            // TODO: remove from transformations set in SceneGraph...
-            scene->removeNodeRecursively(parentTransformation);
-
+        // TODO: remove from transformations set in SceneGraph...
+        scene->removeNodeRecursively(parentTransformation);
+        ++passStatistics.collapsedTransformations;
 
-            // Recursive call
-            collapseSingleMeshTransformations(mesh);
-        }
+        // Continue with the grandparent as the new parent
     }
+
+    passStatistics.totalMilliseconds =
+        std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+    statistics += passStatistics;
+    return passStatistics;
 }
 
 
@@ -88,25 +166,320 @@ repo::core::RepoNodeTransformation* repo::core::RepoGraphOptimizer::getSinglePar
         RepoNodeAbstract* node)
 {
     RepoNodeTransformation* parentTransformation = 0;
-    std::set<const RepoNodeTransformation*> parents = node->getParents<const RepoNodeTransformation*>();
+    RepoNodeTypeRange<const RepoNodeTransformation*> parents = node->getParents<const RepoNodeTransformation*>();
     if (1 == parents.size())
         parentTransformation = const_cast<RepoNodeTransformation*>(*(parents.begin()));
     return parentTransformation;
 }
 
-void repo::core::RepoGraphOptimizer::collapseZeroMeshTransformations()
+unsigned int repo::core::RepoGraphOptimizer::countMeshesAndTransformations(
+        const RepoNodeAbstract *node,
+        unsigned int limit)
 {
-    unsigned int originalCount = scene->getTransformations().size();
+    // Stops early so that wide nodes are not scanned in full
+    unsigned int count = 0;
+    const std::vector<const RepoNodeAbstract *> &children = node->getChildren();
+    for (std::vector<const RepoNodeAbstract *>::const_iterator it = children.begin();
+         count < limit && it != children.end(); ++it)
+        if (RepoNodeAbstract::isOfType<const RepoNodeMesh*>(*it)
+                || RepoNodeAbstract::isOfType<const RepoNodeTransformation*>(*it))
+            ++count;
+    return count;
+}
+
+repo::core::RepoGraphOptimizerStatistics
+    repo::core::RepoGraphOptimizer::collapseZeroMeshTransformations()
+{
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+
+    RepoGraphOptimizerStatistics passStatistics;
+
+    //--------------------------------------------------------------------------
+    // Seed with the current leaves, parents are queued once they become one
+    std::vector<RepoNodeAbstract *> worklist;
+    std::set<const RepoNodeAbstract *> queued;
     for (RepoNodeAbstract* node : scene->getTransformations())
     {
+        ++passStatistics.visitedNodes;
         if (node
                 && !node->isRoot()
-                && 0 == node->getChildren<const RepoNodeMesh*>().size()
-                && 0 == node->getChildren<const RepoNodeTransformation*>().size())
-            scene->removeNodeRecursively(node);
+                && 0 == countMeshesAndTransformations(node, 1))
+        {
+            worklist.push_back(node);
+            queued.insert(node);
+        }
     }
 
-    // Recursive call
-    if (originalCount != scene->getTransformations().size())
-        collapseZeroMeshTransformations();
+    std::vector<RepoNodeAbstract *> parents;
+    while (!worklist.empty())
+    {
+        RepoNodeAbstract* node = worklist.back();
+        worklist.pop_back();
+
+        parents.clear();
+        for (const RepoNodeTransformation* parent : node->getParents<const RepoNodeTransformation*>())
+            parents.push_back(const_cast<RepoNodeTransformation*>(parent));
+
+        scene->removeNodeRecursively(node);
+        ++passStatistics.removedTransformations;
+
+        for (RepoNodeAbstract* parent : parents)
+        {
+            ++passStatistics.visitedNodes;
+            if (!parent->isRoot()
+                    && 0 == countMeshesAndTransformations(parent, 1)
+                    && queued.insert(parent).second)
+                worklist.push_back(parent);
+        }
+    }
+
+    passStatistics.totalMilliseconds =
+        std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+    statistics += passStatistics;
+    return passStatistics;
+}
+
+repo::core::RepoGraphOptimizerStatistics
+    repo::core::RepoGraphOptimizer::collapseInstancedMeshes(double tolerance)
+{
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+
+    RepoGraphOptimizerStatistics passStatistics;
+
+    //--------------------------------------------------------------------------
+    // Unique ID order so that the same meshes are shared on every run
+    std::vector<RepoNodeMesh *> meshes;
+    for (RepoNodeAbstract* node : scene->getMeshes())
+    {
+        RepoNodeMesh* mesh = RepoNodeAbstract::castNode<RepoNodeMesh*>(node);
+        if (mesh && mesh->getVertices() && !mesh->getVertices()->empty())
+            meshes.push_back(mesh);
+    }
+    std::sort(meshes.begin(), meshes.end(),
+              [](const RepoNodeMesh *a, const RepoNodeMesh *b)
+              { return a->getUniqueID() < b->getUniqueID(); });
+
+    //--------------------------------------------------------------------------
+    // Shared geometries with their PCA by fingerprint
+    std::unordered_map<uint64_t, std::vector<std::pair<RepoNodeMesh *, RepoPCA> > > shared;
+    for (RepoNodeMesh* mesh : meshes)
+    {
+        ++passStatistics.visitedNodes;
+
+        RepoPCA pca;
+        pca.initialize(*mesh->getVertices());
+        std::vector<std::pair<RepoNodeMesh *, RepoPCA> > &candidates =
+                shared[getInstancingFingerprint(mesh, pca)];
+
+        RepoNodeMesh* geometry = NULL;
+        aiMatrix4x4 transformation;
+        for (size_t i = 0; !geometry && i < candidates.size(); ++i)
+        {
+            const RepoBoundingBox &box = candidates[i].first->getBoundingBox();
+            float distance = (float) (tolerance * (box.getMax() - box.getMin()).Length());
+            if (findInstanceTransformation(candidates[i].first, candidates[i].second,
+                                           mesh, pca, distance, transformation))
+                geometry = candidates[i].first;
+        }
+
+        if (!geometry)
+        {
+            if (candidates.size() < REPO_INSTANCING_MAX_CANDIDATES)
+                candidates.push_back(std::make_pair(mesh, pca));
+            continue;
+        }
+
+        //----------------------------------------------------------------------
+        // Replace the mesh by a transformation referencing the shared one
+        RepoNodeTransformation* instance = new RepoNodeTransformation(mesh->getName());
+        instance->setMatrix(transformation);
+        scene->addTransformation(instance);
+
+        const std::vector<const RepoNodeAbstract *> parents = mesh->getParents();
+        for (const RepoNodeAbstract* p : parents)
+        {
+            RepoNodeAbstract* parent = const_cast<RepoNodeAbstract*>(p);
+            parent->removeChild(mesh);
+            mesh->removeParent(parent);
+            RepoNodeAbstract::link(parent, instance);
+        }
+
+        const std::vector<const RepoNodeAbstract *> children = mesh->getChildren();
+        for (const RepoNodeAbstract* c : children)
+        {
+            RepoNodeAbstract* child = const_cast<RepoNodeAbstract*>(c);
+            mesh->removeChild(child);
+            child->removeParent(mesh);
+            if (!RepoNodeAbstract::isOfType<const RepoNodeMaterial*>(child))
+            {
+                RepoNodeAbstract::link(instance, child);
+                ++passStatistics.reparentedNodes;
+            }
+        }
+
+        RepoNodeAbstract::link(instance, geometry);
+
+        scene->removeNodeRecursively(mesh);
+        ++passStatistics.instancedMeshes;
+    }
+
+    passStatistics.totalMilliseconds =
+        std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+    statistics += passStatistics;
+    return passStatistics;
+}
+
+uint64_t repo::core::RepoGraphOptimizer::getInstancingFingerprint(
+        const RepoNodeMesh *mesh,
+        const RepoPCA &pca)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    //--------------------------------------------------------------------------
+    // Attribute layout
+    uint64_t counts[5] = {
+        mesh->getVertices() ? mesh->getVertices()->size() : 0,
+        mesh->getFaces() ? mesh->getFaces()->size() : 0,
+        mesh->getNormals() ? mesh->getNormals()->size() : 0,
+        mesh->getUVChannelsCount(),
+        mesh->getColors() ? mesh->getColors()->size() : 0 };
+    hashBytes(hash, counts, sizeof(counts));
+
+    //--------------------------------------------------------------------------
+    // Topology
+    if (mesh->getFaces())
+        for (const aiFace &face : *mesh->getFaces())
+        {
+            hashBytes(hash, &face.mNumIndices, sizeof(face.mNumIndices));
+            hashBytes(hash, face.mIndices, face.mNumIndices * sizeof(unsigned int));
+        }
+
+    //--------------------------------------------------------------------------
+    // Materials
+    for (const RepoNodeAbstract* material : getMaterials(mesh))
+    {
+        boost::uuids::uuid id = material->getUniqueID();
+        hashBytes(hash, id.data, id.size());
+    }
+
+    //--------------------------------------------------------------------------
+    // Shape up to rotation and translation
+    std::vector<RepoPrincipalComponent> components = pca.getPrincipalComponents();
+    for (const RepoPrincipalComponent &component : components)
+    {
+        uint32_t magnitude = quantizeRelative(component.magnitude);
+        hashBytes(hash, &magnitude, sizeof(magnitude));
+    }
+    return hash;
+}
+
+bool repo::core::RepoGraphOptimizer::findInstanceTransformation(
+        const RepoNodeMesh *mesh,
+        const RepoPCA &pca,
+        const RepoNodeMesh *other,
+        const RepoPCA &otherPCA,
+        float distance,
+        aiMatrix4x4 &transformation)
+{
+    const std::vector<aiVector3D> &vertices = *mesh->getVertices();
+    const std::vector<aiVector3D> &otherVertices = *other->getVertices();
+    if (vertices.size() != otherVertices.size())
+        return false;
+
+    //--------------------------------------------------------------------------
+    // Everything but positions and normals has to be identical
+    const std::vector<aiFace> *faces = mesh->getFaces();
+    const std::vector<aiFace> *otherFaces = other->getFaces();
+    if ((faces ? faces->size() : 0) != (otherFaces ? otherFaces->size() : 0))
+        return false;
+    for (size_t f = 0; faces && f < faces->size(); ++f)
+        if ((*faces)[f].mNumIndices != (*otherFaces)[f].mNumIndices
+                || memcmp((*faces)[f].mIndices, (*otherFaces)[f].mIndices,
+                          (*faces)[f].mNumIndices * sizeof(unsigned int)))
+            return false;
+
+    if (mesh->getUVChannelsCount() != other->getUVChannelsCount())
+        return false;
+    for (unsigned int c = 0; c < mesh->getUVChannelsCount(); ++c)
+        if (!mesh->getUVChannel(c) != !other->getUVChannel(c)
+                || (mesh->getUVChannel(c) && *mesh->getUVChannel(c) != *other->getUVChannel(c)))
+            return false;
+
+    if (!mesh->getColors() != !other->getColors()
+            || (mesh->getColors() && *mesh->getColors() != *other->getColors()))
+        return false;
+
+    if (!mesh->getNormals() != !other->getNormals()
+            || (mesh->getNormals() && mesh->getNormals()->size() != other->getNormals()->size())
+            || getMaterials(mesh) != getMaterials(other))
+        return false;
+
+    //--------------------------------------------------------------------------
+    // Candidate transformations, identity first then the PCA frame of the
+    // mesh onto the frame of the other one with all orientations of its axes
+    // that keep the handedness.
+    std::vector<aiMatrix4x4> candidates(1, aiMatrix4x4());
+    for (int signs = 0; signs < 8; ++signs)
+    {
+        RepoVertex flip((signs & 1) ? -1.0f : 1.0f,
+                        (signs & 2) ? -1.0f : 1.0f,
+                        (signs & 4) ? -1.0f : 1.0f);
+        aiVector3D points[4];
+        for (unsigned int i = 0; i < 4; ++i)
+        {
+            RepoVertex point(i == 1 ? 1.0f : 0.0f, i == 2 ? 1.0f : 0.0f, i == 3 ? 1.0f : 0.0f);
+            RepoVertex uvw = pca.transformToUVW(point);
+            uvw = RepoVertex(uvw.x * flip.x, uvw.y * flip.y, uvw.z * flip.z);
+            points[i] = otherPCA.transformToXYZ(uvw);
+        }
+
+        aiMatrix4x4 candidate;
+        candidate.a1 = points[1].x - points[0].x;
+        candidate.b1 = points[1].y - points[0].y;
+        candidate.c1 = points[1].z - points[0].z;
+        candidate.a2 = points[2].x - points[0].x;
+        candidate.b2 = points[2].y - points[0].y;
+        candidate.c2 = points[2].z - points[0].z;
+        candidate.a3 = points[3].x - points[0].x;
+        candidate.b3 = points[3].y - points[0].y;
+        candidate.c3 = points[3].z - points[0].z;
+        candidate.a4 = points[0].x;
+        candidate.b4 = points[0].y;
+        candidate.c4 = points[0].z;
+
+        float determinant =
+            candidate.a1 * (candidate.b2 * candidate.c3 - candidate.b3 * candidate.c2)
+            - candidate.a2 * (candidate.b1 * candidate.c3 - candidate.b3 * candidate.c1)
+            + candidate.a3 * (candidate.b1 * candidate.c2 - candidate.b2 * candidate.c1);
+        if (determinant > 0.0f)
+            candidates.push_back(candidate);
+    }
+
+    //--------------------------------------------------------------------------
+    // Verification vertex by vertex
+    float distanceSquared = distance * distance;
+    float normalSquared = REPO_INSTANCING_NORMAL_TOLERANCE * REPO_INSTANCING_NORMAL_TOLERANCE;
+    for (const aiMatrix4x4 &candidate : candidates)
+    {
+        bool matches = true;
+        for (size_t v = 0; matches && v < vertices.size(); ++v)
+            matches = (transformPoint(candidate, vertices[v]) - otherVertices[v])
+                    .SquareLength() <= distanceSquared;
+
+        const std::vector<aiVector3D> *normals = mesh->getNormals();
+        for (size_t n = 0; matches && normals && n < normals->size(); ++n)
+            matches = (transformDirection(candidate, (*normals)[n])
+                       - (*other->getNormals())[n]).SquareLength() <= normalSquared;
+
+        if (matches)
+        {
+            transformation = candidate;
+            return true;
+        }
+    }
+    return false;
 }
@@ -19,7 +19,10 @@
 #ifndef REPO_GRAPH_OPTIMIZER_H
 #define REPO_GRAPH_OPTIMIZER_H
 
+#include <stdint.h>
+
 #include "../repocoreglobal.h"
+#include "repo_pca.h"
 #include "../graph/repo_graph_scene.h"
 #include "../graph/repo_node_mesh.h"
 #include "../graph/repo_node_metadata.h"
@@ -30,6 +33,50 @@
 namespace repo {
 namespace core {
 
+//! Largest vertex distance of instances relative to the bounding box diagonal.
+#define REPO_INSTANCING_TOLERANCE 1e-4
+
+//! Largest difference of unit normals of instances.
+#define REPO_INSTANCING_NORMAL_TOLERANCE 1e-3f
+
+//! Number of distinct shared geometries kept per fingerprint.
+#define REPO_INSTANCING_MAX_CANDIDATES 8
+
+//! Work done by RepoGraphOptimizer, per call or accumulated.
+struct REPO_CORE_EXPORT RepoGraphOptimizerStatistics
+{
+    unsigned long long visitedNodes; //!< Number of times a node was examined
+    unsigned long long collapsedTransformations; //!< Identity parents merged into their single mesh
+    unsigned long long removedTransformations; //!< Transformations without meshes removed
+    unsigned long long reparentedNodes; //!< Children moved to another parent
+    unsigned long long instancedMeshes; //!< Meshes replaced by a reference to shared geometry
+    double totalMilliseconds; //!< Wall clock time spent
+
+    RepoGraphOptimizerStatistics()
+        : visitedNodes(0)
+        , collapsedTransformations(0)
+        , removedTransformations(0)
+        , reparentedNodes(0)
+        , instancedMeshes(0)
+        , totalMilliseconds(0.0) {}
+
+    RepoGraphOptimizerStatistics &operator+=(const RepoGraphOptimizerStatistics &other)
+    {
+        visitedNodes += other.visitedNodes;
+        collapsedTransformations += other.collapsedTransformations;
+        removedTransformations += other.removedTransformations;
+        reparentedNodes += other.reparentedNodes;
+        instancedMeshes += other.instancedMeshes;
+        totalMilliseconds += other.totalMilliseconds;
+        return *this;
+    }
+};
+
+//! Simplifies transformation hierarchies of a scene in place.
+/*!
+ * Both passes work bottom-up from a worklist so that each node is examined
+ * a bounded number of times regardless of the depth of the hierarchy.
+ */
 class REPO_CORE_EXPORT RepoGraphOptimizer
 {
 
@@ -40,24 +87,83 @@ public:
     ~RepoGraphOptimizer() {}
 
     //! Collapses all single mesh transformations in a scene graph.
-    void collapseSingleMeshTransformations();
-
-    //! Recursive collapse until not more possible.
-    void collapseSingleMeshTransformations(RepoNodeMesh* mesh);
-
-    //! Resursive collapse of transformations that have no meshes as children. Disregards
-    void collapseZeroMeshTransformations();
+    /*!
+     * An identity transformation whose only mesh or transformation child is
+     * a mesh is replaced by that mesh, which takes over its name and
+     * metadata. Other children move to the grandparent.
+     */
+    RepoGraphOptimizerStatistics collapseSingleMeshTransformations();
+
+    //! Collapses parents of the mesh upwards until no more possible.
+    RepoGraphOptimizerStatistics collapseSingleMeshTransformations(RepoNodeMesh* mesh);
+
+    //! Removes transformations that have neither meshes nor transformations as children.
+    /*!
+     * Parents left without such children are removed in turn, hence whole
+     * branches without meshes disappear. The root is always kept.
+     */
+    RepoGraphOptimizerStatistics collapseZeroMeshTransformations();
+
+    //! Replaces repeated geometry with references to a single shared mesh.
+    /*!
+     * Meshes are bucketed by a fingerprint invariant under rigid motion,
+     * i.e. topology, materials, attribute layout and the PCA spans of the
+     * vertices. Within a bucket a mesh is verified against the shared
+     * geometries vertex by vertex, either as an exact copy or as a copy
+     * moved by the rigid transformation aligning their PCA frames.
+     *
+     * A matching mesh is replaced by a transformation of the same name
+     * holding the relative transformation, its metadata and other
+     * non-material children, with the shared mesh as its child. The shared
+     * mesh has an instance in the world per parent, see
+     * RepoNodeMesh::getWorldMatrixCount().
+     *
+     * \param tolerance Largest vertex distance relative to the bounding box
+     * diagonal of the shared mesh
+     */
+    RepoGraphOptimizerStatistics collapseInstancedMeshes(
+            double tolerance = REPO_INSTANCING_TOLERANCE);
 
     //! Returns processed scene.
     RepoGraphScene* getScene() const { return scene; }
 
+    //! Returns statistics accumulated over all calls so far.
+    const RepoGraphOptimizerStatistics &getStatistics() const { return statistics; }
+
     //! Returns a transformation if it is a single parent, NULL otherwise.
     static RepoNodeTransformation* getSingleParentTransformation(RepoNodeAbstract *node);
 
+    //! Returns a hash of the properties of a mesh preserved by rigid motion.
+    static uint64_t getInstancingFingerprint(
+            const RepoNodeMesh *mesh,
+            const RepoPCA &pca);
+
+    //! Returns true if other is the mesh moved by a rigid transformation.
+    /*!
+     * Vertices are compared in order, the transformation mapping the mesh
+     * onto the other one is returned in transformation.
+     *
+     * \param distance Largest allowed distance of corresponding vertices
+     */
+    static bool findInstanceTransformation(
+            const RepoNodeMesh *mesh,
+            const RepoPCA &pca,
+            const RepoNodeMesh *other,
+            const RepoPCA &otherPCA,
+            float distance,
+            aiMatrix4x4 &transformation);
+
+    //! Returns the number of mesh and transformation children up to the limit.
+    static unsigned int countMeshesAndTransformations(
+            const RepoNodeAbstract *node,
+            unsigned int limit);
+
 private :
 
     RepoGraphScene* scene;
 
+    RepoGraphOptimizerStatistics statistics;
+
 }; // end class
 
 } // end namespace core
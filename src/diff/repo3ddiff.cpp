@@ -17,62 +17,233 @@
 
 
 #include "repo3ddiff.h"
+#include "../compute/repo_parallel.h"
+#include "../compute/repo_similarity_index.h"
+#include "../graph/repo_uuid_map.h"
 
-repo::core::Repo3DDiff::Repo3DDiff(
-    const RepoGraphScene* A,
-    const RepoGraphScene* B)
-    : A(A)
-    , B(B) {}
+#include <algorithm>
 
+//------------------------------------------------------------------------------
 
-repo::core::RepoNodeRevision repo::core::Repo3DDiff::diff() const
+//! Appends the nodes of the container to the vector.
+template <class Container>
+inline void append(
+    const Container &container,
+    std::vector<const repo::core::RepoNodeAbstract *> &nodes)
 {
-    RepoNodeAbstractSet meshesA = A->getMeshes();
-    RepoNodeAbstractSet meshesB = B->getMeshes();
-
-
-    RepoNodeAbstractSet meshIntersection = setIntersection(meshesA, meshesB);
-//    printSet(meshIntersection, "Matching Meshes");
-
-
-
-//    RepoSelfSimilarSet hasMultiSet = toSelfSimilarSet(oldMeshes);
-//    std::cerr << "Hash set:" << std::endl;
-//    for (const core::RepoNodeAbstract* x: hasMultiSet)
-//        std::cerr << ((core::RepoNodeMesh*)(x))->getVertexHash() << std::endl;
-
-
-
-//    // A - B
-//    RepoNodeAbstractSet deletedMeshes = this->setDifference(oldMeshes, newMeshes);
-
-//    // B - A
-//    RepoNodeAbstractSet addedMeshes = this->setDifference(newMeshes, oldMeshes);
+    nodes.insert(nodes.end(), container.begin(), container.end());
+}
 
-//    // A intersection B (meshes in common between A and B)
-//    // This is list of modified and unmodified meshes
-//    RepoNodeAbstractSet commonMeshes = this->setDifference(oldMeshes, deletedMeshes);
+//! Orders fingerprints, ties by index of the node.
+inline bool lessFingerprint(
+    const std::pair<const std::string *, size_t> &a,
+    const std::pair<const std::string *, size_t> &b)
+{
+    int compare = a.first->compare(*b.first);
+    return compare < 0 || (0 == compare && a.second < b.second);
+}
 
+//! Sorts the IDs and inserts them into the set.
+inline void toSet(
+    std::vector<boost::uuids::uuid> &ids,
+    std::set<boost::uuids::uuid> &set)
+{
+    std::sort(ids.begin(), ids.end());
+    set.insert(ids.begin(), ids.end());
+}
 
+repo::core::Repo3DDiff::Repo3DDiff(
+    const RepoGraphScene* A,
+    const RepoGraphScene* B)
+    : A(A)
+    , B(B) {}
 
 
+repo::core::RepoNodeRevision repo::core::Repo3DDiff::diff(
+        unsigned int threads) const
+{
+    RepoNodeRevision revision;
+    std::map<std::string, Repo3DDiffResult> results = diffByType(threads);
+    std::map<std::string, Repo3DDiffResult>::const_iterator it;
+    std::set<boost::uuids::uuid>::const_iterator id;
+    for (it = results.begin(); it != results.end(); ++it)
+    {
+        const Repo3DDiffResult &result = it->second;
+        for (id = result.added.begin(); id != result.added.end(); ++id)
+            revision.addAddedSharedID(*id);
+        for (id = result.deleted.begin(); id != result.deleted.end(); ++id)
+            revision.addDeletedSharedID(*id);
+        for (id = result.modified.begin(); id != result.modified.end(); ++id)
+            revision.addModifiedSharedID(*id);
+        for (id = result.unmodified.begin(); id != result.unmodified.end(); ++id)
+            revision.addUnmodifiedSharedID(*id);
+    }
+    revision.setCurrentUniqueIDs(B->getNodes());
+    return revision;
+}
 
-    RepoNodeAbstractSet oldTransformations = A->getTransformations();
-    RepoNodeAbstractSet newTransformations = B->getTransformations();
-    RepoNodeAbstractSet intersect = setIntersection(oldTransformations, newTransformations);
-//    printSet(intersect, "Matching Transformations");
+std::map<std::string, repo::core::Repo3DDiffResult>
+    repo::core::Repo3DDiff::diffByType(unsigned int threads) const
+{
+    //--------------------------------------------------------------------------
+    // Nodes of both scenes by type, A before B within each type
+    std::vector<std::string> types;
+    std::vector<const RepoNodeAbstract *> nodes;
+    std::vector<size_t> offsets; // type t of A at offsets[2t], of B at [2t+1]
+    const RepoGraphScene *scenes[2] = { A, B };
+    const char *labels[] = {
+        REPO_NODE_TYPE_MESH, REPO_NODE_TYPE_TRANSFORMATION,
+        REPO_NODE_TYPE_MATERIAL, REPO_NODE_TYPE_TEXTURE,
+        REPO_NODE_TYPE_CAMERA, REPO_NODE_TYPE_METADATA,
+        REPO_NODE_TYPE_REFERENCE };
+    for (size_t t = 0; t < sizeof(labels) / sizeof(labels[0]); ++t)
+    {
+        types.push_back(labels[t]);
+        for (int s = 0; s < 2; ++s)
+        {
+            offsets.push_back(nodes.size());
+            const RepoGraphScene *scene = scenes[s];
+            switch (t)
+            {
+            case 0 :
+                append(scene->getMeshes(), nodes);
+                break;
+            case 1 :
+                append(scene->getTransformations(), nodes);
+                break;
+            case 2 :
+                append(scene->getMaterials(), nodes);
+                break;
+            case 3 :
+                append(scene->getTextures(), nodes);
+                break;
+            case 4 :
+                append(scene->getCameras(), nodes);
+                break;
+            case 5 :
+                append(scene->getMetadata(), nodes);
+                break;
+            default :
+                append(scene->getReferences(), nodes);
+            }
+        }
+    }
+    offsets.push_back(nodes.size());
 
-    // A - B
-//    RepoNodeAbstractSet deletedTransformations = this->setDifference(oldTransformations, newTransformations);
+    //--------------------------------------------------------------------------
+    // Fingerprints encode every node, hence in parallel with shared paths
+    A->getPathIndex();
+    B->getPathIndex();
+    A->updateWorld();
+    B->updateWorld();
+    std::vector<std::string> fingerprints(nodes.size());
+    RepoParallel::forEach(nodes.size(), threads, [&](size_t n)
+    {
+        try
+        {
+            fingerprints[n] = nodes[n]->getFingerprint();
+        }
+        catch (...)
+        {
+            // Left empty, the node counts as modified
+        }
+    });
 
-//    // B - A
-//    RepoNodeAbstractSet addedTransformations = this->setDifference(newTransformations, oldTransformations);
+    //--------------------------------------------------------------------------
+    // Each type is matched independently
+    std::vector<Repo3DDiffResult> results(types.size());
+    RepoParallel::forEach(types.size(), threads, [&](size_t t)
+    {
+        std::vector<const RepoNodeAbstract *>::const_iterator first =
+            nodes.begin();
+        std::vector<std::string>::const_iterator fingerprint =
+            fingerprints.begin();
+        results[t] = match(
+            std::vector<const RepoNodeAbstract *>(
+                first + offsets[2 * t], first + offsets[2 * t + 1]),
+            std::vector<std::string>(fingerprint + offsets[2 * t],
+                fingerprint + offsets[2 * t + 1]),
+            std::vector<const RepoNodeAbstract *>(
+                first + offsets[2 * t + 1], first + offsets[2 * t + 2]),
+            std::vector<std::string>(fingerprint + offsets[2 * t + 1],
+                fingerprint + offsets[2 * t + 2]));
+    });
 
-//    // A intersection B
-//    RepoNodeAbstractSet matchingTransformations = this->setDifference(oldTransformations, deletedTransformations);
+    //--------------------------------------------------------------------------
+    // Meshes left over are matched by geometry, typically those of a model
+    // re-exported with different IDs and slightly different content
+    Repo3DDiffResult &meshes = results[0];
+    std::vector<const RepoNodeMesh *> deletedMeshes;
+    std::vector<const RepoNodeMesh *> addedMeshes;
+    for (size_t n = offsets[0]; n < offsets[2]; ++n)
+    {
+        const boost::uuids::uuid &sharedID = nodes[n]->getSharedID();
+        if (n < offsets[1] ? meshes.deleted.count(sharedID)
+                : meshes.added.count(sharedID))
+            (n < offsets[1] ? deletedMeshes : addedMeshes).push_back(
+                RepoNodeAbstract::castNode<const RepoNodeMesh *>(nodes[n]));
+    }
+    if (!deletedMeshes.empty() && !addedMeshes.empty())
+    {
+        std::map<boost::uuids::uuid, boost::uuids::uuid> similar =
+            RepoSimilarityIndex::match(deletedMeshes, addedMeshes,
+                REPO_SIMILARITY_TOLERANCE, threads);
+        std::map<boost::uuids::uuid, boost::uuids::uuid>::const_iterator it;
+        for (it = similar.begin(); it != similar.end(); ++it)
+        {
+            meshes.added.erase(it->first);
+            meshes.deleted.erase(it->second);
+            meshes.modified.insert(it->first);
+            meshes.correspondence.insert(*it);
+        }
+    }
 
+    //--------------------------------------------------------------------------
+    // Fingerprints leave out parents, hence unmodified nodes must also have
+    // the parents of their match in A, once those of B are mapped to the
+    // shared IDs they matched, as RepoCommitPipeline::getDelta() requires
+    RepoUUIDMap<boost::uuids::uuid> correspondence;
+    RepoUUIDMap<const RepoNodeAbstract *> nodesA, nodesB;
+    for (size_t t = 0; t < types.size(); ++t)
+    {
+        correspondence.insert(results[t].correspondence.begin(),
+            results[t].correspondence.end());
+        for (size_t n = offsets[2 * t]; n < offsets[2 * t + 2]; ++n)
+            (n < offsets[2 * t + 1] ? nodesA : nodesB).insert(
+                std::make_pair(nodes[n]->getSharedID(), nodes[n]));
+    }
+    RepoParallel::forEach(types.size(), threads, [&](size_t t)
+    {
+        std::vector<boost::uuids::uuid> moved;
+        for (const boost::uuids::uuid &sharedID : results[t].unmodified)
+        {
+            const std::vector<const RepoNodeAbstract *> &parentsB =
+                nodesB.find(sharedID)->second->getParents();
+            const std::vector<const RepoNodeAbstract *> &parentsA =
+                nodesA.find(correspondence.find(sharedID)->second)
+                    ->second->getParents();
+            bool equal = parentsA.size() == parentsB.size();
+            for (size_t p = 0; equal && p < parentsB.size(); ++p)
+            {
+                RepoUUIDMap<boost::uuids::uuid>::const_iterator it =
+                    correspondence.find(parentsB[p]->getSharedID());
+                equal = correspondence.end() != it
+                    && it->second == parentsA[p]->getSharedID();
+            }
+            if (!equal)
+                moved.push_back(sharedID);
+        }
+        for (const boost::uuids::uuid &sharedID : moved)
+        {
+            results[t].unmodified.erase(sharedID);
+            results[t].modified.insert(sharedID);
+        }
+    });
 
-    return RepoNodeRevision();
+    std::map<std::string, Repo3DDiffResult> resultsByType;
+    for (size_t t = 0; t < types.size(); ++t)
+        std::swap(resultsByType[types[t]], results[t]);
+    return resultsByType;
 }
 
 //------------------------------------------------------------------------------
@@ -118,8 +289,90 @@ repo::core::RepoSelfSimilarSet repo::core::Repo3DDiff::toSelfSimilarSet(const Re
     RepoSelfSimilarSet rsss;
     for (auto n = x.begin(); n != x.end(); ++n)
     {
-        RepoNodeMesh *mesh = dynamic_cast<RepoNodeMesh *>(*n);
+        RepoNodeMesh *mesh = RepoNodeAbstract::castNode<RepoNodeMesh *>(*n);
         rsss.insert(std::make_pair(mesh->getVertexHash(), *n));
     }
     return rsss;
 }
+
+repo::core::Repo3DDiffResult repo::core::Repo3DDiff::match(
+        const std::vector<const RepoNodeAbstract *> &a,
+        const std::vector<std::string> &fingerprintsA,
+        const std::vector<const RepoNodeAbstract *> &b,
+        const std::vector<std::string> &fingerprintsB)
+{
+    // IDs are collected in vectors and sorted so that the sets and the map
+    // of the result are built in linear time.
+    std::vector<boost::uuids::uuid> added, deleted, modified, unmodified;
+    std::vector<std::pair<boost::uuids::uuid, boost::uuids::uuid> > pairs;
+
+    RepoUUIDMap<size_t> bySharedID;
+    bySharedID.reserve(a.size());
+    for (size_t i = 0; i < a.size(); ++i)
+        bySharedID.insert(std::make_pair(a[i]->getSharedID(), i));
+
+    //--------------------------------------------------------------------------
+    // Shared IDs first
+    std::vector<bool> matched(a.size(), false);
+    std::vector<std::pair<const std::string *, size_t> > restA, restB;
+    for (size_t j = 0; j < b.size(); ++j)
+    {
+        const boost::uuids::uuid &sharedID = b[j]->getSharedID();
+        RepoUUIDMap<size_t>::const_iterator it = bySharedID.find(sharedID);
+        if (bySharedID.end() == it || matched[it->second])
+        {
+            if (fingerprintsB[j].empty())
+                added.push_back(sharedID);
+            else
+                restB.push_back(std::make_pair(&fingerprintsB[j], j));
+            continue;
+        }
+        matched[it->second] = true;
+        pairs.push_back(std::make_pair(sharedID, sharedID));
+        if (!fingerprintsB[j].empty()
+            && fingerprintsA[it->second] == fingerprintsB[j])
+            unmodified.push_back(sharedID);
+        else
+            modified.push_back(sharedID);
+    }
+
+    //--------------------------------------------------------------------------
+    // Fingerprints of the rest, equal ones are paired up in order of the
+    // nodes so that repeated instances of the same content match one to one
+    for (size_t i = 0; i < a.size(); ++i)
+        if (!matched[i] && !fingerprintsA[i].empty())
+            restA.push_back(std::make_pair(&fingerprintsA[i], i));
+    std::sort(restA.begin(), restA.end(), lessFingerprint);
+    std::sort(restB.begin(), restB.end(), lessFingerprint);
+
+    size_t k = 0;
+    for (size_t j = 0; j < restB.size(); ++j)
+    {
+        while (k < restA.size() && *restA[k].first < *restB[j].first)
+            ++k;
+        const boost::uuids::uuid &sharedID = b[restB[j].second]->getSharedID();
+        if (k < restA.size() && *restA[k].first == *restB[j].first)
+        {
+            matched[restA[k].second] = true;
+            pairs.push_back(std::make_pair(
+                sharedID, a[restA[k].second]->getSharedID()));
+            unmodified.push_back(sharedID);
+            ++k;
+        }
+        else
+            added.push_back(sharedID);
+    }
+
+    for (size_t i = 0; i < a.size(); ++i)
+        if (!matched[i])
+            deleted.push_back(a[i]->getSharedID());
+
+    Repo3DDiffResult result;
+    toSet(added, result.added);
+    toSet(deleted, result.deleted);
+    toSet(modified, result.modified);
+    toSet(unmodified, result.unmodified);
+    std::sort(pairs.begin(), pairs.end());
+    result.correspondence.insert(pairs.begin(), pairs.end());
+    return result;
+}
@@ -20,6 +20,8 @@
 
 #include <set>
 #include <map>
+#include <string>
+#include <vector>
 
 #include "../repocoreglobal.h"
 
@@ -33,6 +35,37 @@ namespace core {
 
 typedef std::multimap<std::string, RepoNodeAbstract*> RepoSelfSimilarSet;
 
+//! Nodes of one type classified by Repo3DDiff.
+/*!
+ * Added, modified and unmodified are shared IDs of nodes of B, deleted are
+ * those of nodes of A.
+ */
+struct REPO_CORE_EXPORT Repo3DDiffResult
+{
+    std::set<boost::uuids::uuid> added; //!< Only in B
+    std::set<boost::uuids::uuid> deleted; //!< Only in A
+    std::set<boost::uuids::uuid> modified; //!< Matched, content differs
+    std::set<boost::uuids::uuid> unmodified; //!< Matched, content is equal
+
+    //! Shared IDs of matched nodes of B to those of their nodes in A.
+    std::map<boost::uuids::uuid, boost::uuids::uuid> correspondence;
+};
+
+//! Compares two scenes, typically two revisions of the same project.
+/*!
+ * Nodes of each type are matched by shared ID first. Nodes left over on
+ * either side are then matched by their content fingerprint, see
+ * RepoNodeAbstract::computeFingerprint(), which pairs up nodes of a model
+ * imported anew whose shared IDs are all different. Meshes still left over
+ * are matched by geometry, see RepoSimilarityIndex, and are modified.
+ * Other matched nodes are modified if their fingerprints differ or if their
+ * parents, in order, are not matched to the parents of their match, hence
+ * a node moved elsewhere in the hierarchy is modified as in
+ * RepoCommitPipeline::getDelta().
+ *
+ * Fingerprints of all nodes are computed in parallel, after which each
+ * type is matched on a thread of its own in O(n log n).
+ */
 class REPO_CORE_EXPORT Repo3DDiff
 {
 
@@ -45,7 +78,18 @@ public:
     //! Default empty destructor.
     ~Repo3DDiff() {}
 
-    RepoNodeRevision diff() const;
+    //! Returns a revision with the ID sets of the changes from A to B.
+    /*!
+     * Sets of all types are merged and the current unique IDs are those of
+     * all nodes of B.
+     *
+     * \param threads Number of threads, 0 uses the hardware concurrency
+     */
+    RepoNodeRevision diff(unsigned int threads = 0) const;
+
+    //! Returns changes from A to B by node type, see diff().
+    std::map<std::string, Repo3DDiffResult> diffByType(
+            unsigned int threads = 0) const;
 
     RepoSelfSimilarSet getSelfSimilarSetA() const
     { return toSelfSimilarSet(A->getMeshes()); }
@@ -72,6 +116,17 @@ public :
 
     static RepoSelfSimilarSet toSelfSimilarSet(const RepoNodeAbstractSet &x);
 
+    //! Matches nodes of a single type given their fingerprints.
+    /*!
+     * Nodes with an empty fingerprint are matched by shared ID only and are
+     * always modified.
+     */
+    static Repo3DDiffResult match(
+            const std::vector<const RepoNodeAbstract *> &a,
+            const std::vector<std::string> &fingerprintsA,
+            const std::vector<const RepoNodeAbstract *> &b,
+            const std::vector<std::string> &fingerprintsB);
+
 private :
 
     const RepoGraphScene* A;
@@ -88,6 +88,41 @@ void repo::core::RepoBoundingBox::toOutline(
 }
 
 
+repo::core::RepoBoundingBox repo::core::RepoBoundingBox::transform(
+        const aiMatrix4x4 &matrix) const
+{
+    RepoBoundingBox box;
+    if (!isEmpty())
+    {
+        for (unsigned int corner = 0; corner < 8; ++corner)
+            box.extend(matrix * aiVector3D(
+                (corner & 1) ? max.x : min.x,
+                (corner & 2) ? max.y : min.y,
+                (corner & 4) ? max.z : min.z));
+    }
+    return box;
+}
+
+void repo::core::RepoBoundingBox::extend(const aiVector3D &point)
+{
+    min.x = std::min(min.x, point.x);
+    min.y = std::min(min.y, point.y);
+    min.z = std::min(min.z, point.z);
+
+    max.x = std::max(max.x, point.x);
+    max.y = std::max(max.y, point.y);
+    max.z = std::max(max.z, point.z);
+}
+
+void repo::core::RepoBoundingBox::extend(const RepoBoundingBox &other)
+{
+    if (!other.isEmpty())
+    {
+        extend(other.min);
+        extend(other.max);
+    }
+}
+
 std::vector<double> repo::core::RepoBoundingBox::getTransformationMatrix() const
 {
     std::vector<double> transformation(16);
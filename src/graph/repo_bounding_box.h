@@ -85,6 +85,9 @@ public :
 	//! Returns a polygon outline as a bounding rectangle in XY plane.
 	void toOutline(std::vector<aiVector2t<float> > * vec) const;
 
+    //! Returns the axis aligned box enclosing this box transformed by matrix.
+    RepoBoundingBox transform(const aiMatrix4x4 &matrix) const;
+
 
     //--------------------------------------------------------------------------
     //
@@ -100,6 +103,12 @@ public :
 
     void setMax(const aiVector3D& max) { setMax(RepoVertex(max)); }
 
+    //! Grows the box to contain the given point.
+    void extend(const aiVector3D &point);
+
+    //! Grows the box to contain the given box, empty boxes are ignored.
+    void extend(const RepoBoundingBox &other);
+
     //--------------------------------------------------------------------------
     //
     // Getters
@@ -117,6 +126,10 @@ public :
 
     double getLengthZ() const { return max.z - min.z; }
 
+    //! Returns true if the box contains no point, e.g. default constructed.
+    bool isEmpty() const
+    { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
     //! Returns transformation matrix suitable for GLC Lib.
     std::vector<double> getTransformationMatrix() const;
 
@@ -0,0 +1,553 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "repo_bvh.h"
+#include "../compute/repo_parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <queue>
+
+//------------------------------------------------------------------------------
+//
+// Construction
+//
+//------------------------------------------------------------------------------
+
+//! Shared state of a build, each worker writes disjoint parts only.
+struct RepoBVHBuild
+{
+	const std::vector<repo::core::RepoBoundingBox> *boxes;
+	std::vector<aiVector3D> centroids;
+	std::vector<uint32_t> indices;
+	std::vector<repo::core::RepoBVHNode> *nodes;
+	std::atomic<uint32_t> nodeCount;
+};
+
+inline float surfaceArea(const repo::core::RepoBoundingBox &box)
+{
+	if (box.isEmpty())
+		return 0.0f;
+	float x = (float) box.getLengthX();
+	float y = (float) box.getLengthY();
+	float z = (float) box.getLengthZ();
+	return 2.0f * (x * y + y * z + z * x);
+}
+
+inline unsigned int binOf(float value, float min, float scale)
+{
+	int bin = (int) ((value - min) * scale);
+	return (unsigned int) std::max(0, std::min(REPO_BVH_BINS - 1, bin));
+}
+
+static void buildNode(
+	RepoBVHBuild &build,
+	uint32_t nodeIndex,
+	uint32_t begin,
+	uint32_t end,
+	unsigned int parallelDepth)
+{
+	repo::core::RepoBVHNode &node = (*build.nodes)[nodeIndex];
+	const std::vector<repo::core::RepoBoundingBox> &boxes = *build.boxes;
+
+	repo::core::RepoBoundingBox centroidBox;
+	node.box = repo::core::RepoBoundingBox();
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		node.box.extend(boxes[build.indices[i]]);
+		centroidBox.extend(build.centroids[build.indices[i]]);
+	}
+
+	uint32_t count = end - begin;
+	if (count <= 1)
+	{
+		node.first = begin;
+		node.count = count;
+		return;
+	}
+
+	//--------------------------------------------------------------------------
+	// Binned surface area heuristic over all three axes
+	int bestAxis = -1;
+	unsigned int bestBin = 0;
+	float bestCost = std::numeric_limits<float>::max();
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		float min = centroidBox.getMin()[axis];
+		float extent = centroidBox.getMax()[axis] - min;
+		if (!(extent > 0.0f))
+			continue;
+		float scale = REPO_BVH_BINS / extent;
+
+		uint32_t binCounts[REPO_BVH_BINS] = {0};
+		repo::core::RepoBoundingBox binBoxes[REPO_BVH_BINS];
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			uint32_t item = build.indices[i];
+			unsigned int bin = binOf(build.centroids[item][axis], min, scale);
+			binCounts[bin]++;
+			binBoxes[bin].extend(boxes[item]);
+		}
+
+		// Sweep from the right accumulating costs of the right sides
+		float rightCosts[REPO_BVH_BINS];
+		repo::core::RepoBoundingBox right;
+		uint32_t rightCount = 0;
+		for (unsigned int bin = REPO_BVH_BINS - 1; bin > 0; --bin)
+		{
+			right.extend(binBoxes[bin]);
+			rightCount += binCounts[bin];
+			rightCosts[bin] = rightCount * surfaceArea(right);
+		}
+
+		repo::core::RepoBoundingBox left;
+		uint32_t leftCount = 0;
+		for (unsigned int bin = 0; bin < REPO_BVH_BINS - 1; ++bin)
+		{
+			left.extend(binBoxes[bin]);
+			leftCount += binCounts[bin];
+			if (0 == leftCount || count == leftCount)
+				continue;
+			float cost = leftCount * surfaceArea(left) + rightCosts[bin + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = bin;
+			}
+		}
+	}
+
+	//--------------------------------------------------------------------------
+	// Leaf if splitting does not pay off, costs relative to the node area
+	float leafCost = count * surfaceArea(node.box);
+	float splitCost = surfaceArea(node.box) + bestCost;
+	if (count <= REPO_BVH_MAX_LEAF_SIZE && (bestAxis < 0 || leafCost <= splitCost))
+	{
+		node.first = begin;
+		node.count = count;
+		return;
+	}
+
+	uint32_t mid = begin + count / 2;
+	if (bestAxis >= 0)
+	{
+		float min = centroidBox.getMin()[bestAxis];
+		float scale = REPO_BVH_BINS / (centroidBox.getMax()[bestAxis] - min);
+		const std::vector<aiVector3D> &centroids = build.centroids;
+		mid = (uint32_t) (std::partition(
+			build.indices.begin() + begin,
+			build.indices.begin() + end,
+			[&](uint32_t item)
+			{ return binOf(centroids[item][bestAxis], min, scale) <= bestBin; })
+			- build.indices.begin());
+	}
+	// else all centroids coincide and the halves are arbitrary
+
+	//--------------------------------------------------------------------------
+	// Children are allocated after their parent, refit relies on it
+	uint32_t children = build.nodeCount.fetch_add(2);
+	node.first = children;
+	node.count = 0;
+
+	if (parallelDepth > 0 && count >= REPO_BVH_MIN_PARALLEL_MESHES)
+	{
+		repo::core::RepoParallel::run(2,
+			[&build, children, begin, mid, end, parallelDepth](unsigned int half)
+		{
+			buildNode(build, children + half, half ? mid : begin,
+				half ? end : mid, parallelDepth - 1);
+		});
+	}
+	else
+	{
+		buildNode(build, children, begin, mid, 0);
+		buildNode(build, children + 1, mid, end, 0);
+	}
+}
+
+void repo::core::RepoBVH::build(
+	const std::vector<const RepoNodeMesh *> &meshes,
+	unsigned int threads)
+{
+	nodes.clear();
+	this->meshes.clear();
+	instances.clear();
+	boxes.clear();
+	builtInstances = 0;
+
+	std::vector<const RepoNodeMesh *> indexed;
+	std::vector<uint32_t> indexedInstances;
+	std::vector<RepoBoundingBox> indexedBoxes;
+	indexed.reserve(meshes.size());
+	indexedInstances.reserve(meshes.size());
+	indexedBoxes.reserve(meshes.size());
+	for (size_t i = 0; i < meshes.size(); ++i)
+		if (meshes[i])
+		{
+			builtInstances += meshes[i]->getWorldMatrixCount();
+			for (size_t j = 0; j < meshes[i]->getWorldMatrixCount(); ++j)
+			{
+				const RepoBoundingBox &box = meshes[i]->getWorldBoundingBox(j);
+				if (!box.isEmpty())
+				{
+					indexed.push_back(meshes[i]);
+					indexedInstances.push_back((uint32_t) j);
+					indexedBoxes.push_back(box);
+				}
+			}
+		}
+	if (indexed.empty())
+		return;
+
+	RepoBVHBuild build;
+	build.boxes = &indexedBoxes;
+	build.centroids.resize(indexed.size());
+	build.indices.resize(indexed.size());
+	for (uint32_t i = 0; i < indexed.size(); ++i)
+	{
+		build.centroids[i] =
+			(indexedBoxes[i].getMin() + indexedBoxes[i].getMax()) * 0.5f;
+		build.indices[i] = i;
+	}
+
+	// A binary tree with non-empty leaves has at most 2n - 1 nodes
+	nodes.resize(2 * indexed.size() - 1);
+	build.nodes = &nodes;
+	build.nodeCount = 1;
+
+	threads = RepoParallel::getThreadCount(threads);
+	unsigned int parallelDepth = 0;
+	while ((1u << parallelDepth) < threads)
+		++parallelDepth;
+
+	buildNode(build, 0, 0, (uint32_t) indexed.size(), parallelDepth);
+	nodes.resize(build.nodeCount);
+
+	this->meshes.resize(indexed.size());
+	instances.resize(indexed.size());
+	boxes.resize(indexed.size());
+	for (size_t i = 0; i < indexed.size(); ++i)
+	{
+		this->meshes[i] = indexed[build.indices[i]];
+		instances[i] = indexedInstances[build.indices[i]];
+		boxes[i] = indexedBoxes[build.indices[i]];
+	}
+}
+
+void repo::core::RepoBVH::refit()
+{
+	for (size_t i = 0; i < meshes.size(); ++i)
+		boxes[i] = instances[i] < meshes[i]->getWorldMatrixCount()
+			? meshes[i]->getWorldBoundingBox(instances[i])
+			: RepoBoundingBox();
+
+	// Children always follow their parents
+	for (size_t n = nodes.size(); n-- > 0;)
+	{
+		RepoBVHNode &node = nodes[n];
+		node.box = RepoBoundingBox();
+		if (node.isLeaf())
+			for (uint32_t i = node.first; i < node.first + node.count; ++i)
+				node.box.extend(boxes[i]);
+		else
+		{
+			node.box.extend(nodes[node.first].box);
+			node.box.extend(nodes[node.first + 1].box);
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+//
+// Queries
+//
+//------------------------------------------------------------------------------
+
+inline bool overlaps(
+	const repo::core::RepoBoundingBox &a,
+	const repo::core::RepoBoundingBox &b)
+{
+	return a.getMin().x <= b.getMax().x && b.getMin().x <= a.getMax().x
+		&& a.getMin().y <= b.getMax().y && b.getMin().y <= a.getMax().y
+		&& a.getMin().z <= b.getMax().z && b.getMin().z <= a.getMax().z;
+}
+
+//! Returns -1 if the box is outside the plane, 1 if inside, 0 if crossing.
+inline int classify(
+	const repo::core::RepoBoundingBox &box,
+	const repo::core::RepoPlane &plane)
+{
+	aiVector3D min = box.getMin();
+	aiVector3D max = box.getMax();
+	aiVector3D positive(
+		plane.normal.x >= 0 ? max.x : min.x,
+		plane.normal.y >= 0 ? max.y : min.y,
+		plane.normal.z >= 0 ? max.z : min.z);
+	aiVector3D negative(
+		plane.normal.x >= 0 ? min.x : max.x,
+		plane.normal.y >= 0 ? min.y : max.y,
+		plane.normal.z >= 0 ? min.z : max.z);
+	if (plane.normal * positive + plane.d < 0)
+		return -1;
+	return plane.normal * negative + plane.d >= 0 ? 1 : 0;
+}
+
+void repo::core::RepoBVH::collect(
+	uint32_t node,
+	std::vector<const RepoNodeMesh *> &result,
+	std::vector<uint32_t> *resultInstances) const
+{
+	std::vector<uint32_t> stack(1, node);
+	while (!stack.empty())
+	{
+		const RepoBVHNode &current = nodes[stack.back()];
+		stack.pop_back();
+		if (current.isLeaf())
+		{
+			result.insert(result.end(),
+				meshes.begin() + current.first,
+				meshes.begin() + current.first + current.count);
+			if (resultInstances)
+				resultInstances->insert(resultInstances->end(),
+					instances.begin() + current.first,
+					instances.begin() + current.first + current.count);
+		}
+		else
+		{
+			stack.push_back(current.first + 1);
+			stack.push_back(current.first);
+		}
+	}
+}
+
+void repo::core::RepoBVH::queryBox(
+	const RepoBoundingBox &box,
+	std::vector<const RepoNodeMesh *> &result,
+	std::vector<uint32_t> *resultInstances) const
+{
+	if (nodes.empty() || box.isEmpty())
+		return;
+
+	std::vector<uint32_t> stack(1, 0);
+	while (!stack.empty())
+	{
+		const RepoBVHNode &node = nodes[stack.back()];
+		stack.pop_back();
+		if (!overlaps(node.box, box))
+			continue;
+		if (node.isLeaf())
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; ++i)
+				if (overlaps(boxes[i], box))
+					append(i, result, resultInstances);
+		}
+		else
+		{
+			stack.push_back(node.first + 1);
+			stack.push_back(node.first);
+		}
+	}
+}
+
+void repo::core::RepoBVH::queryFrustum(
+	const std::vector<RepoPlane> &planes,
+	std::vector<const RepoNodeMesh *> &result,
+	std::vector<uint32_t> *resultInstances) const
+{
+	if (nodes.empty())
+		return;
+
+	std::vector<uint32_t> stack(1, 0);
+	while (!stack.empty())
+	{
+		uint32_t index = stack.back();
+		const RepoBVHNode &node = nodes[index];
+		stack.pop_back();
+
+		bool inside = true;
+		bool outside = false;
+		for (size_t p = 0; p < planes.size() && !outside; ++p)
+		{
+			int side = classify(node.box, planes[p]);
+			outside = side < 0;
+			inside = inside && side > 0;
+		}
+
+		if (outside)
+			continue;
+		else if (inside)
+			collect(index, result, resultInstances);
+		else if (node.isLeaf())
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; ++i)
+			{
+				bool visible = true;
+				for (size_t p = 0; p < planes.size() && visible; ++p)
+					visible = classify(boxes[i], planes[p]) >= 0;
+				if (visible)
+					append(i, result, resultInstances);
+			}
+		}
+		else
+		{
+			stack.push_back(node.first + 1);
+			stack.push_back(node.first);
+		}
+	}
+}
+
+void repo::core::RepoBVH::querySphere(
+	const aiVector3D &center,
+	float radius,
+	std::vector<const RepoNodeMesh *> &result,
+	std::vector<uint32_t> *resultInstances) const
+{
+	if (nodes.empty() || radius < 0)
+		return;
+
+	float radiusSquared = radius * radius;
+	std::vector<uint32_t> stack(1, 0);
+	while (!stack.empty())
+	{
+		const RepoBVHNode &node = nodes[stack.back()];
+		stack.pop_back();
+		if (getSquaredDistance(node.box, center) > radiusSquared)
+			continue;
+		if (node.isLeaf())
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; ++i)
+				if (getSquaredDistance(boxes[i], center) <= radiusSquared)
+					append(i, result, resultInstances);
+		}
+		else
+		{
+			stack.push_back(node.first + 1);
+			stack.push_back(node.first);
+		}
+	}
+}
+
+void repo::core::RepoBVH::queryNearest(
+	const aiVector3D &point,
+	unsigned int k,
+	std::vector<const RepoNodeMesh *> &result,
+	std::vector<uint32_t> *resultInstances) const
+{
+	if (nodes.empty() || 0 == k)
+		return;
+
+	typedef std::pair<float, uint32_t> Entry;
+
+	// Nodes to visit closest first and best meshes so far farthest first
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > open;
+	std::priority_queue<Entry> best;
+
+	open.push(Entry(getSquaredDistance(nodes[0].box, point), 0));
+	while (!open.empty())
+	{
+		Entry entry = open.top();
+		open.pop();
+		if (best.size() == k && entry.first > best.top().first)
+			break;
+
+		const RepoBVHNode &node = nodes[entry.second];
+		if (node.isLeaf())
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; ++i)
+			{
+				float distance = getSquaredDistance(boxes[i], point);
+				if (best.size() < k)
+					best.push(Entry(distance, i));
+				else if (distance < best.top().first)
+				{
+					best.pop();
+					best.push(Entry(distance, i));
+				}
+			}
+		}
+		else
+			for (uint32_t c = node.first; c < node.first + 2; ++c)
+				open.push(Entry(getSquaredDistance(nodes[c].box, point), c));
+	}
+
+	size_t offset = result.size();
+	result.resize(offset + best.size());
+	if (resultInstances)
+		resultInstances->resize(resultInstances->size() + best.size());
+	for (size_t i = result.size(); i-- > offset; best.pop())
+	{
+		result[i] = meshes[best.top().second];
+		if (resultInstances)
+			(*resultInstances)[resultInstances->size() - (result.size() - i)] =
+				instances[best.top().second];
+	}
+}
+
+//------------------------------------------------------------------------------
+//
+// Static helpers
+//
+//------------------------------------------------------------------------------
+
+std::vector<repo::core::RepoPlane> repo::core::RepoBVH::getFrustumPlanes(
+	const aiMatrix4x4 &m)
+{
+	// Gribb & Hartmann, rows combined with the w row
+	const float rows[4][4] = {
+		{ m.a1, m.a2, m.a3, m.a4 },
+		{ m.b1, m.b2, m.b3, m.b4 },
+		{ m.c1, m.c2, m.c3, m.c4 },
+		{ m.d1, m.d2, m.d3, m.d4 }};
+
+	std::vector<RepoPlane> planes(6);
+	for (unsigned int i = 0; i < 6; ++i)
+	{
+		const float *row = rows[i / 2];
+		float sign = (i % 2) ? -1.0f : 1.0f;
+		planes[i].normal = aiVector3D(
+			rows[3][0] + sign * row[0],
+			rows[3][1] + sign * row[1],
+			rows[3][2] + sign * row[2]);
+		planes[i].d = rows[3][3] + sign * row[3];
+
+		float length = planes[i].normal.Length();
+		if (length > 0)
+		{
+			planes[i].normal /= length;
+			planes[i].d /= length;
+		}
+	}
+	return planes;
+}
+
+float repo::core::RepoBVH::getSquaredDistance(
+	const RepoBoundingBox &box,
+	const aiVector3D &point)
+{
+	float distance = 0.0f;
+	aiVector3D min = box.getMin();
+	aiVector3D max = box.getMax();
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		float delta = std::max(0.0f,
+			std::max(min[axis] - point[axis], point[axis] - max[axis]));
+		distance += delta * delta;
+	}
+	return distance;
+}
@@ -0,0 +1,243 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_BVH_H
+#define REPO_BVH_H
+
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include <vector>
+//------------------------------------------------------------------------------
+#include "assimp/scene.h"
+//------------------------------------------------------------------------------
+#include "repo_bounding_box.h"
+#include "repo_node_mesh.h"
+#include "../repocoreglobal.h"
+
+namespace repo {
+namespace core {
+
+//! Maximum number of meshes in a leaf of the BVH.
+#define REPO_BVH_MAX_LEAF_SIZE 4
+
+//! Number of bins used to evaluate the surface area heuristic.
+#define REPO_BVH_BINS 16
+
+//! Subtrees with fewer meshes are always built on the current thread.
+#define REPO_BVH_MIN_PARALLEL_MESHES 4096
+
+//! Plane as normal and offset, points with n.p + d >= 0 are inside.
+struct REPO_CORE_EXPORT RepoPlane
+{
+	aiVector3D normal;
+	float d;
+};
+
+//! Node of the BVH stored in a flat array.
+/*!
+ * Internal nodes have count zero and their two children stored next to
+ * each other at first and first + 1. Leaves reference count meshes from
+ * first onwards in the order of the hierarchy.
+ */
+struct REPO_CORE_EXPORT RepoBVHNode
+{
+	RepoBoundingBox box;
+	uint32_t first;
+	uint32_t count;
+
+	bool isLeaf() const { return count > 0; }
+};
+
+//! Bounding volume hierarchy over world bounding boxes of meshes.
+/*!
+ * Built top-down with the binned surface area heuristic, with the upper
+ * levels of the hierarchy split among worker threads. When meshes move,
+ * refit() updates the boxes without rebuilding the hierarchy, which stays
+ * valid though it may become less efficient.
+ *
+ * Every instance of a mesh shared by several transformations is indexed
+ * with its own world bounding box, see RepoNodeMesh::getWorldMatrixCount().
+ * Queries append a mesh once per matching instance and, if asked for,
+ * the instances themselves in parallel. Instances with an empty bounding
+ * box cannot be located and are left out.
+ */
+class REPO_CORE_EXPORT RepoBVH
+{
+
+public :
+
+	RepoBVH() : builtInstances(0) {}
+
+	~RepoBVH() {}
+
+	//--------------------------------------------------------------------------
+	//
+	// Construction
+	//
+	//--------------------------------------------------------------------------
+
+	//! Builds the hierarchy over the world bounding boxes of the meshes.
+	/*!
+	 * \param meshes Meshes to index, they have to outlive the hierarchy
+	 * \param threads Number of workers, 0 uses the hardware concurrency
+	 */
+	void build(
+		const std::vector<const RepoNodeMesh *> &meshes,
+		unsigned int threads = 0);
+
+	//! Recomputes all bounding boxes bottom-up from the current mesh bounds.
+	/*!
+	 * Instances added since the build are not indexed and removed ones
+	 * are given an empty box, changes of the hierarchy call for a rebuild.
+	 */
+	void refit();
+
+	//--------------------------------------------------------------------------
+	//
+	// Getters
+	//
+	//--------------------------------------------------------------------------
+
+	//! Returns the number of indexed instances of meshes.
+	size_t size() const { return meshes.size(); }
+
+	bool empty() const { return meshes.empty(); }
+
+	//! Returns the number of instances given to the last build, including
+	//! those left out for an empty bounding box.
+	size_t getBuiltInstanceCount() const { return builtInstances; }
+
+	//! Returns the bounding box of all indexed meshes.
+	RepoBoundingBox getBoundingBox() const
+	{ return nodes.empty() ? RepoBoundingBox() : nodes[0].box; }
+
+	//! Returns the nodes, the root being the first.
+	const std::vector<RepoBVHNode> &getNodes() const { return nodes; }
+
+	//! Returns the meshes in the order referenced by the leaves.
+	const std::vector<const RepoNodeMesh *> &getMeshes() const { return meshes; }
+
+	//! Returns the instance of each of the meshes, see getMeshes().
+	const std::vector<uint32_t> &getInstances() const { return instances; }
+
+	//! Returns bytes of heap memory held by the nodes, meshes and boxes.
+	size_t getHeapSize() const
+	{
+		return nodes.capacity() * sizeof(RepoBVHNode)
+			+ meshes.capacity() * sizeof(const RepoNodeMesh *)
+			+ instances.capacity() * sizeof(uint32_t)
+			+ boxes.capacity() * sizeof(RepoBoundingBox);
+	}
+
+	//--------------------------------------------------------------------------
+	//
+	// Queries
+	//
+	//--------------------------------------------------------------------------
+
+	//! Appends meshes whose bounding box overlaps the box.
+	void queryBox(
+		const RepoBoundingBox &box,
+		std::vector<const RepoNodeMesh *> &result,
+		std::vector<uint32_t> *resultInstances = NULL) const;
+
+	//! Appends meshes whose bounding box is not entirely outside any plane.
+	/*!
+	 * Works for any convex volume, see getFrustumPlanes() for a view
+	 * frustum. Boxes near the corners of the volume might be reported
+	 * even though they do not intersect it.
+	 */
+	void queryFrustum(
+		const std::vector<RepoPlane> &planes,
+		std::vector<const RepoNodeMesh *> &result,
+		std::vector<uint32_t> *resultInstances = NULL) const;
+
+	//! Appends meshes whose bounding box intersects the sphere.
+	void querySphere(
+		const aiVector3D &center,
+		float radius,
+		std::vector<const RepoNodeMesh *> &result,
+		std::vector<uint32_t> *resultInstances = NULL) const;
+
+	//! Appends up to k meshes with bounding boxes closest to the point.
+	/*!
+	 * Meshes are appended nearest first, distance being zero for boxes
+	 * containing the point.
+	 */
+	void queryNearest(
+		const aiVector3D &point,
+		unsigned int k,
+		std::vector<const RepoNodeMesh *> &result,
+		std::vector<uint32_t> *resultInstances = NULL) const;
+
+	//--------------------------------------------------------------------------
+	//
+	// Static helpers
+	//
+	//--------------------------------------------------------------------------
+
+	//! Returns the six planes of a frustum given by a view projection matrix.
+	/*!
+	 * Normals point inwards, clip space depth is expected within [-1, 1].
+	 */
+	static std::vector<RepoPlane> getFrustumPlanes(
+		const aiMatrix4x4 &viewProjection);
+
+	//! Returns the squared distance of the point from the box, 0 if inside.
+	static float getSquaredDistance(
+		const RepoBoundingBox &box,
+		const aiVector3D &point);
+
+private :
+
+	//! Appends all meshes below the node.
+	void collect(
+		uint32_t node,
+		std::vector<const RepoNodeMesh *> &result,
+		std::vector<uint32_t> *resultInstances) const;
+
+	//! Appends the mesh of the leaf entry and optionally its instance.
+	void append(
+		uint32_t entry,
+		std::vector<const RepoNodeMesh *> &result,
+		std::vector<uint32_t> *resultInstances) const
+	{
+		result.push_back(meshes[entry]);
+		if (resultInstances)
+			resultInstances->push_back(instances[entry]);
+	}
+
+	std::vector<RepoBVHNode> nodes;
+
+	//! Indexed meshes in the order of the leaves.
+	std::vector<const RepoNodeMesh *> meshes;
+
+	//! Instances of the indexed meshes.
+	std::vector<uint32_t> instances;
+
+	//! World bounding boxes of the meshes at the last build or refit.
+	std::vector<RepoBoundingBox> boxes;
+
+	//! Instances of all meshes given to the last build.
+	size_t builtInstances;
+
+}; // end class
+
+} // end namespace core
+} // end namespace repo
+
+#endif // end REPO_BVH_H
@@ -20,8 +20,10 @@
 #include <boost/range/algorithm/copy.hpp>
 #include <boost/assign.hpp>
 #include <algorithm>
+#include <iomanip>
 #include <iostream>
 #include <map>
+#include <sstream>
 #include <vector>
 
 //------------------------------------------------------------------------------
@@ -37,8 +39,8 @@ void repo::core::RepoGraphAbstract::append(
 //    thisNode->addChild(thatGraph->rootNode);
 //    thatGraph->rootNode->addChild(thisNode);
 
-    std::set<const RepoNodeAbstract *> thisNodeParents = thisNode->getParents();
-    std::set<const RepoNodeAbstract *>::iterator it;
+    const std::vector<const RepoNodeAbstract *> &thisNodeParents = thisNode->getParents();
+    std::vector<const RepoNodeAbstract *>::const_iterator it;
     for (it = thisNodeParents.begin(); it != thisNodeParents.end(); ++it)
     {
         RepoNodeAbstract *thisNodeParent = const_cast<RepoNodeAbstract*>(*it);
@@ -85,7 +87,7 @@ repo::core::RepoNodeAbstract* repo::core::RepoGraphAbstract::getNodeByUniqueID(
 	const boost::uuids::uuid& uid) const
 {
 	RepoNodeAbstract* node = NULL;
-	std::map<boost::uuids::uuid, RepoNodeAbstract*>::const_iterator it =
+	RepoUUIDMap<RepoNodeAbstract*>::const_iterator it =
 		nodesByUniqueID.find(uid);
 	if (nodesByUniqueID.end() != it)		
 		node = it->second;
@@ -95,10 +97,134 @@ repo::core::RepoNodeAbstract* repo::core::RepoGraphAbstract::getNodeByUniqueID(
 void repo::core::RepoGraphAbstract::setRootNode(RepoNodeAbstract *root)
 {
     if (this->rootNode)
-        delete this->rootNode;
+        deleteNode(this->rootNode);
     this->rootNode = root;
 }
 
+void repo::core::RepoGraphAbstract::deleteNode(RepoNodeAbstract *node)
+{
+    delete node;
+}
+
+//------------------------------------------------------------------------------
+void repo::core::RepoGraphAbstract::setNodeUniqueID(
+	RepoNodeAbstract *node,
+	const boost::uuids::uuid &uniqueID)
+{
+	RepoUUIDMap<RepoNodeAbstract*>::iterator it =
+		nodesByUniqueID.find(node->getUniqueID());
+	if (nodesByUniqueID.end() != it && it->second == node)
+		nodesByUniqueID.erase(node->getUniqueID());
+	node->setUniqueID(uniqueID);
+	nodesByUniqueID.insert(std::make_pair(uniqueID, node));
+
+	// Paths are indexed by unique ID
+	node->setPathIndex(boost::shared_ptr<const RepoPathIndex>());
+	if (pathIndex)
+		pathIndex->invalidate();
+}
+
+//------------------------------------------------------------------------------
+boost::shared_ptr<const repo::core::RepoPathIndex>
+	repo::core::RepoGraphAbstract::getPathIndex() const
+{
+	if (!pathIndex || !pathIndex->isValid())
+	{
+		pathIndex.reset(new RepoPathIndex());
+		pathIndex->add(rootNode);
+		RepoUUIDMap<RepoNodeAbstract*>::const_iterator it;
+		for (it = nodesByUniqueID.begin(); it != nodesByUniqueID.end(); ++it)
+			pathIndex->add(it->second);
+
+		boost::shared_ptr<const RepoPathIndex> index = pathIndex;
+		if (rootNode)
+			rootNode->setPathIndex(index);
+		for (it = nodesByUniqueID.begin(); it != nodesByUniqueID.end(); ++it)
+			it->second->setPathIndex(index);
+	}
+	return pathIndex;
+}
+
+//------------------------------------------------------------------------------
+std::map<std::string, repo::core::RepoMemoryFootprint>
+	repo::core::RepoGraphAbstract::getFootprintByType() const
+{
+	std::map<std::string, RepoMemoryFootprint> byType;
+	RepoUUIDMap<RepoNodeAbstract*>::const_iterator it;
+	for (it = nodesByUniqueID.begin(); it != nodesByUniqueID.end(); ++it)
+	{
+		RepoMemoryFootprint &footprint = byType[it->second->getType()];
+		it->second->addFootprint(footprint);
+		++footprint.count;
+	}
+	if (rootNode && nodesByUniqueID.end() ==
+		nodesByUniqueID.find(rootNode->getUniqueID()))
+	{
+		RepoMemoryFootprint &footprint = byType[rootNode->getType()];
+		rootNode->addFootprint(footprint);
+		++footprint.count;
+	}
+	addFootprint(byType["graph"]);
+	return byType;
+}
+
+repo::core::RepoMemoryFootprint
+	repo::core::RepoGraphAbstract::getFootprint() const
+{
+	RepoMemoryFootprint total;
+	std::map<std::string, RepoMemoryFootprint> byType = getFootprintByType();
+	std::map<std::string, RepoMemoryFootprint>::const_iterator it;
+	for (it = byType.begin(); it != byType.end(); ++it)
+		total += it->second;
+	return total;
+}
+
+std::string repo::core::RepoGraphAbstract::getFootprintReport() const
+{
+	static const char *columns[] = { "type", "count", "nodes", "geometry",
+		"topology", "textures", "metadata", "strings", "edges", "indices",
+		"allocator", "total" };
+
+	std::stringstream report;
+	report << std::left << std::setw(16) << columns[0] << std::right;
+	for (size_t i = 1; i < sizeof(columns) / sizeof(columns[0]); ++i)
+		report << std::setw(12) << columns[i];
+	report << std::endl;
+
+	std::map<std::string, RepoMemoryFootprint> byType = getFootprintByType();
+	std::vector<std::pair<std::string, RepoMemoryFootprint> > rows(
+		byType.begin(), byType.end());
+	RepoMemoryFootprint total;
+	for (size_t i = 0; i < rows.size(); ++i)
+		total += rows[i].second;
+	rows.push_back(std::make_pair(std::string("total"), total));
+	for (size_t i = 0; i < rows.size(); ++i)
+	{
+		const RepoMemoryFootprint &f = rows[i].second;
+		report << std::left << std::setw(16) << rows[i].first << std::right
+			<< std::setw(12) << f.count
+			<< std::setw(12) << f.nodes
+			<< std::setw(12) << f.geometry
+			<< std::setw(12) << f.topology
+			<< std::setw(12) << f.textures
+			<< std::setw(12) << f.metadata
+			<< std::setw(12) << f.strings
+			<< std::setw(12) << f.edges
+			<< std::setw(12) << f.indices
+			<< std::setw(12) << f.allocator
+			<< std::setw(12) << f.getTotal() << std::endl;
+	}
+	return report.str();
+}
+
+void repo::core::RepoGraphAbstract::addFootprint(
+	RepoMemoryFootprint &footprint) const
+{
+	footprint.indices += nodesByUniqueID.getHeapSize();
+	if (pathIndex)
+		footprint.indices += sizeof(RepoPathIndex) + pathIndex->getHeapSize();
+}
+
 //------------------------------------------------------------------------------
 repo::core::RepoNodeAbstract* repo::core::RepoGraphAbstract::addNodeByUniqueID(
 	RepoNodeAbstract* node)
@@ -106,8 +232,11 @@ repo::core::RepoNodeAbstract* repo::core::RepoGraphAbstract::addNodeByUniqueID(
 	RepoNodeAbstract* oldNode = NULL;
 	if (node)
 	{
+		if (pathIndex)
+			pathIndex->invalidate();
+
 		boost::uuids::uuid uid = node->getUniqueID();
-        std::pair<std::map<boost::uuids::uuid,RepoNodeAbstract*>::iterator,bool>
+        std::pair<RepoUUIDMap<RepoNodeAbstract*>::iterator,bool>
                 ret = nodesByUniqueID.insert(std::make_pair(uid, node));
 
 		// If there was a previous entry with the same UID (insertion failed), 
@@ -129,8 +258,8 @@ void repo::core::RepoGraphAbstract::printDAG(
     if (node)
     {
         std::cout << delimiter << node->getName() << std::endl;
-        std::set<const RepoNodeAbstract *> children = node->getChildren();
-        std::set<const RepoNodeAbstract *>::const_iterator it;
+        const std::vector<const RepoNodeAbstract *> &children = node->getChildren();
+        std::vector<const RepoNodeAbstract *>::const_iterator it;
         for (it = children.begin();
              it != children.end(); ++it)
         {
@@ -147,41 +276,38 @@ void repo::core::RepoGraphAbstract::printDAG() const
 
 //------------------------------------------------------------------------------
 void repo::core::RepoGraphAbstract::buildGraph(
-	const std::map<boost::uuids::uuid, RepoNodeAbstract*>& nodesBySharedID) const
+	const RepoUUIDMap<RepoNodeAbstract*>& nodesBySharedID) const
 {
-	std::map<boost::uuids::uuid, RepoNodeAbstract*>::const_iterator it;		
-	std::map<boost::uuids::uuid, RepoNodeAbstract*>::const_iterator finder;	
+	RepoUUIDMap<RepoNodeAbstract*>::const_iterator it;
+	RepoUUIDMap<RepoNodeAbstract*>::const_iterator finder;
 
 	for (it = nodesBySharedID.begin(); it!= nodesBySharedID.end(); ++it)
 	{
 		RepoNodeAbstract* node = it->second;		
 
-        std::set<boost::uuids::uuid> psi = node->getParentSharedIDs();
-        for (std::set<boost::uuids::uuid>::iterator it = psi.begin();
+        const std::vector<boost::uuids::uuid> &psi = node->getUnlinkedParentSharedIDs();
+        for (std::vector<boost::uuids::uuid>::const_iterator it = psi.begin();
              it != psi.end(); ++it)
         {
             boost::uuids::uuid uuid = *it;
             finder = nodesBySharedID.find(uuid);
             if (nodesBySharedID.end() != finder)
             {
-                RepoNodeAbstract* parent = finder->second;
-                parent->addChild(node);
-                node->addParent(parent);
+                // Parent IDs of a node are unique, hence so are the edges
+                RepoNodeAbstract::link(finder->second, node);
             }
         }
 	}
+
+    // Linked parents are reachable through the pointers from now on
+	for (it = nodesBySharedID.begin(); it!= nodesBySharedID.end(); ++it)
+		it->second->releaseLinkedParentSharedIDs();
 }
 
 
 void repo::core::RepoGraphAbstract::clear()
 {
     rootNode = NULL;
-    std::map<boost::uuids::uuid, RepoNodeAbstract*>::iterator it;
-    for (it = nodesByUniqueID.begin(); it != nodesByUniqueID.end(); ++it)
-    {
-        //nodesByUniqueID;
-        it->first;
-        it->second = NULL;
-    }
     nodesByUniqueID.clear();
+    pathIndex.reset();
 }
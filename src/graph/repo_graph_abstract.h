@@ -21,8 +21,14 @@
 //------------------------------------------------------------------------------
 #include <mongo/client/dbclient.h> // the MongoDB driver
 //------------------------------------------------------------------------------
+#include <map>
+#include <string>
+//------------------------------------------------------------------------------
 #include "assimp/scene.h"
+#include "repo_memory_footprint.h"
 #include "repo_node_abstract.h"
+#include "repo_path_index.h"
+#include "repo_uuid_map.h"
 
 #include "../repocoreglobal.h"
 
@@ -78,7 +84,7 @@ public :
 	//! Returns a set of all unique nodes that make up the graph hierarchy.
 	virtual std::set<const RepoNodeAbstract *> getNodesRecursively() const;
 
-	//! Returns a set of nodes as values from nodesByUniqueID stl map.
+	//! Returns a set of nodes as values from nodesByUniqueID map.
     virtual RepoNodeAbstractSet getNodes() const;
 		
 	//! Returns a set of all unique IDs.
@@ -87,6 +93,28 @@ public :
 	//! Returns a graph node by UID, NULL if not present.
     virtual RepoNodeAbstract* getNodeByUniqueID(const boost::uuids::uuid &uid) const;
 
+	//! Returns paths of all nodes of the graph.
+	/*!
+	 * The index is built on first use, in a single pass over the graph, and
+	 * attached to every node so that serialisation reuses it. It is rebuilt
+	 * once any node changes its parents or a node is added.
+	 */
+	boost::shared_ptr<const RepoPathIndex> getPathIndex() const;
+
+	//! Returns heap memory held by the nodes of the graph by node type.
+	/*!
+	 * Memory held by the graph itself, such as its lookup maps and indices,
+	 * is reported under "graph". Buffers shared between copies of nodes are
+	 * reported by each copy, see RepoGraphScene(const RepoGraphScene &).
+	 */
+	std::map<std::string, RepoMemoryFootprint> getFootprintByType() const;
+
+	//! Returns heap memory held by the graph and all of its nodes.
+	RepoMemoryFootprint getFootprint() const;
+
+	//! Returns a table of the footprint by node type and category in bytes.
+	std::string getFootprintReport() const;
+
     //--------------------------------------------------------------------------
     //
     // Setters
@@ -96,6 +124,12 @@ public :
     //! Sets the root node of the graph and deletes any previously stored root.
     virtual void setRootNode(RepoNodeAbstract *root);
 
+    //! Changes the unique ID of a node of the graph and its lookup entry.
+    //! The path index is invalidated as it is keyed by unique ID.
+    void setNodeUniqueID(
+        RepoNodeAbstract *node,
+        const boost::uuids::uuid &uniqueID);
+
     //--------------------------------------------------------------------------
 	//
 	// Adders
@@ -130,10 +164,17 @@ protected :
 		
 	/*! 
 	 * Populates parental information in given nodes based on the uuid mapping.
-	 * Efficiency is (n log n).
+	 * Efficiency is linear in the number of parent links. Nodes are linked
+	 * in the order of the mapping.
 	 */
 	virtual void buildGraph(
-        const std::map<boost::uuids::uuid, RepoNodeAbstract*> &idMapping) const;
+        const RepoUUIDMap<RepoNodeAbstract*> &idMapping) const;
+
+	//! Adds memory held by the graph other than by its nodes.
+	virtual void addFootprint(RepoMemoryFootprint &footprint) const;
+
+	//! Deletes a node owned by the graph.
+	virtual void deleteNode(RepoNodeAbstract *node);
 
 protected :
 
@@ -147,7 +188,10 @@ protected :
     RepoNodeAbstract *rootNode;
 
 	//! A lookup map for the all nodes the graph contains.
-    std::map<boost::uuids::uuid, RepoNodeAbstract*> nodesByUniqueID;
+    RepoUUIDMap<RepoNodeAbstract*> nodesByUniqueID;
+
+	//! Lazily built paths of all nodes, shared with the nodes.
+	mutable boost::shared_ptr<RepoPathIndex> pathIndex;
 
 }; // end class
 
@@ -16,6 +16,7 @@
  */
 
 #include "repo_graph_history.h"
+#include "repo_node_registry.h"
 
 //------------------------------------------------------------------------------
 //
@@ -26,7 +27,9 @@
 repo::core::RepoGraphHistory::RepoGraphHistory(
 	const std::vector<mongo::BSONObj>& collection) : RepoGraphAbstract()
 {
-	std::map<boost::uuids::uuid, RepoNodeAbstract*> nodesBySharedID;
+	RepoUUIDMap<RepoNodeAbstract*> nodesBySharedID;
+	nodesBySharedID.reserve(collection.size());
+	nodesByUniqueID.reserve(collection.size());
     std::vector<mongo::BSONObj>::const_iterator it;
 
     for (it = collection.begin(); it != collection.end(); ++it)
@@ -36,8 +39,7 @@ repo::core::RepoGraphHistory::RepoGraphHistory(
 //	{
 		RepoNodeAbstract* node = NULL;
 
-		std::string nodeType = obj.getField(REPO_NODE_LABEL_TYPE).str();
-		if (REPO_NODE_TYPE_REVISION == nodeType)
+		if (RepoNodeRevision::TypeTag == RepoNodeRegistry::getTypeTag(obj))
 		{
 			node = new RepoNodeRevision(obj);
 			revisions.push_back(node);
@@ -86,6 +86,13 @@ public :
 
 protected :
 
+	//! Adds memory held by the lookup maps and the revisions vector.
+	void addFootprint(RepoMemoryFootprint &footprint) const
+	{
+		RepoGraphAbstract::addFootprint(footprint);
+		footprint.indices += RepoMemoryFootprint::getHeapSize(revisions);
+	}
+
 	//! A vector of all revisions from all branches.
 	std::vector<RepoNodeAbstract *> revisions; 
 
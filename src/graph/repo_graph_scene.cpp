@@ -16,9 +16,12 @@
  */
 
 #include "repo_graph_scene.h"
+#include "../compute/repo_parallel.h"
 #include <algorithm>
 #include <string>
 #include <cctype>
+#include <exception>
+#include <unordered_map>
 
 //------------------------------------------------------------------------------
 //
@@ -30,6 +33,8 @@ repo::core::RepoGraphScene::RepoGraphScene(
 	const aiScene* scene,
 	const std::map<std::string, RepoNodeAbstract*>& textures)
 	: RepoGraphAbstract()
+	, arena(NULL)
+	, bvh(NULL)
 {
     //--------------------------------------------------------------------------
     // Textures
@@ -139,88 +144,256 @@ repo::core::RepoGraphScene::RepoGraphScene(
 
 
 repo::core::RepoGraphScene::RepoGraphScene(
-	const std::vector<mongo::BSONObj>& collection) : RepoGraphAbstract()
+	const std::vector<mongo::BSONObj>& collection,
+	unsigned int threads,
+	bool useArena)
+	: RepoGraphAbstract()
+	, arena(useArena ? new RepoNodeArena() : NULL)
+	, bvh(NULL)
 {
 	// To retrieve a graph, first identify a root node.
-	// The very root normally does not have any parents, but this has to be
-	// made more general as in the future it will be possible to retrieve a
-	// subgraph from the scene in which case the root of the subgraph will
-	// have his parents, however, will be the top-most node in the subgraph.
-	//
-	// This can be achieved through set intersections from paths.
-	// The root node of the subgraph is the one which is in the retrieved
-	// collection of objects and is referenced the most times by the nodes.
-	// set_intersection on paths can deliver the most occurrences.
-
-    std::map<boost::uuids::uuid, RepoNodeAbstract *> nodesBySharedID;
-    for (std::vector<mongo::BSONObj>::const_iterator it = collection.begin();
-         it != collection.end();
-         ++it)
-    {
-        mongo::BSONObj obj = *it;
-		RepoNodeAbstract *node = NULL;
-
-		std::string nodeType = obj.getField(REPO_NODE_LABEL_TYPE).str();
-
-		if (REPO_NODE_TYPE_TRANSFORMATION == nodeType)
-		{
-			node = new RepoNodeTransformation(obj);
-            transformations.insert(node);
-		}
-		else if (REPO_NODE_TYPE_MESH == nodeType)
-		{
-			node = new RepoNodeMesh(obj);
-            meshes.insert(node);
-		}
-		else if (REPO_NODE_TYPE_MATERIAL == nodeType)
+	// The very root does not have any parents. The root of a subgraph, see
+	// MongoClientWrapper::fetchSubgraph(), keeps its parents which are not
+	// retrieved, hence it is the top-most node once the graph is built.
+
+	//--------------------------------------------------------------------------
+	// Decode the documents in parallel. Each worker decodes a contiguous
+	// block of the collection into its own container so that concatenating
+	// the blocks preserves the order of the collection. Arena is not thread
+	// safe, hence each block gets its own which are merged afterwards.
+	threads = RepoParallel::getThreadCount(threads);
+	size_t blockSize = std::max<size_t>(
+		REPO_SCENE_MIN_DOCUMENTS_PER_THREAD,
+		(collection.size() + threads - 1) / threads);
+	size_t blocks = (collection.size() + blockSize - 1) / blockSize;
+
+	std::vector<std::vector<RepoNodeAbstract *> > decoded(blocks);
+	if (blocks > 1)
+	{
+		// Exceptions are passed back to this thread as in serial decoding
+		std::vector<std::exception_ptr> errors(blocks);
+		std::vector<RepoNodeArena *> arenas(blocks, (RepoNodeArena *) NULL);
+		if (arena)
+			for (size_t b = 0; b < blocks; ++b)
+				arenas[b] = new RepoNodeArena();
+		RepoParallel::run(static_cast<unsigned int>(blocks),
+			[&collection, &decoded, &errors, &arenas, blockSize](unsigned int b)
 		{
-			node = new RepoNodeMaterial(obj);
-			materials.push_back(node);
-		}
-		else if (REPO_NODE_TYPE_TEXTURE == nodeType)
+			try
+			{
+				decodeNodes(collection, b * blockSize,
+					std::min(collection.size(), (b + 1) * blockSize),
+					decoded[b], arenas[b]);
+			}
+			catch (...)
+			{
+				errors[b] = std::current_exception();
+			}
+		});
+
+		for (size_t b = 0; b < blocks; ++b)
+			if (arenas[b])
+			{
+				arena->adopt(*arenas[b]);
+				delete arenas[b];
+			}
+
+		for (size_t b = 0; b < blocks; ++b)
+			if (errors[b])
+			{
+				if (arena)
+				{
+					delete arena;
+					arena = NULL;
+				}
+				else
+					for (size_t d = 0; d < blocks; ++d)
+						for (size_t i = 0; i < decoded[d].size(); ++i)
+							delete decoded[d][i];
+				std::rethrow_exception(errors[b]);
+			}
+	}
+	else if (blocks)
+	{
+		try
 		{
-            RepoNodeTexture *tex = new RepoNodeTexture(obj);
-			textures.push_back(tex);
-			node = tex;
+			decodeNodes(collection, 0, collection.size(), decoded[0], arena);
 		}
-		else if (REPO_NODE_TYPE_CAMERA == nodeType)
+		catch (...)
 		{
-			node = new RepoNodeCamera(obj);
-			cameras.push_back(node);
+			if (arena)
+			{
+				delete arena;
+				arena = NULL;
+			}
+			else
+				for (size_t i = 0; i < decoded[0].size(); ++i)
+					delete decoded[0][i];
+			throw;
 		}
-        else if (REPO_NODE_TYPE_REFERENCE == nodeType)
-        {
-            node = new RepoNodeReference(obj);
-            references.push_back(node);
-        }
-        else if (REPO_NODE_TYPE_METADATA == nodeType)
-        {
-            node = new RepoNodeMetadata(obj);
-            metadata.push_back(node);
-        }
-
-        //----------------------------------------------------------------------
-		if (!obj.hasField(REPO_NODE_LABEL_PARENTS))
-			rootNode = node;
+	}
 
-        //----------------------------------------------------------------------
-		// Skip objects of unrecognized type
-		if (node)
-		{
-			nodesByUniqueID.insert(std::make_pair(node->getUniqueID(), node));
-			// TODO: take care of multiple objects that have the same shared ID.
-			nodesBySharedID.insert(std::make_pair(node->getSharedID(), node));
-		}
-		else
+	//--------------------------------------------------------------------------
+	// Merge serially in the order of the collection
+	RepoUUIDMap<RepoNodeAbstract *> nodesBySharedID;
+	nodesBySharedID.reserve(collection.size());
+	nodesByUniqueID.reserve(collection.size());
+	for (size_t b = 0, doc = 0; b < blocks; ++b)
+	{
+		for (size_t i = 0; i < decoded[b].size(); ++i, ++doc)
 		{
-			std::cerr << "Unrecognized node type" << std::endl;
-			//RepoILogger::getInstance().log(repo::REPO_WARNING, "Node of unrecognized type.");
+			RepoNodeAbstract *node = decoded[b][i];
+
+			//------------------------------------------------------------------
+			if (!collection[doc].hasField(REPO_NODE_LABEL_PARENTS))
+				rootNode = node;
+
+			//------------------------------------------------------------------
+			// Skip objects of unrecognized type
+			if (node)
+			{
+				switch (node->getTypeTag())
+				{
+					case REPO_NODE_TAG_TRANSFORMATION :
+						transformations.insert(node);
+						break;
+					case REPO_NODE_TAG_MESH :
+						meshes.insert(node);
+						break;
+					case REPO_NODE_TAG_MATERIAL :
+						materials.push_back(node);
+						break;
+					case REPO_NODE_TAG_TEXTURE :
+						textures.push_back(static_cast<RepoNodeTexture *>(node));
+						break;
+					case REPO_NODE_TAG_CAMERA :
+						cameras.push_back(node);
+						break;
+					case REPO_NODE_TAG_REFERENCE :
+						references.push_back(node);
+						break;
+					case REPO_NODE_TAG_METADATA :
+						metadata.push_back(node);
+						break;
+					default :
+						break;
+				}
+
+				nodesByUniqueID.insert(std::make_pair(node->getUniqueID(), node));
+				// TODO: take care of multiple objects that have the same shared ID.
+				nodesBySharedID.insert(std::make_pair(node->getSharedID(), node));
+			}
+			else
+			{
+				std::cerr << "Unrecognized node type" << std::endl;
+				//RepoILogger::getInstance().log(repo::REPO_WARNING, "Node of unrecognized type.");
+			}
 		}
 	}
 
     //--------------------------------------------------------------------------
 	// Build the parental graph.
 	buildGraph(nodesBySharedID);
+
+	//--------------------------------------------------------------------------
+	// Root of a subgraph is the first node without any retrieved parent
+	for (size_t b = 0; !rootNode && b < blocks; ++b)
+		for (size_t i = 0; !rootNode && i < decoded[b].size(); ++i)
+			if (decoded[b][i] && decoded[b][i]->getParents().empty())
+				rootNode = decoded[b][i];
+}
+
+repo::core::RepoGraphScene::RepoGraphScene(const RepoGraphScene &other)
+	: RepoGraphAbstract()
+	, arena(NULL)
+	, bvh(NULL)
+{
+	//--------------------------------------------------------------------------
+	// Copy registered nodes, those only held by the containers and those
+	// only reachable through edges, each of them once.
+	std::unordered_map<const RepoNodeAbstract *, RepoNodeAbstract *> copies;
+	std::vector<const RepoNodeAbstract *> copied;
+	copies.reserve(other.nodesByUniqueID.size() + 1);
+	copied.reserve(other.nodesByUniqueID.size() + 1);
+	auto copyOf = [&copies, &copied](const RepoNodeAbstract *node)
+		-> RepoNodeAbstract *
+	{
+		if (!node)
+			return NULL;
+		std::pair<std::unordered_map<const RepoNodeAbstract *,
+			RepoNodeAbstract *>::iterator, bool> ret =
+			copies.insert(std::make_pair(node, (RepoNodeAbstract *) NULL));
+		if (ret.second)
+		{
+			ret.first->second = node->clone();
+			copied.push_back(node);
+		}
+		return ret.first->second;
+	};
+
+	nodesByUniqueID.reserve(other.nodesByUniqueID.size());
+	RepoUUIDMap<RepoNodeAbstract *>::const_iterator it;
+	for (it = other.nodesByUniqueID.begin(); it != other.nodesByUniqueID.end(); ++it)
+		nodesByUniqueID.insert(std::make_pair(it->first, copyOf(it->second)));
+
+	rootNode = copyOf(other.rootNode);
+	for (RepoNodeAbstractSet::const_iterator n = other.meshes.begin();
+		n != other.meshes.end(); ++n)
+		meshes.insert(copyOf(*n));
+	for (RepoNodeAbstractSet::const_iterator n = other.transformations.begin();
+		n != other.transformations.end(); ++n)
+		transformations.insert(copyOf(*n));
+	for (size_t i = 0; i < other.cameras.size(); ++i)
+		cameras.push_back(copyOf(other.cameras[i]));
+	for (size_t i = 0; i < other.materials.size(); ++i)
+		materials.push_back(copyOf(other.materials[i]));
+	for (size_t i = 0; i < other.metadata.size(); ++i)
+		metadata.push_back(copyOf(other.metadata[i]));
+	for (size_t i = 0; i < other.references.size(); ++i)
+		references.push_back(copyOf(other.references[i]));
+	for (size_t i = 0; i < other.textures.size(); ++i)
+		textures.push_back(static_cast<RepoNodeTexture *>(
+			copyOf(other.textures[i])));
+
+	//--------------------------------------------------------------------------
+	// Edges in their original order, copying nodes reached the first time
+	for (size_t n = 0; n < copied.size(); ++n)
+	{
+		const RepoNodeAbstract *node = copied[n];
+		std::vector<const RepoNodeAbstract *> edges;
+		edges.reserve(node->getParents().size());
+		for (size_t i = 0; i < node->getParents().size(); ++i)
+			edges.push_back(copyOf(node->getParents()[i]));
+		copies.find(node)->second->setParents(edges);
+
+		edges.clear();
+		edges.reserve(node->getChildren().size());
+		for (size_t i = 0; i < node->getChildren().size(); ++i)
+			edges.push_back(copyOf(node->getChildren()[i]));
+		copies.find(node)->second->setChildren(edges);
+	}
+}
+
+repo::core::RepoNodeAbstract *repo::core::RepoGraphScene::createNode(
+	const mongo::BSONObj &obj,
+	RepoNodeArena *arena)
+{
+	// Revisions belong to the history graph
+	return REPO_NODE_TAG_REVISION != RepoNodeRegistry::getTypeTag(obj)
+		? RepoNodeRegistry::create(obj, arena)
+		: NULL;
+}
+
+void repo::core::RepoGraphScene::decodeNodes(
+	const std::vector<mongo::BSONObj> &collection,
+	size_t begin,
+	size_t end,
+	std::vector<RepoNodeAbstract *> &nodes,
+	RepoNodeArena *arena)
+{
+	nodes.reserve(end - begin);
+	for (size_t i = begin; i < end; ++i)
+		nodes.push_back(createNode(collection[i], arena));
 }
 
 
@@ -232,10 +405,37 @@ repo::core::RepoGraphScene::RepoGraphScene(
 
 repo::core::RepoGraphScene::~RepoGraphScene()
 {
-    RepoNodeAbstractSet nodes = getNodes();
-    RepoNodeAbstractSet::iterator it;
-    for (it = nodes.begin(); it != nodes.end(); ++it)
-        delete *it;
+    RepoUUIDMap<RepoNodeAbstract*>::iterator it;
+    for (it = nodesByUniqueID.begin(); it != nodesByUniqueID.end(); ++it)
+        deleteNode(it->second);
+
+    // Bulk release of all arena nodes including the removed ones
+    delete arena;
+    delete bvh;
+}
+
+void repo::core::RepoGraphScene::deleteNode(RepoNodeAbstract *node)
+{
+    if (!arena || !arena->owns(node))
+        delete node;
+}
+
+void repo::core::RepoGraphScene::addFootprint(
+    RepoMemoryFootprint &footprint) const
+{
+    RepoGraphAbstract::addFootprint(footprint);
+    footprint.indices += RepoMemoryFootprint::getHeapSize(cameras)
+        + RepoMemoryFootprint::getHeapSize(meshes)
+        + RepoMemoryFootprint::getHeapSize(materials)
+        + RepoMemoryFootprint::getHeapSize(metadata)
+        + RepoMemoryFootprint::getHeapSize(references)
+        + RepoMemoryFootprint::getHeapSize(textures)
+        + RepoMemoryFootprint::getHeapSize(transformations);
+    if (bvh)
+        footprint.indices += sizeof(RepoBVH) + bvh->getHeapSize();
+    if (arena)
+        footprint.allocator += sizeof(RepoNodeArena)
+            + arena->getAllocatedBytes() - arena->getUsedBytes();
 }
 
 void repo::core::RepoGraphScene::append(RepoNodeAbstract *thisNode, RepoGraphAbstract *thatGraph)
@@ -251,7 +451,16 @@ void repo::core::RepoGraphScene::append(RepoNodeAbstract *thisNode, RepoGraphAbs
         cameras.insert(cameras.end(), thatScene->cameras.begin(), thatScene->cameras.end());
         references.insert(references.end(), thatScene->references.begin(), thatScene->references.end());
         metadata.insert(metadata.end(), thatScene->metadata.begin(), thatScene->metadata.end());
+
+        // Nodes of the other scene have to outlive it
+        if (thatScene->arena)
+        {
+            if (!arena)
+                arena = new RepoNodeArena();
+            arena->adopt(*thatScene->arena);
+        }
         thatScene->clear();
+        invalidateBVH();
     }
     thatGraph->clear();
 }
@@ -260,39 +469,92 @@ void repo::core::RepoGraphScene::append(RepoNodeAbstract *thisNode, RepoGraphAbs
 repo::core::RepoNodeAbstractSet repo::core::RepoGraphScene::addMetadata(
         const RepoNodeAbstractSet& metadata,
         bool exactMatch)
+{
+    return addMetadata(metadata, std::vector<std::string>(), exactMatch);
+}
+
+repo::core::RepoNodeAbstractSet repo::core::RepoGraphScene::addMetadata(
+        const RepoNodeAbstractSet& metadata,
+        const std::vector<std::string> &keys,
+        bool exactMatch,
+        RepoNodeAbstractSet *unmatched)
 {
     RepoNodeAbstractSet matches;
 
+    //--------------------------------------------------------------------------
+    // Build side: transformations by normalised name
+    std::unordered_map<std::string, std::vector<RepoNodeAbstract *> > byName;
+    byName.reserve(transformations.size());
     for (RepoNodeAbstract* transformation : transformations)
+        byName[normaliseName(transformation->getName(), exactMatch, true)]
+            .push_back(transformation);
+
+    //--------------------------------------------------------------------------
+    // Probe side: metadata by name and by values of the extra keys
+    std::vector<std::string> names;
+    for (RepoNodeAbstract* meta : metadata)
     {
-        std::string transformationName = transformation->getName();
-        if (!exactMatch)
+        names.clear();
+        names.push_back(normaliseName(meta->getName(), exactMatch, false));
+        const RepoNodeMetadata *node =
+            RepoNodeAbstract::castNode<const RepoNodeMetadata *>(meta);
+        if (!keys.empty() && node)
         {
-            transformationName = transformationName.substr(0, transformationName.find(" "));
-            std::transform(transformationName.begin(), transformationName.end(),transformationName.begin(), ::toupper);
+            mongo::BSONObj fields = node->getMetadata();
+            for (const std::string &key : keys)
+            {
+                mongo::BSONElement field = fields.getField(key);
+                if (mongo::String == field.type())
+                    names.push_back(
+                        normaliseName(field.String(), exactMatch, false));
+            }
         }
 
-        for (RepoNodeAbstract* meta : metadata)
+        bool matched = false;
+        for (size_t i = 0; i < names.size(); ++i)
         {
-            // TODO: improve efficiency by storing in std::map
-            std::string metaName = meta->getName();
-            if (!exactMatch)
-                std::transform(metaName.begin(), metaName.end(),metaName.begin(), ::toupper);
+            if (std::find(names.begin(), names.begin() + i, names[i])
+                != names.begin() + i)
+                continue;
 
-            if (metaName == transformationName)
-            {
-                transformation->addChild(meta);
-                meta->addParent(transformation);
-                addNodeByUniqueID(meta);
-                this->metadata.push_back(meta);
+            std::unordered_map<std::string,
+                std::vector<RepoNodeAbstract *> >::const_iterator it =
+                byName.find(names[i]);
+            if (byName.end() == it)
+                continue;
 
-                matches.insert(meta);
+            for (RepoNodeAbstract* transformation : it->second)
+            {
+                RepoNodeAbstract::link(transformation, meta);
             }
+            matched = true;
+        }
+
+        if (matched)
+        {
+            addNodeByUniqueID(meta);
+            this->metadata.push_back(meta);
+            matches.insert(meta);
         }
+        else if (unmatched)
+            unmatched->insert(meta);
     }
     return matches;
 }
 
+std::string repo::core::RepoGraphScene::normaliseName(
+        const std::string &name,
+        bool exactMatch,
+        bool truncate)
+{
+    if (exactMatch)
+        return name;
+
+    std::string normalised = truncate ? name.substr(0, name.find(" ")) : name;
+    std::transform(normalised.begin(), normalised.end(), normalised.begin(), ::toupper);
+    return normalised;
+}
+
 //------------------------------------------------------------------------------
 //
 // Export
@@ -420,6 +682,84 @@ std::vector<std::string> repo::core::RepoGraphScene::getNamesOfMeshes() const
 	return names;
 }
 
+void repo::core::RepoGraphScene::updateWorld() const
+{
+    RepoNodeAbstractSet::const_iterator it;
+    for (it = transformations.begin(); it != transformations.end(); ++it)
+        if ((*it)->isWorldDirty())
+            static_cast<const RepoNodeTransformation *>(*it)->getWorldMatrix();
+    for (it = meshes.begin(); it != meshes.end(); ++it)
+        if ((*it)->isWorldDirty())
+            static_cast<const RepoNodeMesh *>(*it)->getWorldMatrix();
+}
+
+void repo::core::RepoGraphScene::shareBuffers()
+{
+    for (RepoNodeAbstractSet::iterator it = meshes.begin();
+        it != meshes.end(); ++it)
+        static_cast<RepoNodeMesh *>(*it)->shareBuffers();
+    for (size_t i = 0; i < textures.size(); ++i)
+        textures[i]->shareData();
+}
+
+repo::core::RepoBoundingBox repo::core::RepoGraphScene::getWorldBoundingBox() const
+{
+    RepoBoundingBox box;
+    for (RepoNodeAbstractSet::const_iterator it = meshes.begin();
+        it != meshes.end(); ++it)
+    {
+        const RepoNodeMesh *mesh = static_cast<const RepoNodeMesh *>(*it);
+        for (size_t i = 0; i < mesh->getWorldMatrixCount(); ++i)
+            box.extend(mesh->getWorldBoundingBox(i));
+    }
+    return box;
+}
+
+const repo::core::RepoBVH &repo::core::RepoGraphScene::getBVH(
+    unsigned int threads) const
+{
+    if (!bvh)
+    {
+        std::vector<const RepoNodeMesh *> indexed;
+        indexed.reserve(meshes.size());
+        for (RepoNodeAbstractSet::const_iterator it = meshes.begin();
+            it != meshes.end(); ++it)
+            indexed.push_back(static_cast<const RepoNodeMesh *>(*it));
+
+        updateWorld();
+        bvh = new RepoBVH();
+        bvh->build(indexed, threads);
+
+        worldChanged.reset(new bool(false));
+        for (size_t i = 0; i < indexed.size(); ++i)
+            indexed[i]->setWorldChangedFlag(worldChanged);
+    }
+    else if (*worldChanged)
+    {
+        updateWorld();
+        *worldChanged = false;
+
+        // Instances added or removed by new edges need a new hierarchy
+        size_t instances = 0;
+        for (RepoNodeAbstractSet::const_iterator it = meshes.begin();
+            it != meshes.end(); ++it)
+            instances += static_cast<const RepoNodeMesh *>(*it)->getWorldMatrixCount();
+        if (instances != bvh->getBuiltInstanceCount())
+        {
+            invalidateBVH();
+            return getBVH(threads);
+        }
+        bvh->refit();
+    }
+    return *bvh;
+}
+
+void repo::core::RepoGraphScene::invalidateBVH() const
+{
+    delete bvh;
+    bvh = NULL;
+}
+
 
 
 
@@ -428,8 +768,9 @@ void repo::core::RepoGraphScene::removeNodeRecursively(RepoNodeAbstract* node)
 {
 
 
-    // Remove from parents
-    for (const RepoNodeAbstract* p : node->getParents())
+    // Remove from parents (iterates a copy as the edges are being removed)
+    const std::vector<const RepoNodeAbstract *> parents = node->getParents();
+    for (const RepoNodeAbstract* p : parents)
     {
         RepoNodeAbstract* parent = const_cast<RepoNodeAbstract*>(p);
         parent->removeChild(node);
@@ -437,7 +778,8 @@ void repo::core::RepoGraphScene::removeNodeRecursively(RepoNodeAbstract* node)
     }
 
     // Check children
-    for (const RepoNodeAbstract* c : node->getChildren())
+    const std::vector<const RepoNodeAbstract *> children = node->getChildren();
+    for (const RepoNodeAbstract* c : children)
     {
         RepoNodeAbstract* child = const_cast<RepoNodeAbstract*>(c);
         child->removeParent(node);
@@ -451,10 +793,11 @@ void repo::core::RepoGraphScene::removeNodeRecursively(RepoNodeAbstract* node)
     // TODO: remove also from materials, textures, etc
     nodesByUniqueID.erase(node->getUniqueID());
     transformations.erase(node);
-    meshes.erase(node);
+    if (meshes.erase(node))
+        invalidateBVH();
 
     // Clean up memory
-    delete node;
+    deleteNode(node);
     node = 0;
 }
 
@@ -473,6 +816,7 @@ void repo::core::RepoGraphScene::clear()
 
     materials.clear();
     meshes.clear();
+    invalidateBVH();
     textures.clear();
     transformations.clear();
     cameras.clear();
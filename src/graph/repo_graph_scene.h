@@ -32,12 +32,18 @@
 #include "repo_node_camera.h"
 #include "repo_node_reference.h"
 #include "repo_node_metadata.h"
+#include "repo_node_arena.h"
+#include "repo_bvh.h"
+#include "repo_node_registry.h"
 #include "../repocoreglobal.h"
 //------------------------------------------------------------------------------
 
 namespace repo {
 namespace core {
 
+//! Collections smaller than this are decoded on the calling thread only.
+#define REPO_SCENE_MIN_DOCUMENTS_PER_THREAD 64
+
 //! 3D Repo scene graph as directed acyclic graph with a single root node.
 class REPO_CORE_EXPORT RepoGraphScene : public RepoGraphAbstract
 {
@@ -51,10 +57,20 @@ public :
     //--------------------------------------------------------------------------
 
 	//! Empty default constructor so that it can be registered as a qmetatype.
-    RepoGraphScene() : RepoGraphAbstract(new RepoNodeTransformation()) {}
+    RepoGraphScene() : RepoGraphAbstract(new RepoNodeTransformation()), arena(NULL), bvh(NULL) {}
 
-	//! Copy constructor
-	//RepoGraphScene(const RepoGraphScene &) : RepoGraphAbstract() {};
+	//! Copy constructor, copies every node and edge of the other scene.
+	/*!
+	 * The copy can be modified without affecting the other scene. Once
+	 * shareBuffers() has been called on the other scene, the buffers of
+	 * meshes and textures are shared until modified, hence a copy costs the
+	 * hierarchy rather than the geometry. The other scene is only read.
+	 * Nodes keep their IDs and edges keep their order. Copies are allocated
+	 * on the heap.
+	 *
+	 * \sa RepoNodeAbstract::clone(), RepoSceneSnapshots
+	 */
+	RepoGraphScene(const RepoGraphScene &other);
 
 	/*!
 	 * Constructs a graph from Assimp's aiScene and the given predefined
@@ -69,9 +85,20 @@ public :
 	/*!
 	 * Constructs a graph from a collection of BSON objects.
 	 *
+	 * Documents are decoded in parallel and merged in the order of the
+	 * collection, hence the result is the same as if decoded serially.
+	 *
+	 * \param collection BSON representations of the nodes
+	 * \param threads Number of decoding workers, 0 uses the hardware
+	 * concurrency
+	 * \param useArena If true, nodes are allocated from an arena owned by
+	 * the scene and released all at once when the scene is destroyed
 	 * \sa RepoGraphScene(), ~RepoGraphScene()
 	 */
-	RepoGraphScene(const std::vector<mongo::BSONObj> &collection);
+	RepoGraphScene(
+		const std::vector<mongo::BSONObj> &collection,
+		unsigned int threads = 0,
+		bool useArena = false);
 
 	//! Destructor for proper cleanup.
 	/*!
@@ -88,9 +115,36 @@ public :
     RepoNodeAbstractSet addMetadata(const RepoNodeAbstractSet& metadata,
                      bool exactMatch = true);
 
+    //! Attaches metadata to transformations of matching names.
+    /*!
+     * Transformations are hashed by name once and every metadata node is
+     * looked up by its name and by the string values of the given metadata
+     * keys, hence the join runs in time linear in the number of
+     * transformations and metadata. A metadata node matching several
+     * transformations is attached to all of them.
+     *
+     * \param metadata Metadata nodes to attach, e.g. rows of a CSV file
+     * \param keys Additional metadata fields to match names against
+     * \param exactMatch If false, names are compared case insensitively and
+     * transformation names up to the first space only
+     * \param unmatched If given, receives metadata not attached anywhere
+     * \return Attached metadata nodes
+     */
+    RepoNodeAbstractSet addMetadata(const RepoNodeAbstractSet& metadata,
+                     const std::vector<std::string> &keys,
+                     bool exactMatch = true,
+                     RepoNodeAbstractSet *unmatched = NULL);
+
     void addMetadata(RepoNodeMetadata *meta)
     { metadata.push_back(meta); }
 
+    //! Registers a new transformation, edges have to be set by the caller.
+    void addTransformation(RepoNodeTransformation *transformation)
+    {
+        transformations.insert(transformation);
+        addNodeByUniqueID(transformation);
+    }
+
     //--------------------------------------------------------------------------
 	//
 	// Export
@@ -135,9 +189,57 @@ public :
     //! Returns a vector of metadata nodes.
     inline std::vector<RepoNodeAbstract *> getMetadata() const { return metadata; }
 
+	//! Returns a new node decoded from BSON, NULL if of unrecognized type.
+	/*!
+	 * Nodes are constructed through the RepoNodeRegistry, revisions are not
+	 * part of a scene and are skipped. The node is allocated from the arena
+	 * if given, from the heap otherwise.
+	 */
+	static RepoNodeAbstract *createNode(
+		const mongo::BSONObj &obj,
+		RepoNodeArena *arena = NULL);
+
+	//! Returns the arena of the scene, NULL if nodes are on the heap.
+	const RepoNodeArena *getArena() const { return arena; }
+
 	//! Returns a list of names of meshes.
 	std::vector<std::string> getNamesOfMeshes() const;
 
+	//! Brings cached world matrices and bounding boxes up to date.
+	/*!
+	 * World data is otherwise computed lazily on first access after a
+	 * change, which is not safe from multiple threads. Each stale node is
+	 * computed once, parents before children.
+	 */
+	void updateWorld() const;
+
+	//! Lets copies of this scene share the buffers of meshes and textures.
+	/*!
+	 * Copies made before are independent, see RepoNodeMesh::shareBuffers().
+	 * Has to be called before the scene is copied from several threads.
+	 */
+	void shareBuffers();
+
+	//! Returns the bounding box of all instances of meshes in world coordinates.
+	RepoBoundingBox getWorldBoundingBox() const;
+
+	//! Returns the spatial index of meshes in world coordinates.
+	/*!
+	 * The hierarchy is built on first use and rebuilt once meshes or their
+	 * instances are added or removed. If only transformations changed since,
+	 * it is refitted instead. Meshes report their changes through a shared
+	 * flag, hence an up to date index is returned in constant time. Like
+	 * updateWorld() this is not safe to call from multiple threads while the
+	 * index is out of date.
+	 *
+	 * \param threads Number of build workers, 0 uses the hardware
+	 * concurrency
+	 */
+	const RepoBVH &getBVH(unsigned int threads = 0) const;
+
+	//! Drops the spatial index so that the next getBVH() rebuilds it.
+	void invalidateBVH() const;
+
     //! Returns true if refrences are present, false otherwise.
     bool hasReferences() const { return references.size() > 0; }
 
@@ -153,6 +255,29 @@ public :
 
 protected :
 
+	//! Decodes documents [begin, end) of the collection in order.
+	/*!
+	 * Unrecognized documents are stored as NULL to keep the positions.
+	 */
+	static void decodeNodes(
+		const std::vector<mongo::BSONObj> &collection,
+		size_t begin,
+		size_t end,
+		std::vector<RepoNodeAbstract *> &nodes,
+		RepoNodeArena *arena = NULL);
+
+	//! Returns the name as compared by addMetadata().
+	static std::string normaliseName(
+		const std::string &name,
+		bool exactMatch,
+		bool truncate);
+
+	//! Deletes a heap node, arena nodes are left to the arena teardown.
+	void deleteNode(RepoNodeAbstract *node);
+
+	//! Adds memory held by containers, the spatial index and arena slack.
+	void addFootprint(RepoMemoryFootprint &footprint) const;
+
     // TODO: The vectors should be lists or sets to prevent excessive copying!
 
 	std::vector<RepoNodeAbstract *> cameras; //!< Cameras
@@ -169,6 +294,16 @@ protected :
 
     RepoNodeAbstractSet transformations; //!< Transformations
 
+    //! Optional arena holding the nodes decoded by this scene, NULL if unused.
+    RepoNodeArena *arena;
+
+    //! Lazily built spatial index of meshes, NULL until requested.
+    mutable RepoBVH *bvh;
+
+    //! Raised by indexed meshes whose world data went stale since the
+    //! last build or refit, see RepoNodeMesh::setWorldChangedFlag().
+    mutable boost::shared_ptr<bool> worldChanged;
+
 }; // end class
 
 } // end namespace core
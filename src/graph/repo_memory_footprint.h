@@ -0,0 +1,112 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_MEMORY_FOOTPRINT_H
+#define REPO_MEMORY_FOOTPRINT_H
+
+//------------------------------------------------------------------------------
+#include <set>
+#include <string>
+#include <vector>
+//------------------------------------------------------------------------------
+#include "../repocoreglobal.h"
+
+namespace repo {
+namespace core {
+
+//! Bytes of heap memory held by nodes and graphs, by category.
+/*!
+ * Sizes are derived from the capacities of the containers, hence they
+ * include reserved but unused space. Allocator bookkeeping is estimated for
+ * tree based containers and ignored otherwise.
+ */
+struct REPO_CORE_EXPORT RepoMemoryFootprint
+{
+    unsigned long long count; //!< Number of nodes
+    unsigned long long nodes; //!< Node objects and their fixed size members
+    unsigned long long geometry; //!< Vertices, normals, UVs, colors, outlines
+    unsigned long long topology; //!< Faces and their vertex indices
+    unsigned long long textures; //!< Pixel data of textures
+    unsigned long long metadata; //!< BSON documents of metadata nodes
+    unsigned long long strings; //!< Names, types and other strings
+    unsigned long long edges; //!< Parent and child pointers, parent shared IDs
+    unsigned long long indices; //!< Lookup maps, containers and caches
+    unsigned long long allocator; //!< Reserved but unused space of arenas
+
+    RepoMemoryFootprint()
+        : count(0)
+        , nodes(0)
+        , geometry(0)
+        , topology(0)
+        , textures(0)
+        , metadata(0)
+        , strings(0)
+        , edges(0)
+        , indices(0)
+        , allocator(0) {}
+
+    //! Returns the sum of all categories in bytes.
+    unsigned long long getTotal() const
+    {
+        return nodes + geometry + topology + textures + metadata + strings
+            + edges + indices + allocator;
+    }
+
+    RepoMemoryFootprint &operator+=(const RepoMemoryFootprint &other)
+    {
+        count += other.count;
+        nodes += other.nodes;
+        geometry += other.geometry;
+        topology += other.topology;
+        textures += other.textures;
+        metadata += other.metadata;
+        strings += other.strings;
+        edges += other.edges;
+        indices += other.indices;
+        allocator += other.allocator;
+        return *this;
+    }
+
+    //--------------------------------------------------------------------------
+    //
+    // Static helpers
+    //
+    //--------------------------------------------------------------------------
+
+    //! Returns bytes allocated by the string, 0 if stored in place.
+    static unsigned long long getHeapSize(const std::string &string)
+    {
+        static const size_t inPlace = std::string().capacity();
+        return string.capacity() > inPlace ? string.capacity() + 1 : 0;
+    }
+
+    //! Returns bytes allocated by the vector, not by its elements.
+    template <class T>
+    static unsigned long long getHeapSize(const std::vector<T> &vector)
+    { return vector.capacity() * sizeof(T); }
+
+    //! Returns bytes allocated by the set, i.e. a tree node per element.
+    template <class T, class C>
+    static unsigned long long getHeapSize(const std::set<T, C> &set)
+    { return set.size() * (sizeof(T) + 4 * sizeof(void *)); }
+
+};
+
+} // end namespace core
+} // end namespace repo
+
+#endif // end REPO_MEMORY_FOOTPRINT_H
@@ -16,6 +16,12 @@
  */
 
 #include "repo_node_abstract.h"
+#include "repo_node_registry.h"
+#include "repo_path_index.h"
+#include "repo_uuid_map.h"
+#include "../sha256/sha256.h"
+
+#include <cstdio>
 
 //------------------------------------------------------------------------------
 //
@@ -23,7 +29,9 @@
 //
 //------------------------------------------------------------------------------
 
-repo::core::RepoNodeAbstract::RepoNodeAbstract(const mongo::BSONObj &obj)
+repo::core::RepoNodeAbstract::RepoNodeAbstract(
+	const mongo::BSONObj &obj,
+	RepoNodeTypeTag typeTag) : typeTag(typeTag), worldDirty(true)
 {
     //--------------------------------------------------------------------------
 	// ID
@@ -41,6 +49,8 @@ repo::core::RepoNodeAbstract::RepoNodeAbstract(const mongo::BSONObj &obj)
 		type = obj.getField(REPO_NODE_LABEL_TYPE).String();
 	else
 		type = REPO_NODE_TYPE_UNKNOWN; // failsafe
+	if (REPO_NODE_TAG_UNKNOWN == typeTag)
+		this->typeTag = toTypeTag(type);
 
     //--------------------------------------------------------------------------
 	// API level
@@ -62,11 +72,18 @@ repo::core::RepoNodeAbstract::RepoNodeAbstract(const mongo::BSONObj &obj)
 			RepoTranscoderBSON::retrieveUUIDs(
 				obj.getField(REPO_NODE_LABEL_PARENTS));
 
-        std::vector<boost::uuids::uuid>::iterator it;
-        for (it = parentIDs.begin(); it != parentIDs.end(); ++it)
+        // Nodes shared by many others, such as materials, list many parents
+        if (parentIDs.size() < 2)
+            parentSharedIDs.swap(parentIDs);
+        else
         {
-            boost::uuids::uuid id = *it;
-			parentSharedIDs.insert(id);
+            RepoUUIDMap<bool> unique;
+            unique.reserve(parentIDs.size());
+            parentSharedIDs.reserve(parentIDs.size());
+            std::vector<boost::uuids::uuid>::iterator it;
+            for (it = parentIDs.begin(); it != parentIDs.end(); ++it)
+                if (unique.insert(std::make_pair(*it, true)).second)
+                    parentSharedIDs.push_back(*it);
         }
 	}
 }
@@ -109,39 +126,37 @@ bool repo::core::RepoNodeAbstract::operator<(const RepoNodeAbstract& other) cons
 std::vector<std::vector<boost::uuids::uuid>>
 	repo::core::RepoNodeAbstract::getPaths(const RepoNodeAbstract * node)
 {
-	std::vector<std::vector<boost::uuids::uuid>> ret;
-
-	if (node->isRoot())
-	{	
-        //----------------------------------------------------------------------
-		// Base case
-		std::vector<boost::uuids::uuid> vec;
-		vec.push_back(node->sharedID);
-		ret.push_back(vec);
+	if (node->pathIndex && node->pathIndex->isValid())
+		return node->pathIndex->getPaths(node);
+	return RepoPathIndex(node).getPaths(node);
+}
+
+void repo::core::RepoNodeAbstract::setPathIndex(
+	const boost::shared_ptr<const RepoPathIndex> &index) const
+{
+	if (pathIndex && pathIndex != index)
+		pathIndex->invalidate();
+	pathIndex = index;
+}
+
+void repo::core::RepoNodeAbstract::invalidatePaths() const
+{
+	if (pathIndex)
+	{
+		pathIndex->invalidate();
+		pathIndex.reset();
 	}
-	else 
-	{	
-        //----------------------------------------------------------------------
-		// Recursion
-        std::set<const RepoNodeAbstract *>::iterator it;
-        for (it = node->parents.begin(); it != node->parents.end(); ++it)
-        {
-            const RepoNodeAbstract *parent = *it;
-            std::vector<std::vector<boost::uuids::uuid> > paths =
-				getPaths(parent);			
-			
-            //------------------------------------------------------------------
-			// Store the current node in all the so far accumulated paths
-            std::vector<std::vector<boost::uuids::uuid> >::iterator itt;
-            for (itt = paths.begin(); itt != paths.end(); ++itt)
-            {
-                std::vector<boost::uuids::uuid> vec = *itt;
-                vec.push_back(node->sharedID);
-				ret.push_back(vec);
-			}
-		}		
+}
+
+void repo::core::RepoNodeAbstract::invalidateWorld() const
+{
+	if (!worldDirty)
+	{
+		worldDirty = true;
+        std::vector<const RepoNodeAbstract *>::const_iterator it;
+        for (it = children.begin(); it != children.end(); ++it)
+            (*it)->invalidateWorld();
 	}
-	return ret;
 }
 
 void repo::core::RepoNodeAbstract::getSubNodes(
@@ -149,28 +164,67 @@ void repo::core::RepoNodeAbstract::getSubNodes(
 {
 	components.insert(this);
 
-    std::set<const RepoNodeAbstract *>::iterator it;
+    std::vector<const RepoNodeAbstract *>::const_iterator it;
     for (it = children.begin(); it != children.end(); ++it)
     {
         const RepoNodeAbstract *child = *it;
-		child->getSubNodes(components);
+        // Shared subgraphs are visited only once
+        if (0 == components.count(child))
+            child->getSubNodes(components);
     }
 }
 
-std::set<boost::uuids::uuid> repo::core::RepoNodeAbstract::
-	getParentSharedIDs() 
+void repo::core::RepoNodeAbstract::addFootprint(
+	RepoMemoryFootprint &footprint) const
 {
-	if (parents.size() > parentSharedIDs.size())
-	{
-		parentSharedIDs.clear();
-        std::set<const RepoNodeAbstract *>::iterator it;
-        for (it = parents.begin(); it != parents.end(); ++it)
-        {
-//		for each (const RepoNodeAbstract * parent in parents)
-			parentSharedIDs.insert((*it)->sharedID);
-        }
-	}
-	return parentSharedIDs;
+	footprint.nodes += sizeof(RepoNodeAbstract);
+	footprint.strings += RepoMemoryFootprint::getHeapSize(type)
+		+ RepoMemoryFootprint::getHeapSize(name);
+	footprint.edges += RepoMemoryFootprint::getHeapSize(parents)
+		+ RepoMemoryFootprint::getHeapSize(children)
+		+ RepoMemoryFootprint::getHeapSize(parentSharedIDs);
+}
+
+std::vector<boost::uuids::uuid> repo::core::RepoNodeAbstract::
+	getParentSharedIDs() const
+{
+	std::vector<boost::uuids::uuid> ids;
+	ids.reserve(parents.size() + parentSharedIDs.size());
+	RepoUUIDMap<bool> linked;
+	linked.reserve(parentSharedIDs.empty() ? 0 : parents.size());
+    std::vector<const RepoNodeAbstract *>::const_iterator it;
+    for (it = parents.begin(); it != parents.end(); ++it)
+    {
+		ids.push_back((*it)->sharedID);
+		if (!parentSharedIDs.empty())
+			linked.insert(std::make_pair((*it)->sharedID, true));
+    }
+
+    std::vector<boost::uuids::uuid>::const_iterator idIt;
+    for (idIt = parentSharedIDs.begin(); idIt != parentSharedIDs.end(); ++idIt)
+        if (linked.end() == linked.find(*idIt))
+            ids.push_back(*idIt);
+	return ids;
+}
+
+void repo::core::RepoNodeAbstract::releaseLinkedParentSharedIDs()
+{
+	if (parentSharedIDs.empty() || parents.empty())
+		return;
+
+	RepoUUIDMap<bool> linked;
+	linked.reserve(parents.size());
+    std::vector<const RepoNodeAbstract *>::const_iterator it;
+    for (it = parents.begin(); it != parents.end(); ++it)
+		linked.insert(std::make_pair((*it)->sharedID, true));
+
+	std::vector<boost::uuids::uuid> unlinked;
+    std::vector<boost::uuids::uuid>::const_iterator idIt;
+    for (idIt = parentSharedIDs.begin(); idIt != parentSharedIDs.end(); ++idIt)
+        if (linked.end() == linked.find(*idIt))
+            unlinked.push_back(*idIt);
+	// Swap rather than assign to release the memory
+	parentSharedIDs.swap(unlinked);
 }
 
 //------------------------------------------------------------------------------
@@ -194,10 +248,10 @@ void repo::core::RepoNodeAbstract::appendDefaultFields(
 	// Paths
 	// 
 	// Paths are stored as array of arrays of shared_id (uuids)
-	const std::vector<std::vector<boost::uuids::uuid>> paths = 
-		getPaths(this);
-	if (paths.size() > 0)
-		RepoTranscoderBSON::append(REPO_NODE_LABEL_PATHS, paths, builder);
+	if (pathIndex && pathIndex->isValid())
+		pathIndex->appendPaths(REPO_NODE_LABEL_PATHS, this, builder);
+	else
+		RepoPathIndex(this).appendPaths(REPO_NODE_LABEL_PATHS, this, builder);
 			
     //--------------------------------------------------------------------------
 	// Type
@@ -213,7 +267,7 @@ void repo::core::RepoNodeAbstract::appendDefaultFields(
 	if (!isRoot()) 
 	{
 		std::vector<boost::uuids::uuid> parentalUUIDs;
-        std::set<const RepoNodeAbstract *>::iterator it;
+        std::vector<const RepoNodeAbstract *>::const_iterator it;
         for (it = parents.begin(); it != parents.end(); ++it)
         {
 //		for each (const RepoNodeAbstract * node in parents)
@@ -231,11 +285,43 @@ void repo::core::RepoNodeAbstract::appendDefaultFields(
 		builder <<  REPO_NODE_LABEL_NAME << name;
 }
 
+std::string repo::core::RepoNodeAbstract::computeFingerprint(
+	const mongo::BSONObj &obj)
+{
+	SHA256 sha;
+	sha.init();
+	for (mongo::BSONObjIterator it(obj); it.more(); )
+	{
+		mongo::BSONElement e = it.next();
+		std::string field = e.fieldName();
+		if (REPO_NODE_LABEL_ID != field
+			&& REPO_NODE_LABEL_SHARED_ID != field
+			&& REPO_NODE_LABEL_PATHS != field
+			&& REPO_NODE_LABEL_PARENTS != field
+			&& REPO_NODE_LABEL_FINGERPRINT != field)
+			sha.update(reinterpret_cast<const unsigned char *>(e.rawdata()),
+				e.size());
+	}
+	unsigned char digest[SHA256::DIGEST_SIZE];
+	sha.final(digest);
+
+	char hex[2 * SHA256::DIGEST_SIZE + 1];
+	for (unsigned int i = 0; i < SHA256::DIGEST_SIZE; ++i)
+		sprintf(hex + 2 * i, "%02x", digest[i]);
+	return std::string(hex, 2 * SHA256::DIGEST_SIZE);
+}
+
 //------------------------------------------------------------------------------
 //
 // Static helpers
 //
 //------------------------------------------------------------------------------
+repo::core::RepoNodeTypeTag repo::core::RepoNodeAbstract::toTypeTag(
+	const std::string &type)
+{
+	return RepoNodeRegistry::getTypeTag(type);
+}
+
 mongo::Date_t repo::core::RepoNodeAbstract::currentTimestamp()
 {
 	return mongo::Date_t(time(NULL) * 1000); // milliseconds
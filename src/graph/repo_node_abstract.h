@@ -21,20 +21,52 @@
 //------------------------------------------------------------------------------
 #include <mongo/client/dbclient.h> // the MongoDB driver
 //------------------------------------------------------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <set>
+#include <type_traits>
+#include <vector>
+//------------------------------------------------------------------------------
 #include <boost/uuid/uuid.hpp> 
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/functional/hash.hpp>
+#include <boost/shared_ptr.hpp>
 //------------------------------------------------------------------------------
 #include "../conversion/repo_transcoder_bson.h"
 #include "../conversion/repo_transcoder_string.h"
 //------------------------------------------------------------------------------
 
 #include "repo_node_types.h"
+#include "repo_memory_footprint.h"
 #include "../repocoreglobal.h"
 
 namespace repo {
 namespace core {
 
+class RepoPathIndex;
+
+//! Type of a node as a compact tag, one per node class.
+/*!
+ * Tags mirror the 'type' strings stored in the repository so that the type
+ * of a node can be checked without string comparisons or dynamic_casts.
+ * Each node class exposes its own tag as a static TypeTag member.
+ */
+enum RepoNodeTypeTag
+{
+	REPO_NODE_TAG_UNKNOWN = 0,
+	REPO_NODE_TAG_TRANSFORMATION,
+	REPO_NODE_TAG_MESH,
+	REPO_NODE_TAG_MATERIAL,
+	REPO_NODE_TAG_TEXTURE,
+	REPO_NODE_TAG_CAMERA,
+	REPO_NODE_TAG_REFERENCE,
+	REPO_NODE_TAG_METADATA,
+	REPO_NODE_TAG_REVISION
+};
+
+template <class T> class RepoNodeTypeRange;
+
 //! Base abstract class for all entries stored in 3D Repo.
 /*!
  * Each document preserved in 3D Repo being it a scene graph node or a revision
@@ -74,10 +106,12 @@ public :
 		const boost::uuids::uuid &sharedId = boost::uuids::random_generator()(),
 		const std::string &name = std::string()) : 
 			type(type), 
+			typeTag(toTypeTag(type)),
 			api(api), 
             sharedID(sharedId),
 			uniqueID(boost::uuids::random_generator()()), 
-            name(name) {}
+            name(name),
+            worldDirty(true) {}
 
 	//! BSON to repository node conversion constructor.
 	/*!
@@ -86,9 +120,20 @@ public :
 	 * "unknown". If API level is not present, it is set to 0.
 	 * 
 	 * \param obj BSON representation of a scene graph or revision graph node.
+	 * \param typeTag Tag of the node class, looked up by type if unknown.
 	 * \sa RepoNodeAbstract() and ~RepoNodeAbstract()
 	 */
-	RepoNodeAbstract(const mongo::BSONObj &obj);
+	RepoNodeAbstract(
+		const mongo::BSONObj &obj,
+		RepoNodeTypeTag typeTag = REPO_NODE_TAG_UNKNOWN);
+
+	//! Returns a copy of this node with the same IDs but without any edges.
+	/*!
+	 * Parents that were never linked keep their shared IDs. Large buffers
+	 * such as geometry or pixel data are shared with the copy rather than
+	 * duplicated, see RepoGraphScene(const RepoGraphScene &).
+	 */
+	virtual RepoNodeAbstract *clone() const = 0;
 
     //--------------------------------------------------------------------------
 	//
@@ -130,10 +175,29 @@ public :
 	 */
 	virtual mongo::BSONObj toBSONObj() const = 0;
 
+    //! Returns the content fingerprint of this node, see computeFingerprint().
+    std::string getFingerprint() const
+    { return computeFingerprint(toBSONObj()); }
+
+    //! Returns a hex SHA-256 of the fields of a node's BSON representation.
+    /*!
+     * Identity and hierarchy fields, that is unique and shared IDs, paths,
+     * parents and the fingerprint itself, are left out so that two nodes
+     * with equal content have equal fingerprints wherever they are stored.
+     */
+    static std::string computeFingerprint(const mongo::BSONObj &obj);
+
     //! Returns a string representation of the node, name in this case.
     virtual std::string toString() const
     { return name; }
 
+    //! Adds heap memory held by this node to the footprint.
+    /*!
+     * Derived classes add their own size and buffers on top. Buffers shared
+     * with copies of the node, see clone(), are reported by each of them.
+     */
+    virtual void addFootprint(RepoMemoryFootprint &footprint) const;
+
     //--------------------------------------------------------------------------
 	//
 	// Graph access
@@ -181,22 +245,27 @@ public :
 	//! Returns the type of the node.
     inline std::string getType() const { return type; }
 
+	//! Returns the type tag of the node.
+    inline RepoNodeTypeTag getTypeTag() const { return typeTag; }
+
 	//! Returns the api level of the node.
     inline unsigned int getApi() const { return api; }
 
-    //! Returns children of the node.
-    inline std::set<const RepoNodeAbstract *> getChildren() const { return children; }
+    //! Returns children of the node in the order they were added.
+    inline const std::vector<const RepoNodeAbstract *> &getChildren() const { return children; }
 
+    //! Returns children of type T, such as getChildren<const RepoNodeMesh*>().
     template<class T>
-    std::set<T> getChildren() const
-    { return getNodesOfType<T>(children); }
+    RepoNodeTypeRange<T> getChildren() const
+    { return RepoNodeTypeRange<T>(children); }
 
-    //! Returns parents of the node.
-    inline std::set<const RepoNodeAbstract *> getParents() const { return parents; }
+    //! Returns parents of the node in the order they were added.
+    inline const std::vector<const RepoNodeAbstract *> &getParents() const { return parents; }
 
+    //! Returns parents of type T, such as getParents<const RepoNodeMesh*>().
     template<class T>
-    std::set<T> getParents() const
-    { return getNodesOfType<T>(parents); }
+    RepoNodeTypeRange<T> getParents() const
+    { return RepoNodeTypeRange<T>(parents); }
 
     void setName(const std::string& name)
     { this->name = name; }
@@ -204,8 +273,9 @@ public :
     void setUniqueID(const boost::uuids::uuid &uuid)
     { this->uniqueID = uuid; }
 
+    //! Sets the shared ID, paths of the node and its descendants are invalid.
     void setSharedID(const boost::uuids::uuid &uuid)
-    { this->sharedID = uuid; }
+    { this->sharedID = uuid; invalidatePaths(); }
 
     void setRandomUniqueID()
     { setUniqueID(boost::uuids::random_generator()()); }
@@ -217,7 +287,7 @@ public :
     { setRandomUniqueID(); setRandomSharedID(); }
 
     bool isTransformation() const
-    { return REPO_NODE_TYPE_TRANSFORMATION == getType(); }
+    { return REPO_NODE_TAG_TRANSFORMATION == typeTag; }
 
     //--------------------------------------------------------------------------
 	//
@@ -232,21 +302,41 @@ public :
 	 * \sa addParent(), addChild(), setChildren()
 	 */
 	inline void setParents(
-		const std::set<const RepoNodeAbstract *> & parents) 
-            { this->parents = std::set<const RepoNodeAbstract *>(parents); }
+		const std::vector<const RepoNodeAbstract *> & parents) 
+            { this->parents = parents; invalidateWorld(); invalidatePaths(); }
 
 	//! Adds parent to this node.
 	/*!
-	 * Adds a parent to the set of parents of this node. This function does
-	 * not affect the parent node to prevent infinite cycles.
-	 * \sa addChild()
+	 * Adds a parent to the list of parents of this node unless already
+	 * present, which takes time linear in the number of parents. This
+	 * function does not affect the parent node to prevent infinite cycles.
+	 * \sa addChild(), link()
 	 */
     inline void addParent(const RepoNodeAbstract* parent)
-    { parents.insert(parent); parentSharedIDs.insert(parent->sharedID); }
+    {
+        if (!hasParent(parent))
+        {
+            parents.push_back(parent);
+            invalidateWorld();
+            invalidatePaths();
+        }
+    }
 
     //! Returns true if parent is removed successfully, false otherwise.
     bool removeParent(const RepoNodeAbstract* parent)
-    { return 1 == parents.erase(parent) && 1 == parentSharedIDs.erase(parent->sharedID); }
+    {
+        bool removed = remove(parents, parent);
+        if (removed)
+        {
+            invalidateWorld();
+            invalidatePaths();
+        }
+        return removed;
+    }
+
+    //! Returns true if the given node is a parent of this node.
+    inline bool hasParent(const RepoNodeAbstract* parent) const
+    { return parents.end() != std::find(parents.begin(), parents.end(), parent); }
 
 
 	//! Sets children of this node.
@@ -256,35 +346,100 @@ public :
 	 * \sa addChild(), addParent(), setParents()
 	 */
 	inline void setChildren(
-		const std::set<const RepoNodeAbstract *> & children) 
-        { this->children = std::set<const RepoNodeAbstract *>(children); }
+		const std::vector<const RepoNodeAbstract *> & children) 
+        { this->children = children; }
 		
 	//! Adds child to this node.
 	/*!
-	 * Adds a child to the set of children of this node. This function does
-	 * not affect the child node to prevent infinite cycles.
-	 * \sa addParent()
+	 * Adds a child to the list of children of this node unless already
+	 * present, which takes time linear in the number of children. This
+	 * function does not affect the child node to prevent infinite cycles.
+	 * \sa addParent(), link()
 	 */
     inline void addChild(const RepoNodeAbstract* child)
-        { children.insert(child); }
+    {
+        if (!hasChild(child))
+            children.push_back(child);
+    }
 
     //! Returns true if child is found and removed, false otherwise.
     bool removeChild(const RepoNodeAbstract* child)
-    { return 1 == children.erase(child); }
+    { return remove(children, child); }
 
-	//! Recursively retrieves all possible paths from this node to the root
+    //! Returns true if the given node is a child of this node.
+    inline bool hasChild(const RepoNodeAbstract* child) const
+    { return children.end() != std::find(children.begin(), children.end(), child); }
+
+	//! Adds an edge from the parent to the child in both directions.
+	/*!
+	 * Unlike addParent() and addChild() existing edges are not looked up,
+	 * hence the edge must not be present yet. Graph builders which add every
+	 * edge once use this to link nodes shared by a great many others, such
+	 * as materials and textures, in constant time.
+	 */
+    static void link(RepoNodeAbstract* parent, RepoNodeAbstract* child)
+    {
+        parent->children.push_back(child);
+        child->parents.push_back(parent);
+        child->invalidateWorld();
+        child->invalidatePaths();
+    }
+
+	//! Marks cached world data of this node and all its descendants as stale.
+	/*!
+	 * World matrices and bounding boxes are computed lazily by the node types
+	 * that have them. Propagation stops at nodes that are already stale as
+	 * their descendants have been marked by then.
+	 */
+    virtual void invalidateWorld() const;
+
+	//! Returns true if the cached world data has to be recomputed.
+    inline bool isWorldDirty() const { return worldDirty; }
+
+	//! Retrieves all possible paths from the root to this node.
+	/*!
+	 * Uses the path index attached to the node if still valid, otherwise
+	 * indexes the ancestors of the node visiting each of them once.
+	 */
 	static std::vector<std::vector<boost::uuids::uuid> > 
 		getPaths(const RepoNodeAbstract * node);
 
+	//! Attaches an index holding paths of this node, see getPaths().
+	/*!
+	 * The index is shared by all nodes of a graph and invalidated as soon as
+	 * any of them changes its parents. A previously attached index is
+	 * invalidated as well since this node no longer guards it.
+	 */
+	void setPathIndex(const boost::shared_ptr<const RepoPathIndex> &index) const;
+
+	//! Returns the attached path index, possibly empty or out of date.
+	const boost::shared_ptr<const RepoPathIndex> &getPathIndex() const
+	{ return pathIndex; }
+
 	//! Recursively retrieve components of a subgraph of this node.
     void getSubNodes(std::set<const RepoNodeAbstract *> &components) const;
 
 	//! Returns shared IDs of parents of this node if any.
 	/*!
-	 * Performs caching. If the size of the cached set is not the same as the
-	 * size of the current parents, this set is recalculated.
+	 * Includes both the linked parents and the parents loaded from the
+	 * repository which have not been linked yet.
+	 */
+    std::vector<boost::uuids::uuid> getParentSharedIDs() const;
+
+	//! Returns shared IDs of parents loaded from the repository.
+	/*!
+	 * Only valid until the graph is built, see releaseLinkedParentSharedIDs().
 	 */
-    std::set<boost::uuids::uuid> getParentSharedIDs();
+    inline const std::vector<boost::uuids::uuid> &getUnlinkedParentSharedIDs() const
+    { return parentSharedIDs; }
+
+	//! Forgets loaded shared IDs of parents that are already linked.
+	/*!
+	 * Once the parents are linked their shared IDs are available through the
+	 * parent nodes themselves, hence only IDs of parents missing from the
+	 * graph are retained.
+	 */
+    void releaseLinkedParentSharedIDs();
 
     //--------------------------------------------------------------------------
 	//
@@ -295,22 +450,52 @@ public :
 	//! Returns the current time in milliseconds.
 	static mongo::Date_t currentTimestamp();
 
+    //! Returns the tag of the given type string.
+    static RepoNodeTypeTag toTypeTag(const std::string &type);
+
+    //! Returns true if the node is of pointer type T, false otherwise.
+    template<class T>
+    static bool isOfType(const RepoNodeAbstract *node)
+    {
+        typedef typename std::remove_cv<
+                typename std::remove_pointer<T>::type>::type NodeType;
+        return NodeType::TypeTag == node->typeTag;
+    }
+
+    //! Returns the node cast to pointer type T if of that type, NULL otherwise.
+    template<class T>
+    static T castNode(RepoNodeAbstract *node)
+    { return node && isOfType<T>(node) ? static_cast<T>(node) : NULL; }
+
+    template<class T>
+    static T castNode(const RepoNodeAbstract *node)
+    { return node && isOfType<T>(node) ? static_cast<T>(node) : NULL; }
+
 
     //! Returns a set of nodes that are of the specific type only.
     template<class T>
-    static std::set<T> getNodesOfType(std::set<const RepoNodeAbstract*> set)
+    static std::set<T> getNodesOfType(
+            const std::vector<const RepoNodeAbstract*> &nodes)
     {
         std::set<T> ret;
-        for (auto node : set)
-        {
-            T child = dynamic_cast<T>(node);
-            if (child)
-                ret.insert(child);
-        }
+        for (auto node : nodes)
+            if (isOfType<T>(node))
+                ret.insert(static_cast<T>(node));
         return ret;
     }
 
 protected :
+
+	//! Copies identity of the node but none of its edges, see clone().
+	RepoNodeAbstract(const RepoNodeAbstract &other) :
+		type(other.type),
+		typeTag(other.typeTag),
+		api(other.api),
+		sharedID(other.sharedID),
+		uniqueID(other.uniqueID),
+		name(other.name),
+		parentSharedIDs(other.parentSharedIDs),
+		worldDirty(true) {}
 	
     //--------------------------------------------------------------------------
 	//
@@ -329,6 +514,22 @@ protected :
 	 */
 	void appendDefaultFields(mongo::BSONObjBuilder &builder) const;
 
+    //! Removes the node from the list preserving the order of the others.
+    static bool remove(
+            std::vector<const RepoNodeAbstract *> &nodes,
+            const RepoNodeAbstract *node)
+    {
+        std::vector<const RepoNodeAbstract *>::iterator it =
+                std::find(nodes.begin(), nodes.end(), node);
+        if (nodes.end() == it)
+            return false;
+        nodes.erase(it);
+        return true;
+    }
+
+    //! Invalidates and releases the attached path index after edge changes.
+    void invalidatePaths() const;
+
 protected :
 
     //--------------------------------------------------------------------------
@@ -339,6 +540,8 @@ protected :
 	
 	std::string type; //!< Compulsory type of this document.
 
+	RepoNodeTypeTag typeTag; //!< Tag of the type of this document.
+
 	unsigned int api; //!< Compulsory API level of this document (used to decode).
 
 	boost::uuids::uuid sharedID; //!< Shared unique graph document identifier.
@@ -349,23 +552,107 @@ protected :
 
 	//! Parents of this node.
 	/*! 
-	 * Parents are a std:set to make sure all entries are unique.		  
+	 * Unique entries kept in a plain vector, a pointer per edge.
 	 */
-    std::set<const RepoNodeAbstract *> parents;
+    std::vector<const RepoNodeAbstract *> parents;
 
 	/*!
-	 * Shared IDs of the parents. Needs to be in sync with
-	 * parents set. This is only useful when retrieving data from the 
-	 * repository as this set can otherwise be calculated on the fly.
+	 * Shared IDs of the parents as loaded from the repository. This is only
+	 * useful until the parents are linked as the IDs can otherwise be
+	 * retrieved from the parent nodes.
 	 */
-	std::set<boost::uuids::uuid> parentSharedIDs; 
+	std::vector<boost::uuids::uuid> parentSharedIDs; 
 
 	//! Children of this node.
 	/*! 
-	 * Children are a std:set to make sure all entries are unique.		  
+	 * Unique entries kept in a plain vector, a pointer per edge.
 	 */
     // TODO: remove const
-    std::set<const RepoNodeAbstract *> children;
+    std::vector<const RepoNodeAbstract *> children;
+
+	//! True if cached world data (if any) needs recomputing.
+	mutable bool worldDirty;
+
+	//! Index of paths of the graph this node belongs to, if any.
+	mutable boost::shared_ptr<const RepoPathIndex> pathIndex;
+
+}; // end class
+
+//! Nodes of a single type within a list of nodes, iterated without copying.
+/*!
+ * T is a const pointer to a node class, e.g. const RepoNodeMesh*. Other
+ * nodes are skipped on the fly by comparing their type tags.
+ */
+template <class T>
+class RepoNodeTypeRange
+{
+
+public :
+
+    typedef std::vector<const RepoNodeAbstract *>::const_iterator base_iterator;
+
+    class const_iterator
+    {
+
+    public :
+
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T *pointer;
+        typedef T reference;
+
+        const_iterator(base_iterator it, base_iterator end)
+            : it(it), end(end) { skip(); }
+
+        T operator*() const { return static_cast<T>(*it); }
+
+        const_iterator &operator++() { ++it; skip(); return *this; }
+
+        const_iterator operator++(int)
+        { const_iterator tmp(*this); ++*this; return tmp; }
+
+        bool operator==(const const_iterator &other) const
+        { return it == other.it; }
+
+        bool operator!=(const const_iterator &other) const
+        { return it != other.it; }
+
+    private :
+
+        void skip()
+        {
+            while (it != end && !RepoNodeAbstract::isOfType<T>(*it))
+                ++it;
+        }
+
+        base_iterator it;
+
+        base_iterator end;
+
+    }; // end class
+
+    typedef const_iterator iterator;
+
+    RepoNodeTypeRange(const std::vector<const RepoNodeAbstract *> &nodes)
+        : nodes(&nodes) {}
+
+    const_iterator begin() const
+    { return const_iterator(nodes->begin(), nodes->end()); }
+
+    const_iterator end() const
+    { return const_iterator(nodes->end(), nodes->end()); }
+
+    //! Returns the number of nodes of type T, linear in the list length.
+    size_t size() const
+    { return std::distance(begin(), end()); }
+
+    bool empty() const
+    { return begin() == end(); }
+
+private :
+
+    const std::vector<const RepoNodeAbstract *> *nodes;
 
 }; // end class
 
@@ -0,0 +1,100 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "repo_node_arena.h"
+
+void *repo::core::RepoNodeArena::allocate(size_t bytes, size_t alignment)
+{
+	size_t padding = (alignment - ((size_t) current % alignment)) % alignment;
+	if (NULL == current || padding + bytes > remaining)
+	{
+		//----------------------------------------------------------------------
+		// Objects larger than a block get a block of their own so that the
+		// free space of the current block is not wasted.
+		size_t size = bytes + alignment;
+		if (size > blockSize / 4)
+		{
+			char *block = (char *) ::operator new(size);
+			blocks.insert(std::make_pair(block, size));
+			char *ptr = block + (alignment - ((size_t) block % alignment)) % alignment;
+			usedBytes += bytes;
+			return ptr;
+		}
+
+		current = (char *) ::operator new(blockSize);
+		remaining = blockSize;
+		blocks.insert(std::make_pair(current, blockSize));
+		padding = (alignment - ((size_t) current % alignment)) % alignment;
+	}
+
+	char *ptr = current + padding;
+	current += padding + bytes;
+	remaining -= padding + bytes;
+	usedBytes += bytes;
+	return ptr;
+}
+
+bool repo::core::RepoNodeArena::owns(const void *ptr) const
+{
+	const char *p = (const char *) ptr;
+	std::map<const char *, size_t>::const_iterator it = blocks.upper_bound(p);
+	if (blocks.begin() == it)
+		return false;
+	--it;
+	return p < it->first + it->second;
+}
+
+void repo::core::RepoNodeArena::adopt(RepoNodeArena &other)
+{
+	if (&other == this)
+		return;
+	blocks.insert(other.blocks.begin(), other.blocks.end());
+	nodes.insert(nodes.end(), other.nodes.begin(), other.nodes.end());
+	usedBytes += other.usedBytes;
+
+	other.blocks.clear();
+	other.nodes.clear();
+	other.current = NULL;
+	other.remaining = 0;
+	other.usedBytes = 0;
+}
+
+void repo::core::RepoNodeArena::clear()
+{
+	for (std::vector<RepoNodeAbstract *>::reverse_iterator it = nodes.rbegin();
+		it != nodes.rend(); ++it)
+		(*it)->~RepoNodeAbstract();
+	nodes.clear();
+
+	for (std::map<const char *, size_t>::iterator it = blocks.begin();
+		it != blocks.end(); ++it)
+		::operator delete((void *) it->first);
+	blocks.clear();
+
+	current = NULL;
+	remaining = 0;
+	usedBytes = 0;
+}
+
+size_t repo::core::RepoNodeArena::getAllocatedBytes() const
+{
+	size_t bytes = 0;
+	for (std::map<const char *, size_t>::const_iterator it = blocks.begin();
+		it != blocks.end(); ++it)
+		bytes += it->second;
+	return bytes;
+}
@@ -0,0 +1,119 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_NODE_ARENA_H
+#define REPO_NODE_ARENA_H
+
+//------------------------------------------------------------------------------
+#include <cstddef>
+#include <map>
+#include <new>
+#include <utility>
+#include <vector>
+//------------------------------------------------------------------------------
+#include "repo_node_abstract.h"
+#include "../repocoreglobal.h"
+
+namespace repo {
+namespace core {
+
+//! Default size of a single arena block in bytes.
+#define REPO_NODE_ARENA_BLOCK_SIZE (1 << 20)
+
+//! Region allocator for the nodes of a single graph.
+/*!
+ * Nodes are constructed in place in large blocks one after another and
+ * their memory is only returned once the whole arena is cleared, at which
+ * point all nodes are destroyed in one go. This turns the teardown of big
+ * scenes into a handful of deallocations and keeps the nodes of a scene
+ * close together in memory.
+ *
+ * Nodes allocated from an arena must never be deleted individually. The
+ * arena is not thread safe, concurrent producers should use an arena each
+ * and merge them with adopt().
+ */
+class REPO_CORE_EXPORT RepoNodeArena
+{
+
+public :
+
+	//! Creates an empty arena, no memory is allocated until needed.
+	RepoNodeArena(size_t blockSize = REPO_NODE_ARENA_BLOCK_SIZE)
+		: blockSize(blockSize)
+		, current(NULL)
+		, remaining(0)
+		, usedBytes(0) {}
+
+	//! Destroys all nodes and releases all blocks.
+	~RepoNodeArena() { clear(); }
+
+	//! Constructs a node of type T in the arena.
+	template <class T, class... Args>
+	T *create(Args&&... args)
+	{
+		void *memory = allocate(sizeof(T), alignof(T));
+		T *node = new (memory) T(std::forward<Args>(args)...);
+		nodes.push_back(node);
+		return node;
+	}
+
+	//! Returns uninitialised memory that lives as long as the arena.
+	void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+	//! Returns true if the object was allocated from this arena.
+	bool owns(const void *ptr) const;
+
+	//! Takes over all nodes and blocks of the other arena leaving it empty.
+	void adopt(RepoNodeArena &other);
+
+	//! Destroys all nodes in reverse order and releases all blocks.
+	void clear();
+
+	//! Returns the number of nodes constructed in the arena.
+	size_t getNodesCount() const { return nodes.size(); }
+
+	//! Returns the number of bytes handed out so far.
+	size_t getUsedBytes() const { return usedBytes; }
+
+	//! Returns the number of bytes held in blocks.
+	size_t getAllocatedBytes() const;
+
+private :
+
+	RepoNodeArena(const RepoNodeArena &);
+	RepoNodeArena &operator=(const RepoNodeArena &);
+
+	size_t blockSize;
+
+	char *current; //!< Next free byte of the last block.
+
+	size_t remaining; //!< Free bytes left in the last block.
+
+	size_t usedBytes;
+
+	//! Blocks keyed by their first byte, valued by their size.
+	std::map<const char *, size_t> blocks;
+
+	//! Nodes in the order of construction.
+	std::vector<RepoNodeAbstract *> nodes;
+
+}; // end class
+
+} // end namespace core
+} // end namespace repo
+
+#endif // end REPO_NODE_ARENA_H
@@ -62,7 +62,7 @@ repo::core::RepoNodeCamera::RepoNodeCamera(
 //------------------------------------------------------------------------------
 
 repo::core::RepoNodeCamera::RepoNodeCamera(const mongo::BSONObj &obj) 
-	: RepoNodeAbstract(obj)
+	: RepoNodeAbstract(obj, TypeTag)
 {
     //--------------------------------------------------------------------------
 	// Aspect ratio
@@ -49,6 +49,9 @@ class REPO_CORE_EXPORT RepoNodeCamera : public RepoNodeAbstract
 
 public :
 
+	//! Type tag of all nodes of this class.
+	static const RepoNodeTypeTag TypeTag = REPO_NODE_TAG_CAMERA;
+
     //--------------------------------------------------------------------------
 	//
 	// Constructors
@@ -110,6 +113,17 @@ public :
 	//
     //--------------------------------------------------------------------------
 	
+	//! Returns a copy without edges, see RepoNodeAbstract::clone().
+	RepoNodeAbstract *clone() const
+	{ return new RepoNodeCamera(*this); }
+
+	//! Adds memory held by this node, see RepoNodeAbstract::addFootprint().
+	void addFootprint(RepoMemoryFootprint &footprint) const
+	{
+		RepoNodeAbstract::addFootprint(footprint);
+		footprint.nodes += sizeof(RepoNodeCamera) - sizeof(RepoNodeAbstract);
+	}
+
 	//! BSONObj representation.
 	/*!
 	 * Returns a BSON representation of this repository object suitable for a
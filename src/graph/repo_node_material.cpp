@@ -102,8 +102,7 @@ repo::core::RepoNodeMaterial::RepoNodeMaterial(
 
 		if (textures.end() != it)
 		{
-			this->addChild(it->second);
-			it->second->addParent(this);
+			link(this, it->second);
 		}
 	}
 }
@@ -112,7 +111,7 @@ repo::core::RepoNodeMaterial::RepoNodeMaterial(
 
 repo::core::RepoNodeMaterial::RepoNodeMaterial(
 	const mongo::BSONObj &obj) : 
-		RepoNodeAbstract(obj) ,
+		RepoNodeAbstract(obj, TypeTag) ,
 		ambient(NULL),
 		diffuse(NULL),
 		emissive(NULL),
@@ -175,6 +174,19 @@ repo::core::RepoNodeMaterial::RepoNodeMaterial(
 									numberDouble();
 }
 
+repo::core::RepoNodeMaterial::RepoNodeMaterial(const RepoNodeMaterial &other)
+	: RepoNodeAbstract(other)
+	, ambient(other.ambient ? new aiColor3D(*other.ambient) : NULL)
+	, diffuse(other.diffuse ? new aiColor3D(*other.diffuse) : NULL)
+	, emissive(other.emissive ? new aiColor3D(*other.emissive) : NULL)
+	, specular(other.specular ? new aiColor3D(*other.specular) : NULL)
+	, isWireframe(other.isWireframe)
+	, isTwoSided(other.isTwoSided)
+	, opacity(other.opacity)
+	, shininess(other.shininess)
+	, shininessStrength(other.shininessStrength)
+{}
+
 //------------------------------------------------------------------------------
 //
 // Destructor
@@ -346,7 +358,7 @@ void repo::core::RepoNodeMaterial::toAssimp(
 	// Diffuse texture
 	// 3D Repo supports only diffuse textures at the moment
 	std::map<const RepoNodeAbstract *, std::string>::const_iterator it;
-    std::set<const RepoNodeAbstract *>::iterator childrenIt;
+    std::vector<const RepoNodeAbstract *>::const_iterator childrenIt;
 
     for (childrenIt = children.begin(); childrenIt!=children.end();++childrenIt)
     {
@@ -458,3 +470,14 @@ float repo::core::RepoNodeMaterial::getShininessStrength() const
 {
     return shininessStrength;
 }
+
+void repo::core::RepoNodeMaterial::addFootprint(
+    RepoMemoryFootprint &footprint) const
+{
+    RepoNodeAbstract::addFootprint(footprint);
+    footprint.nodes += sizeof(RepoNodeMaterial) - sizeof(RepoNodeAbstract);
+    const aiColor3D *colors[] = { ambient, diffuse, emissive, specular };
+    for (const aiColor3D *color : colors)
+        if (color)
+            footprint.nodes += sizeof(aiColor3D);
+}
@@ -55,6 +55,9 @@ class REPO_CORE_EXPORT RepoNodeMaterial : public RepoNodeAbstract
 
 public :
 
+	//! Type tag of all nodes of this class.
+	static const RepoNodeTypeTag TypeTag = REPO_NODE_TAG_MATERIAL;
+
     //--------------------------------------------------------------------------
 	//
 	// Constructors
@@ -99,6 +102,9 @@ public :
 	 */
     RepoNodeMaterial(const mongo::BSONObj &obj);
 
+	//! Copy constructor, colors are duplicated, edges are not copied.
+	RepoNodeMaterial(const RepoNodeMaterial &other);
+
     //--------------------------------------------------------------------------
 	//
 	// Destructor
@@ -123,6 +129,13 @@ public :
 	//
     //--------------------------------------------------------------------------
 
+	//! Returns a copy without edges, see RepoNodeAbstract::clone().
+	RepoNodeAbstract *clone() const
+	{ return new RepoNodeMaterial(*this); }
+
+	//! Adds memory held by this node, see RepoNodeAbstract::addFootprint().
+	void addFootprint(RepoMemoryFootprint &footprint) const;
+
 	//! BSONObj representation.
 	/*!
 	 * Returns a BSON representation of this repository object suitable for a
@@ -18,10 +18,63 @@
 
 #include "repo_node_mesh.h"
 #include "repo_node_transformation.h"
+#include "../compute/repo_triangulator.h"
 
 #include <algorithm>
 #include <functional>
 
+//! Owner of the buffers of a mesh shared with its copies.
+struct repo::core::RepoNodeMesh::Buffers
+{
+	explicit Buffers(const RepoNodeMesh *mesh)
+		: vertices(mesh->vertices)
+		, faces(mesh->faces)
+		, normals(mesh->normals)
+		, outline(mesh->outline)
+		, uvChannels(mesh->uvChannels)
+		, colors(mesh->colors) {}
+
+	~Buffers()
+	{
+		delete vertices;
+		delete faces;
+		delete normals;
+		delete outline;
+		if (NULL != uvChannels)
+		{
+			for (size_t i = 0; i < uvChannels->size(); ++i)
+				delete (*uvChannels)[i];
+			delete uvChannels;
+		}
+		delete colors;
+	}
+
+	//! Hands the buffers back to a mesh without deallocating them.
+	void release()
+	{
+		vertices = NULL;
+		faces = NULL;
+		normals = NULL;
+		outline = NULL;
+		uvChannels = NULL;
+		colors = NULL;
+	}
+
+	std::vector<aiVector3t<float> > *vertices;
+	std::vector<aiFace> *faces;
+	std::vector<aiVector3t<float> > *normals;
+	std::vector<aiVector2D> *outline;
+	std::vector<std::vector<aiVector3t<float> > *> *uvChannels;
+	std::vector<aiColor4D> *colors;
+};
+
+//! Returns a copy of the buffer on the heap, NULL if there is none.
+template <class T>
+inline std::vector<T> *copyBuffer(const std::vector<T> *buffer)
+{
+	return buffer ? new std::vector<T>(*buffer) : NULL;
+}
+
 //------------------------------------------------------------------------------
 //
 // Constructors
@@ -131,8 +184,7 @@ repo::core::RepoNodeMesh::RepoNodeMesh(
 	// Material (always only one per mesh)
 	if (mesh->mMaterialIndex < materials.size())
 	{
-		this->addChild(materials[mesh->mMaterialIndex]);
-		materials[mesh->mMaterialIndex]->addParent(this);
+		link(this, materials[mesh->mMaterialIndex]);
 	}
 
     //std::cerr << getVertexHash() << std::endl;
@@ -141,7 +193,7 @@ repo::core::RepoNodeMesh::RepoNodeMesh(
 //------------------------------------------------------------------------------
 
 repo::core::RepoNodeMesh::RepoNodeMesh(
-	const mongo::BSONObj &obj) : RepoNodeAbstract(obj),
+	const mongo::BSONObj &obj) : RepoNodeAbstract(obj, TypeTag),
 		vertices(NULL),
 		faces(NULL),
 		normals(NULL),
@@ -256,6 +308,27 @@ repo::core::RepoNodeMesh::RepoNodeMesh(
 	}
 }
 
+//------------------------------------------------------------------------------
+
+repo::core::RepoNodeMesh::RepoNodeMesh(const RepoNodeMesh &other)
+	: RepoNodeAbstract(other),
+		vertexHash(other.vertexHash),
+		vertices(other.vertices),
+		faces(other.faces),
+		normals(other.normals),
+		outline(other.outline),
+		boundingBox(other.boundingBox),
+		pca(other.pca),
+		uvChannels(other.uvChannels),
+		colors(other.colors)
+{
+	// Only the other mesh may hand its buffers to an owner, see shareBuffers()
+	if (other.buffers)
+		buffers = other.buffers;
+	else
+		copyBuffers();
+}
+
 //------------------------------------------------------------------------------
 //
 // Destructor
@@ -263,6 +336,10 @@ repo::core::RepoNodeMesh::RepoNodeMesh(
 //------------------------------------------------------------------------------
 repo::core::RepoNodeMesh::~RepoNodeMesh()
 {
+	// Shared buffers are deallocated by their owner
+	if (buffers)
+		return;
+
 	if (NULL != vertices)
 	{
 		vertices->clear();
@@ -620,7 +697,7 @@ void repo::core::RepoNodeMesh::toAssimp(
 	// If multiple children materials are found, takes the first one
 	std::map<const RepoNodeAbstract *, unsigned int>::const_iterator it;
 
-    std::set<const RepoNodeAbstract *>::iterator childrenIt;
+    std::vector<const RepoNodeAbstract *>::const_iterator childrenIt;
     for (childrenIt = children.begin(); childrenIt != children.end(); ++childrenIt)
     {
 		it = materialMapping.find(*childrenIt);
@@ -735,25 +812,261 @@ repo::core::RepoVertex
 	return centroid;
 }
 
+//------------------------------------------------------------------------------
+std::vector<aiVector3t<float> > repo::core::RepoNodeMesh::calculateNormals() const
+{
+	std::vector<aiVector3t<float> > vertexNormals;
+	if (NULL == vertices)
+		return vertexNormals;
+
+	vertexNormals.resize(vertices->size(), aiVector3t<float>(0, 0, 0));
+	if (NULL == faces)
+		return vertexNormals;
+
+	for (unsigned int f = 0; f < faces->size(); ++f)
+	{
+		const aiFace &face = (*faces)[f];
+		if (face.mNumIndices < 3)
+			continue;
+
+		// Newell's method, the length of the result is twice the face area
+		// which gives the area weighting for free.
+		aiVector3t<float> faceNormal(0, 0, 0);
+		for (unsigned int i = 0; i < face.mNumIndices; ++i)
+		{
+			const aiVector3t<float> &a = vertices->at(face.mIndices[i]);
+			const aiVector3t<float> &b = vertices->at(
+				face.mIndices[(i + 1) % face.mNumIndices]);
+			faceNormal.x += (a.y - b.y) * (a.z + b.z);
+			faceNormal.y += (a.z - b.z) * (a.x + b.x);
+			faceNormal.z += (a.x - b.x) * (a.y + b.y);
+		}
+
+		for (unsigned int i = 0; i < face.mNumIndices; ++i)
+			vertexNormals[face.mIndices[i]] += faceNormal;
+	}
+
+	for (unsigned int v = 0; v < vertexNormals.size(); ++v)
+		if (vertexNormals[v].SquareLength() > 0)
+			vertexNormals[v].Normalize();
+
+	return vertexNormals;
+}
+
+bool repo::core::RepoNodeMesh::isTriangulated() const
+{
+	return NULL == faces || RepoTriangulator::isTriangulated(*faces);
+}
+
+bool repo::core::RepoNodeMesh::triangulate()
+{
+	bool modified = false;
+	if (NULL != vertices && !isTriangulated())
+	{
+		std::vector<aiFace> *triangles = new std::vector<aiFace>(
+			RepoTriangulator::triangulate(*vertices, *faces));
+		detachBuffers();
+		delete faces;
+		faces = triangles;
+		modified = true;
+	}
+	return modified;
+}
+
+void repo::core::RepoNodeMesh::detachBuffers()
+{
+	if (!buffers)
+		return;
+
+	if (buffers.unique())
+		buffers->release();
+	else
+		copyBuffers();
+	buffers.reset();
+}
+
+void repo::core::RepoNodeMesh::shareBuffers()
+{
+	if (!buffers)
+		buffers.reset(new Buffers(this));
+}
+
+void repo::core::RepoNodeMesh::copyBuffers()
+{
+	vertices = copyBuffer(vertices);
+	faces = copyBuffer(faces);
+	normals = copyBuffer(normals);
+	outline = copyBuffer(outline);
+	colors = copyBuffer(colors);
+	if (NULL != uvChannels)
+	{
+		std::vector<std::vector<aiVector3t<float> > *> *channels =
+			new std::vector<std::vector<aiVector3t<float> > *>(
+				uvChannels->size());
+		for (size_t i = 0; i < uvChannels->size(); ++i)
+			(*channels)[i] = copyBuffer((*uvChannels)[i]);
+		uvChannels = channels;
+	}
+}
+
+void repo::core::RepoNodeMesh::releaseGeometry()
+{
+	if (buffers)
+		buffers.reset();
+	else
+	{
+		// Deallocates the buffers on leaving the scope
+		Buffers owner(this);
+	}
+	vertices = NULL;
+	faces = NULL;
+	normals = NULL;
+	outline = NULL;
+	uvChannels = NULL;
+	colors = NULL;
+	pca.releaseVertices();
+}
+
+void repo::core::RepoNodeMesh::takeGeometry(RepoNodeMesh &other)
+{
+	releaseGeometry();
+	other.detachBuffers();
+	std::swap(vertices, other.vertices);
+	std::swap(faces, other.faces);
+	std::swap(normals, other.normals);
+	std::swap(outline, other.outline);
+	std::swap(uvChannels, other.uvChannels);
+	std::swap(colors, other.colors);
+}
+
+void repo::core::RepoNodeMesh::addFootprint(
+	RepoMemoryFootprint &footprint) const
+{
+	RepoNodeAbstract::addFootprint(footprint);
+	footprint.nodes += sizeof(RepoNodeMesh) - sizeof(RepoNodeAbstract);
+	if (buffers)
+		footprint.nodes += sizeof(Buffers);
+	footprint.strings += RepoMemoryFootprint::getHeapSize(vertexHash);
+	footprint.indices += RepoMemoryFootprint::getHeapSize(instanceMatrices)
+		+ RepoMemoryFootprint::getHeapSize(instanceBoundingBoxes);
+	footprint.nodes += pca.getHeapSize() - pca.getVerticesHeapSize();
+	footprint.geometry += pca.getVerticesHeapSize();
+	if (vertices)
+		footprint.geometry += sizeof(*vertices)
+			+ RepoMemoryFootprint::getHeapSize(*vertices);
+	if (normals)
+		footprint.geometry += sizeof(*normals)
+			+ RepoMemoryFootprint::getHeapSize(*normals);
+	if (outline)
+		footprint.geometry += sizeof(*outline)
+			+ RepoMemoryFootprint::getHeapSize(*outline);
+	if (colors)
+		footprint.geometry += sizeof(*colors)
+			+ RepoMemoryFootprint::getHeapSize(*colors);
+	if (uvChannels)
+	{
+		footprint.geometry += sizeof(*uvChannels)
+			+ RepoMemoryFootprint::getHeapSize(*uvChannels);
+		for (const std::vector<aiVector3t<float> > *channel : *uvChannels)
+			if (channel)
+				footprint.geometry += sizeof(*channel)
+					+ RepoMemoryFootprint::getHeapSize(*channel);
+	}
+	if (faces)
+	{
+		footprint.topology += sizeof(*faces)
+			+ RepoMemoryFootprint::getHeapSize(*faces);
+		for (const aiFace &face : *faces)
+			footprint.topology += face.mNumIndices * sizeof(unsigned int);
+	}
+}
+
 aiMatrix4x4 repo::core::RepoNodeMesh::getTransformation() const
 {
-    return getTransformation(this);
+    return getWorldMatrix();
 }
 
 aiMatrix4x4 repo::core::RepoNodeMesh::getTransformation(
         const RepoNodeAbstract *node)
 {
     aiMatrix4x4 transformation;
-    for (const RepoNodeAbstract *parent : node->getParents())
+    for (const RepoNodeTransformation *transformationParent :
+         node->getParents<const RepoNodeTransformation*>())
     {
-        const RepoNodeTransformation *transformationParent = dynamic_cast<const RepoNodeTransformation*>(parent);
-        if (transformationParent)
+        transformation = transformationParent->getWorldMatrix();
+        break;
+    }
+    return transformation;
+}
+
+const aiMatrix4x4 &repo::core::RepoNodeMesh::getWorldMatrix() const
+{
+    if (worldDirty)
+        updateWorldMatrices();
+    return worldMatrix;
+}
+
+const repo::core::RepoBoundingBox &repo::core::RepoNodeMesh::getWorldBoundingBox() const
+{
+    if (worldDirty)
+        updateWorldMatrices();
+    return worldBoundingBox;
+}
+
+void repo::core::RepoNodeMesh::invalidateWorld() const
+{
+    if (!worldDirty && worldChanged)
+        *worldChanged = true;
+    RepoNodeAbstract::invalidateWorld();
+}
+
+size_t repo::core::RepoNodeMesh::getWorldMatrixCount() const
+{
+    if (worldDirty)
+        updateWorldMatrices();
+    return 1 + instanceMatrices.size();
+}
+
+const aiMatrix4x4 &repo::core::RepoNodeMesh::getWorldMatrix(
+        size_t instance) const
+{
+    if (worldDirty)
+        updateWorldMatrices();
+    return instance ? instanceMatrices[instance - 1] : worldMatrix;
+}
+
+const repo::core::RepoBoundingBox &repo::core::RepoNodeMesh::getWorldBoundingBox(
+        size_t instance) const
+{
+    if (worldDirty)
+        updateWorldMatrices();
+    return instance ? instanceBoundingBoxes[instance - 1] : worldBoundingBox;
+}
+
+void repo::core::RepoNodeMesh::updateWorldMatrices() const
+{
+    worldMatrix = aiMatrix4x4();
+    instanceMatrices.clear();
+    instanceBoundingBoxes.clear();
+    bool first = true;
+    for (const RepoNodeTransformation *parent :
+         getParents<const RepoNodeTransformation*>())
+    {
+        for (size_t i = 0; i < parent->getWorldMatrixCount(); ++i)
         {
-            transformation = getTransformation(transformationParent) * transformationParent->getMatrix();
-            break;
+            if (first)
+                worldMatrix = parent->getWorldMatrix(i);
+            else
+            {
+                instanceMatrices.push_back(parent->getWorldMatrix(i));
+                instanceBoundingBoxes.push_back(
+                    boundingBox.transform(instanceMatrices.back()));
+            }
+            first = false;
         }
     }
-    return transformation;
+    worldBoundingBox = boundingBox.transform(worldMatrix);
+    worldDirty = false;
 }
 
 aiMatrix4x4 repo::core::RepoNodeMesh::getBoundingBoxTransformation() const
@@ -81,6 +81,9 @@ class REPO_CORE_EXPORT RepoNodeMesh : public RepoNodeAbstract
 
 public :
 
+	//! Type tag of all nodes of this class.
+	static const RepoNodeTypeTag TypeTag = REPO_NODE_TAG_MESH;
+
     //--------------------------------------------------------------------------
 	//
 	// Constructors
@@ -130,6 +133,16 @@ public :
 	 */
 	RepoNodeMesh(const mongo::BSONObj & obj);
 
+	//! Copy constructor, buffers are shared until modified, edges are not.
+	/*!
+	 * Once shareBuffers() has been called on the other mesh, its vertices,
+	 * faces, normals, outline, UV channels and colors are shared by all
+	 * copies and released along with the last of them, otherwise they are
+	 * copied. A mesh modifying its buffers makes its own copy first. The
+	 * other mesh is only read, so copies can be made concurrently.
+	 */
+	RepoNodeMesh(const RepoNodeMesh &other);
+
     //--------------------------------------------------------------------------
     //
     // Destructors
@@ -137,6 +150,9 @@ public :
     //--------------------------------------------------------------------------
 
 	//! Destructor. Deallocates vertices, normals and faces vectors.
+	/*!
+	 * Buffers shared with copies are deallocated by the last of them.
+	 */
 	~RepoNodeMesh();
 
     //--------------------------------------------------------------------------
@@ -154,6 +170,13 @@ public :
 	//
     //--------------------------------------------------------------------------
 
+	//! Returns a copy without edges, see RepoNodeAbstract::clone().
+	RepoNodeAbstract *clone() const
+	{ return new RepoNodeMesh(*this); }
+
+	//! Adds memory held by this node, see RepoNodeAbstract::addFootprint().
+	void addFootprint(RepoMemoryFootprint &footprint) const;
+
 	//! BSONObj representation.
 	/*!
 	 * Returns a BSON representation of this repository object suitable for a
@@ -201,6 +224,10 @@ public :
         return tmp;
     }
 
+    //! Returns the number of texcoord channels.
+    size_t getUVChannelsCount() const
+    { return uvChannels ? uvChannels->size() : 0; }
+
     //! Returns outline of this mesh.
     const std::vector<aiVector2D> *getOutline() const
     { return outline; }
@@ -217,10 +244,49 @@ public :
 
     aiMatrix4x4 getBoundingBoxTransformation() const;
 
+    //! Returns the world matrix of this mesh, see getWorldMatrix().
     aiMatrix4x4 getTransformation() const;
 
+    //! Returns the world matrix of the first transformation parent.
     static aiMatrix4x4 getTransformation(const RepoNodeAbstract *node);
 
+    //! Returns the combined matrix of all transformation ancestors.
+    /*!
+     * Follows the first transformation parent, same as getWorldMatrix(0).
+     * Cached until an ancestor or the topology above this mesh changes.
+     */
+    const aiMatrix4x4 &getWorldMatrix() const;
+
+    //! Returns the bounding box of this mesh in world coordinates.
+    const RepoBoundingBox &getWorldBoundingBox() const;
+
+    //! Marks cached world data as stale and raises the attached flag.
+    void invalidateWorld() const;
+
+    //! Attaches a flag raised whenever the world data of this mesh goes stale.
+    /*!
+     * The flag is shared by all meshes of a scene so that the scene learns
+     * of moved meshes without visiting them, see RepoGraphScene::getBVH().
+     * Copies of the mesh do not inherit it.
+     */
+    void setWorldChangedFlag(const boost::shared_ptr<bool> &flag) const
+    { worldChanged = flag; }
+
+    //! Returns the number of instances of this mesh in the world.
+    /*!
+     * A mesh shared by several transformations, such as the geometry
+     * shared by RepoGraphOptimizer::collapseInstancedMeshes(), has one
+     * instance per path from the root, see
+     * RepoNodeTransformation::getWorldMatrix(size_t).
+     */
+    size_t getWorldMatrixCount() const;
+
+    //! Returns the world matrix of the given instance.
+    const aiMatrix4x4 &getWorldMatrix(size_t instance) const;
+
+    //! Returns the world bounding box of the given instance.
+    const RepoBoundingBox &getWorldBoundingBox(size_t instance) const;
+
     std::string getVertexHash();
 
 	//! Returns the area of a face identified by its index.
@@ -248,6 +314,47 @@ public :
 	//! Returns the centroid of a face.
 	RepoVertex getFaceCentroid(unsigned int index) const;
 
+	//! Returns area weighted per vertex normals calculated from the faces.
+	/*!
+	 * Used when the mesh does not carry its own normals. Each face normal is
+	 * computed with Newell's method so that polygons are supported as well.
+	 * Vertices not referenced by any non-degenerate face get a zero normal.
+	 */
+	std::vector<aiVector3t<float> > calculateNormals() const;
+
+    //! Returns true if all faces of this mesh are triangles.
+    bool isTriangulated() const;
+
+    //! Replaces polygonal faces by triangles, drops points and lines.
+    /*!
+     * Returns true if the faces had to be modified.
+     * \sa RepoTriangulator
+     */
+    bool triangulate();
+
+    //! Hands the buffers to a reference counted owner shared with copies.
+    /*!
+     * Has to be called before the mesh is copied from several threads, see
+     * RepoSceneSnapshots. Does nothing if the buffers are already shared.
+     */
+    void shareBuffers();
+
+    //! Deallocates all buffers and the vertices of the PCA, keeps the
+    //! bounding box, principal components and vertex hash.
+    /*!
+     * Leaves a skeleton of the mesh which can be given its geometry back
+     * with takeGeometry(). Copies sharing the buffers keep them.
+     * \sa RepoSceneManager
+     */
+    void releaseGeometry();
+
+    //! Replaces buffers of this mesh by those of the other mesh.
+    /*!
+     * The other mesh, typically decoded from the same BSON document, is left
+     * without geometry.
+     */
+    void takeGeometry(RepoNodeMesh &other);
+
     RepoPCA getPCA() const { return pca; }
 
     void setVertexHash(const std::string& hash)
@@ -302,6 +409,22 @@ protected :
 
 	RepoBoundingBox boundingBox; //!< Axis-aligned local coords bounding box.
 
+	mutable aiMatrix4x4 worldMatrix; //!< Cached result of getWorldMatrix().
+
+	mutable RepoBoundingBox worldBoundingBox; //!< Cached world coords bounding box.
+
+	//! Cached world matrices of the instances after the first, usually none.
+	mutable std::vector<aiMatrix4x4> instanceMatrices;
+
+	//! Cached world bounding boxes of the instances after the first.
+	mutable std::vector<RepoBoundingBox> instanceBoundingBoxes;
+
+	//! Recomputes the cached world matrices and bounding boxes.
+	void updateWorldMatrices() const;
+
+	//! Raised when the world data goes stale, see setWorldChangedFlag().
+	mutable boost::shared_ptr<bool> worldChanged;
+
     RepoPCA pca;
 
 	//! UV channels per vertex
@@ -314,6 +437,18 @@ protected :
     //! Vertex colors of this mesh.
     std::vector<aiColor4D>* colors;
 
+	//! Makes buffers shared with copies private to this mesh, see triangulate().
+	void detachBuffers();
+
+	//! Replaces the buffer pointers by pointers to copies of the buffers.
+	void copyBuffers();
+
+	//! Owner of the buffers shared with copies of this mesh.
+	struct Buffers;
+
+	//! Owns the buffers once shared with copies, empty until then.
+	boost::shared_ptr<Buffers> buffers;
+
 }; // end class
 
 
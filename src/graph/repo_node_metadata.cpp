@@ -127,7 +127,7 @@ repo::core::RepoNodeMetadata::RepoNodeMetadata(
 
 repo::core::RepoNodeMetadata::RepoNodeMetadata(
         const mongo::BSONObj &obj)
-    : RepoNodeAbstract(obj)
+    : RepoNodeAbstract(obj, TypeTag)
 {
     //--------------------------------------------------------------------------
     // Media type
@@ -192,3 +192,12 @@ std::string repo::core::RepoNodeMetadata::toString(std::string separator) const
     }
     return ret;
 }
+
+void repo::core::RepoNodeMetadata::addFootprint(
+    RepoMemoryFootprint &footprint) const
+{
+    RepoNodeAbstract::addFootprint(footprint);
+    footprint.nodes += sizeof(RepoNodeMetadata) - sizeof(RepoNodeAbstract);
+    footprint.metadata += metadata.objsize();
+    footprint.strings += RepoMemoryFootprint::getHeapSize(mime);
+}
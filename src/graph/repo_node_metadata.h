@@ -44,6 +44,9 @@ class REPO_CORE_EXPORT RepoNodeMetadata : public RepoNodeAbstract
 
 public :
 
+	//! Type tag of all nodes of this class.
+	static const RepoNodeTypeTag TypeTag = REPO_NODE_TAG_METADATA;
+
     //--------------------------------------------------------------------------
     //
     // Constructors
@@ -110,6 +113,13 @@ public :
     //! Returns metadata subobject.
     mongo::BSONObj getMetadata() const { return metadata; }
 
+    //! Returns a copy without edges, see RepoNodeAbstract::clone().
+    RepoNodeAbstract *clone() const
+    { return new RepoNodeMetadata(*this); }
+
+    //! Adds memory held by this node, see RepoNodeAbstract::addFootprint().
+    void addFootprint(RepoMemoryFootprint &footprint) const;
+
     //! BSONObj representation.
     /*!
      * Returns a BSON representation of this metadata object suitable for a
@@ -55,7 +55,7 @@ repo::core::RepoNodeReference::RepoNodeReference(
 
 repo::core::RepoNodeReference::RepoNodeReference(
         const mongo::BSONObj &obj)
-    : RepoNodeAbstract(obj)
+    : RepoNodeAbstract(obj, TypeTag)
     , revisionID(boost::uuids::uuid())
     , isUniqueID(false)
 {
@@ -135,3 +135,12 @@ mongo::BSONObj repo::core::RepoNodeReference::toBSONObj() const
 
     return builder.obj();
 }
+
+void repo::core::RepoNodeReference::addFootprint(
+    RepoMemoryFootprint &footprint) const
+{
+    RepoNodeAbstract::addFootprint(footprint);
+    footprint.nodes += sizeof(RepoNodeReference) - sizeof(RepoNodeAbstract);
+    footprint.strings += RepoMemoryFootprint::getHeapSize(project)
+        + RepoMemoryFootprint::getHeapSize(database);
+}
@@ -48,6 +48,9 @@ class REPO_CORE_EXPORT RepoNodeReference : public RepoNodeAbstract
 
 public :
 
+	//! Type tag of all nodes of this class.
+	static const RepoNodeTypeTag TypeTag = REPO_NODE_TAG_REFERENCE;
+
     //--------------------------------------------------------------------------
     //
     // Constructors
@@ -106,6 +109,13 @@ public :
     //
     //--------------------------------------------------------------------------
 
+    //! Returns a copy without edges, see RepoNodeAbstract::clone().
+    RepoNodeAbstract *clone() const
+    { return new RepoNodeReference(*this); }
+
+    //! Adds memory held by this node, see RepoNodeAbstract::addFootprint().
+    void addFootprint(RepoMemoryFootprint &footprint) const;
+
     //! BSONObj representation.
     /*!
      * Returns a BSON representation of this reference object suitable for a
@@ -0,0 +1,109 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "repo_node_registry.h"
+#include "repo_node_camera.h"
+#include "repo_node_material.h"
+#include "repo_node_mesh.h"
+#include "repo_node_metadata.h"
+#include "repo_node_reference.h"
+#include "repo_node_revision.h"
+#include "repo_node_texture.h"
+#include "repo_node_transformation.h"
+
+std::map<std::string, repo::core::RepoNodeRegistry::Entry> &
+	repo::core::RepoNodeRegistry::getEntries()
+{
+	// Initialisation of function statics is thread safe in C++11
+	static std::map<std::string, Entry> entries = []()
+	{
+		std::map<std::string, Entry> builtIn;
+		Entry entry;
+
+		entry.typeTag = RepoNodeTransformation::TypeTag;
+		entry.constructor = &construct<RepoNodeTransformation>;
+		builtIn[REPO_NODE_TYPE_TRANSFORMATION] = entry;
+
+		entry.typeTag = RepoNodeMesh::TypeTag;
+		entry.constructor = &construct<RepoNodeMesh>;
+		builtIn[REPO_NODE_TYPE_MESH] = entry;
+
+		entry.typeTag = RepoNodeMaterial::TypeTag;
+		entry.constructor = &construct<RepoNodeMaterial>;
+		builtIn[REPO_NODE_TYPE_MATERIAL] = entry;
+
+		entry.typeTag = RepoNodeTexture::TypeTag;
+		entry.constructor = &construct<RepoNodeTexture>;
+		builtIn[REPO_NODE_TYPE_TEXTURE] = entry;
+
+		entry.typeTag = RepoNodeCamera::TypeTag;
+		entry.constructor = &construct<RepoNodeCamera>;
+		builtIn[REPO_NODE_TYPE_CAMERA] = entry;
+
+		entry.typeTag = RepoNodeReference::TypeTag;
+		entry.constructor = &construct<RepoNodeReference>;
+		builtIn[REPO_NODE_TYPE_REFERENCE] = entry;
+
+		entry.typeTag = RepoNodeMetadata::TypeTag;
+		entry.constructor = &construct<RepoNodeMetadata>;
+		builtIn[REPO_NODE_TYPE_METADATA] = entry;
+
+		entry.typeTag = RepoNodeRevision::TypeTag;
+		entry.constructor = &construct<RepoNodeRevision>;
+		builtIn[REPO_NODE_TYPE_REVISION] = entry;
+
+		return builtIn;
+	}();
+	return entries;
+}
+
+void repo::core::RepoNodeRegistry::registerType(
+	const std::string &type,
+	RepoNodeTypeTag typeTag,
+	RepoNodeConstructor constructor)
+{
+	Entry entry;
+	entry.typeTag = typeTag;
+	entry.constructor = constructor;
+	getEntries()[type] = entry;
+}
+
+repo::core::RepoNodeAbstract *repo::core::RepoNodeRegistry::create(
+	const mongo::BSONObj &obj,
+	RepoNodeArena *arena)
+{
+	std::map<std::string, Entry> &entries = getEntries();
+	std::map<std::string, Entry>::const_iterator it =
+		entries.find(obj.getField(REPO_NODE_LABEL_TYPE).str());
+	return entries.end() != it && it->second.constructor
+		? it->second.constructor(obj, arena)
+		: NULL;
+}
+
+repo::core::RepoNodeTypeTag repo::core::RepoNodeRegistry::getTypeTag(
+	const std::string &type)
+{
+	std::map<std::string, Entry> &entries = getEntries();
+	std::map<std::string, Entry>::const_iterator it = entries.find(type);
+	return entries.end() != it ? it->second.typeTag : REPO_NODE_TAG_UNKNOWN;
+}
+
+repo::core::RepoNodeTypeTag repo::core::RepoNodeRegistry::getTypeTag(
+	const mongo::BSONObj &obj)
+{
+	return getTypeTag(obj.getField(REPO_NODE_LABEL_TYPE).str());
+}
@@ -0,0 +1,91 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_NODE_REGISTRY_H
+#define REPO_NODE_REGISTRY_H
+
+//------------------------------------------------------------------------------
+#include <map>
+#include <string>
+//------------------------------------------------------------------------------
+#include <mongo/client/dbclient.h> // the MongoDB driver
+//------------------------------------------------------------------------------
+#include "repo_node_abstract.h"
+#include "repo_node_arena.h"
+#include "../repocoreglobal.h"
+
+namespace repo {
+namespace core {
+
+//! Function constructing a node from BSON, in the arena if not NULL.
+typedef RepoNodeAbstract *(*RepoNodeConstructor)(
+	const mongo::BSONObj &obj,
+	RepoNodeArena *arena);
+
+//! Static registry of node constructors keyed by the BSON 'type' field.
+/*!
+ * All node classes of the library are registered on first use. Further
+ * types can be registered, or the built-in ones replaced, before any
+ * decoding starts; lookups are safe from multiple threads, registration is
+ * not.
+ */
+class REPO_CORE_EXPORT RepoNodeRegistry
+{
+
+public :
+
+	//! Registers the constructor and tag of nodes of the given type.
+	static void registerType(
+		const std::string &type,
+		RepoNodeTypeTag typeTag,
+		RepoNodeConstructor constructor);
+
+	//! Returns a new node decoded from BSON, NULL if of unregistered type.
+	static RepoNodeAbstract *create(
+		const mongo::BSONObj &obj,
+		RepoNodeArena *arena = NULL);
+
+	//! Returns the tag of the type, REPO_NODE_TAG_UNKNOWN if not registered.
+	static RepoNodeTypeTag getTypeTag(const std::string &type);
+
+	//! Returns the tag of the BSON 'type' field.
+	static RepoNodeTypeTag getTypeTag(const mongo::BSONObj &obj);
+
+	//! Constructor of class T suitable for registerType().
+	template <class T>
+	static RepoNodeAbstract *construct(
+		const mongo::BSONObj &obj,
+		RepoNodeArena *arena)
+	{ return arena ? arena->create<T>(obj) : new T(obj); }
+
+private :
+
+	struct Entry
+	{
+		RepoNodeTypeTag typeTag;
+		RepoNodeConstructor constructor;
+	};
+
+	//! Returns the registry, populated with the built-in types on first use.
+	static std::map<std::string, Entry> &getEntries();
+
+}; // end class
+
+} // end namespace core
+} // end namespace repo
+
+#endif // end REPO_NODE_REGISTRY_H
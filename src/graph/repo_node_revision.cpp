@@ -36,7 +36,7 @@ boost::uuids::uuid repo::core::RepoNodeRevision::REPO_NODE_UUID_BRANCH_MASTER =
 //
 //------------------------------------------------------------------------------
 repo::core::RepoNodeRevision::RepoNodeRevision(const mongo::BSONObj & obj)
-	: RepoNodeAbstract(obj) 
+	: RepoNodeAbstract(obj, TypeTag) 
 {
     //--------------------------------------------------------------------------
 	// Author
@@ -204,3 +204,18 @@ void repo::core::RepoNodeRevision::setCurrentUniqueIDs(const RepoNodeAbstractSet
     for (RepoNodeAbstract *node : nodes)
         currentUniqueIDs.insert(node->getUniqueID());
 }
+
+void repo::core::RepoNodeRevision::addFootprint(
+    RepoMemoryFootprint &footprint) const
+{
+    RepoNodeAbstract::addFootprint(footprint);
+    footprint.nodes += sizeof(RepoNodeRevision) - sizeof(RepoNodeAbstract);
+    footprint.strings += RepoMemoryFootprint::getHeapSize(author)
+        + RepoMemoryFootprint::getHeapSize(message)
+        + RepoMemoryFootprint::getHeapSize(tag);
+    footprint.indices += RepoMemoryFootprint::getHeapSize(currentUniqueIDs)
+        + RepoMemoryFootprint::getHeapSize(addedSharedIDs)
+        + RepoMemoryFootprint::getHeapSize(deletedSharedIDs)
+        + RepoMemoryFootprint::getHeapSize(modifiedSharedIDs)
+        + RepoMemoryFootprint::getHeapSize(unmodifiedSharedIDs);
+}
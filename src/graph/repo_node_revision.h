@@ -58,6 +58,9 @@ class REPO_CORE_EXPORT RepoNodeRevision : public RepoNodeAbstract
 
 public :
 
+	//! Type tag of all nodes of this class.
+	static const RepoNodeTypeTag TypeTag = REPO_NODE_TAG_REVISION;
+
     //--------------------------------------------------------------------------
 	//
 	// Constructors
@@ -120,6 +123,13 @@ public :
 	//
     //--------------------------------------------------------------------------
 
+	//! Returns a copy without edges, see RepoNodeAbstract::clone().
+	RepoNodeAbstract *clone() const
+	{ return new RepoNodeRevision(*this); }
+
+	//! Adds memory held by this node, see RepoNodeAbstract::addFootprint().
+	void addFootprint(RepoMemoryFootprint &footprint) const;
+
 	//! BSONObj representation.
 	/*!
 	 * Returns a BSON representation of this revision object suitable for a
@@ -54,7 +54,7 @@ repo::core::RepoNodeTexture::RepoNodeTexture(
 //------------------------------------------------------------------------------
 
 repo::core::RepoNodeTexture::RepoNodeTexture(const mongo::BSONObj &obj)
-    : RepoNodeAbstract(obj)
+    : RepoNodeAbstract(obj, TypeTag)
     , data(NULL)
 {
 	//
@@ -99,6 +99,23 @@ repo::core::RepoNodeTexture::RepoNodeTexture(const mongo::BSONObj &obj)
 	}	
 }
 
+//------------------------------------------------------------------------------
+
+repo::core::RepoNodeTexture::RepoNodeTexture(const RepoNodeTexture &other)
+    : RepoNodeAbstract(other)
+    , width(other.width)
+    , height(other.height)
+    , extension(other.extension)
+    , data(other.data)
+{
+	// Pixel data are never modified once loaded, hence they are shared
+	// once the other texture has handed them to an owner, see shareData()
+	if (other.sharedData)
+		sharedData = other.sharedData;
+	else if (NULL != data)
+		data = new std::vector<char>(*data);
+}
+
 //------------------------------------------------------------------------------
 //
 // Destructor
@@ -106,7 +123,8 @@ repo::core::RepoNodeTexture::RepoNodeTexture(const mongo::BSONObj &obj)
 //------------------------------------------------------------------------------
 repo::core::RepoNodeTexture::~RepoNodeTexture() 
 {
-	if (NULL != data)
+	// Shared data are released along with the last texture using them
+	if (NULL != data && !sharedData)
 	{
 		data->clear();
 		delete data;
@@ -179,3 +197,20 @@ mongo::BSONObj repo::core::RepoNodeTexture::toBSONObj() const
 
 	return builder.obj();
 }
+
+void repo::core::RepoNodeTexture::shareData()
+{
+	if (NULL != data && !sharedData)
+		sharedData.reset(data);
+}
+
+void repo::core::RepoNodeTexture::addFootprint(
+	RepoMemoryFootprint &footprint) const
+{
+	RepoNodeAbstract::addFootprint(footprint);
+	footprint.nodes += sizeof(RepoNodeTexture) - sizeof(RepoNodeAbstract);
+	footprint.strings += RepoMemoryFootprint::getHeapSize(extension);
+	if (data)
+		footprint.textures += sizeof(std::vector<char>)
+			+ RepoMemoryFootprint::getHeapSize(*data);
+}
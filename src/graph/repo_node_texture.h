@@ -45,6 +45,9 @@ class REPO_CORE_EXPORT RepoNodeTexture : public RepoNodeAbstract
 
 public :
 
+	//! Type tag of all nodes of this class.
+	static const RepoNodeTypeTag TypeTag = REPO_NODE_TAG_TEXTURE;
+
     //--------------------------------------------------------------------------
 	//
 	// Constructors
@@ -54,7 +57,8 @@ public :
 	inline RepoNodeTexture() : 
 		RepoNodeAbstract(
 			REPO_NODE_TYPE_TEXTURE, 
-            REPO_NODE_API_LEVEL_1) {}
+            REPO_NODE_API_LEVEL_1),
+        data(NULL) {}
 
 	RepoNodeTexture(
         const std::string &name,
@@ -67,6 +71,13 @@ public :
 
 	RepoNodeTexture(const mongo::BSONObj &obj);
 
+	//! Copy constructor, edges are not copied.
+	/*!
+	 * Pixel data are shared once shareData() has been called on the other
+	 * texture, otherwise they are copied. The other texture is only read.
+	 */
+	RepoNodeTexture(const RepoNodeTexture &other);
+
     //--------------------------------------------------------------------------
 	//
 	// Destructor
@@ -93,6 +104,16 @@ public :
     //--------------------------------------------------------------------------
 
 
+	//! Returns a copy without edges, see RepoNodeAbstract::clone().
+	RepoNodeAbstract *clone() const
+	{ return new RepoNodeTexture(*this); }
+
+	//! Hands the pixel data to a reference counted owner shared with copies.
+	void shareData();
+
+	//! Adds memory held by this node, see RepoNodeAbstract::addFootprint().
+	void addFootprint(RepoMemoryFootprint &footprint) const;
+
 	//! BSONObj representation.
 	/*!
 	 * Returns a BSON representation of this repository object suitable for a
@@ -133,6 +154,9 @@ protected :
 
 	std::vector<char> * data; //!< copy of the pixel data
 
+	//! Owns the pixel data once shared with copies, empty until then.
+	boost::shared_ptr<std::vector<char> > sharedData;
+
 }; // end class
 
 } // end namespace core
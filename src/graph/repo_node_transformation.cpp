@@ -51,15 +51,14 @@ repo::core::RepoNodeTransformation::RepoNodeTransformation(
 	transformations.push_back(this);
 
     //--------------------------------------------------------------------------
-	// Register meshes as children of this transformation if any
+	// Register meshes as children of this transformation if any, instanced
+	// meshes are linked to a great many transformations
+	std::set<unsigned int> meshIndices;
 	for (unsigned int i = 0; i < node->mNumMeshes; ++i)
 	{
 		unsigned int meshIndex = node->mMeshes[i];
-		if (meshIndex < meshes.size())
-		{
-			this->addChild(meshes[meshIndex]);
-			meshes[meshIndex]->addParent(this);
-		}
+		if (meshIndex < meshes.size() && meshIndices.insert(meshIndex).second)
+			link(this, meshes[meshIndex]);
 	}
 
     //--------------------------------------------------------------------------
@@ -68,8 +67,7 @@ repo::core::RepoNodeTransformation::RepoNodeTransformation(
             cameras.find(node->mName.data);
 	if (cameras.end() != it)
 	{
-		this->addChild(it->second);
-		it->second->addParent(this);
+		link(this, it->second);
 	}
 
 	//--------------------------------------------------------------------------
@@ -81,8 +79,7 @@ repo::core::RepoNodeTransformation::RepoNodeTransformation(
             metadataName = "<metadata>";
 		repo::core::RepoNodeMetadata *metachild =
             new RepoNodeMetadata(node->mMetaData, metadataName);
-		this->addChild(metachild);
-		metachild->addParent(this);
+		link(this, metachild);
 		metadata.push_back(metachild);
 	}
 
@@ -98,14 +95,13 @@ repo::core::RepoNodeTransformation::RepoNodeTransformation(
 				cameras,
 				transformations,
 				metadata);
-		this->addChild(child);
-		child->addParent(this);
+		link(this, child);
 	}
 }
 
 repo::core::RepoNodeTransformation::RepoNodeTransformation(
 	const mongo::BSONObj &obj) :
-		RepoNodeAbstract(obj)
+		RepoNodeAbstract(obj, TypeTag)
 {
 	if (obj.hasField(REPO_NODE_LABEL_MATRIX))
 	{
@@ -182,6 +178,49 @@ bool repo::core::RepoNodeTransformation::operator==(const RepoNodeAbstract& othe
 //
 // Export
 //
+//------------------------------------------------------------------------------
+const aiMatrix4x4 &repo::core::RepoNodeTransformation::getWorldMatrix() const
+{
+	if (worldDirty)
+		updateWorldMatrices();
+	return worldMatrix;
+}
+
+size_t repo::core::RepoNodeTransformation::getWorldMatrixCount() const
+{
+	if (worldDirty)
+		updateWorldMatrices();
+	return 1 + instanceMatrices.size();
+}
+
+const aiMatrix4x4 &repo::core::RepoNodeTransformation::getWorldMatrix(
+	size_t instance) const
+{
+	if (worldDirty)
+		updateWorldMatrices();
+	return instance ? instanceMatrices[instance - 1] : worldMatrix;
+}
+
+void repo::core::RepoNodeTransformation::updateWorldMatrices() const
+{
+	worldMatrix = matrix;
+	instanceMatrices.clear();
+	bool first = true;
+	for (const RepoNodeTransformation *parent :
+		getParents<const RepoNodeTransformation*>())
+	{
+		for (size_t i = 0; i < parent->getWorldMatrixCount(); ++i)
+		{
+			if (first)
+				worldMatrix = parent->getWorldMatrix(i) * matrix;
+			else
+				instanceMatrices.push_back(parent->getWorldMatrix(i) * matrix);
+			first = false;
+		}
+	}
+	worldDirty = false;
+}
+
 //------------------------------------------------------------------------------
 mongo::BSONObj repo::core::RepoNodeTransformation::toBSONObj() const
 {
@@ -232,7 +271,7 @@ void repo::core::RepoNodeTransformation::toAssimp(
 	// Indices into the mesh array
 	std::vector<unsigned int> meshArrayIndices;
 
-    std::set<const RepoNodeAbstract *>::iterator childrenIt;
+    std::vector<const RepoNodeAbstract *>::const_iterator childrenIt;
     for (childrenIt = children.begin(); childrenIt != children.end(); ++childrenIt)
     {
         const RepoNodeAbstract *child = *childrenIt;
@@ -275,7 +314,7 @@ void repo::core::RepoNodeTransformation::toAssimp(
 		std::map<const RepoNodeAbstract *, aiNode *>::const_iterator it;
 		std::vector<aiNode *> childrenNodes;
 
-        std::set<const RepoNodeAbstract *>::iterator childrenIt;
+        std::vector<const RepoNodeAbstract *>::const_iterator childrenIt;
         for (childrenIt = children.begin(); childrenIt != children.end(); ++childrenIt)
         {
             const RepoNodeAbstract *child = *childrenIt;
@@ -288,7 +327,7 @@ void repo::core::RepoNodeTransformation::toAssimp(
 				// parents and children information to the Assimp tree hierarchy
 				// of aiNodes
                 const RepoNodeTransformation *childTransf =
-					 dynamic_cast<const RepoNodeTransformation *>(child);
+					 castNode<const RepoNodeTransformation *>(child);
 				if (childTransf)
 					childTransf->toAssimp(nodesMapping, thisNode);
 			}
@@ -49,6 +49,9 @@ class REPO_CORE_EXPORT RepoNodeTransformation : public RepoNodeAbstract
 
 public :
 
+	//! Type tag of all nodes of this class.
+	static const RepoNodeTypeTag TypeTag = REPO_NODE_TAG_TRANSFORMATION;
+
     //--------------------------------------------------------------------------
 	//
 	// Constructors
@@ -132,6 +135,29 @@ public :
 
     aiMatrix4x4 getMatrix() const { return matrix; }
 
+    //! Returns the matrix of this node premultiplied by all its ancestors.
+    /*!
+     * Follows the first transformation parent at each level, same as
+     * getWorldMatrix(0). The result is cached until this node or any of its
+     * ancestors changes, hence it is not safe to call concurrently on a
+     * stale node.
+     */
+    const aiMatrix4x4 &getWorldMatrix() const;
+
+    //! Returns the number of paths from the root through transformations.
+    /*!
+     * Each path places the node at a world matrix of its own, such as when
+     * a transformation is shared by several parents.
+     */
+    size_t getWorldMatrixCount() const;
+
+    //! Returns the world matrix of the node along the given path.
+    /*!
+     * Paths are ordered by the transformation parents and then by the paths
+     * of each parent.
+     */
+    const aiMatrix4x4 &getWorldMatrix(size_t instance) const;
+
     //--------------------------------------------------------------------------
 	//
 	// Export
@@ -139,7 +165,20 @@ public :
     //--------------------------------------------------------------------------
 
 	//! Sets the transformation matrix.
-    void setMatrix(aiMatrix4x4 matrix) { this->matrix = matrix; }
+    void setMatrix(aiMatrix4x4 matrix)
+    { this->matrix = matrix; invalidateWorld(); }
+
+	//! Returns a copy without edges, see RepoNodeAbstract::clone().
+	RepoNodeAbstract *clone() const
+	{ return new RepoNodeTransformation(*this); }
+
+	//! Adds memory held by this node, see RepoNodeAbstract::addFootprint().
+	void addFootprint(RepoMemoryFootprint &footprint) const
+	{
+		RepoNodeAbstract::addFootprint(footprint);
+		footprint.nodes += sizeof(RepoNodeTransformation) - sizeof(RepoNodeAbstract);
+		footprint.indices += RepoMemoryFootprint::getHeapSize(instanceMatrices);
+	}
 
 	//! BSONObj representation.
 	/*!
@@ -179,6 +218,14 @@ protected :
 
 	aiMatrix4x4 matrix; //!< transformation matrix
 
+	mutable aiMatrix4x4 worldMatrix; //!< cached result of getWorldMatrix()
+
+	//! Cached world matrices of the paths after the first one, usually none.
+	mutable std::vector<aiMatrix4x4> instanceMatrices;
+
+	//! Recomputes the cached world matrices.
+	void updateWorldMatrices() const;
+
 }; // end class
 
 } // end namespace core
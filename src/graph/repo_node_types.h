@@ -24,6 +24,7 @@
 //-----------------------------------------------------------------------------
 #define REPO_NODE_LABEL_NAME			"name" //!< optional bson field label
 #define REPO_NODE_LABEL_PARENTS			"parents" //!< optional field label
+#define REPO_NODE_LABEL_FINGERPRINT		"fingerprint" //!< content hash label
 //-----------------------------------------------------------------------------
 #define REPO_NODE_TYPE_ANIMATION		"animation"
 #define REPO_NODE_TYPE_BONE				"bone"
@@ -31,6 +32,7 @@
 #define REPO_NODE_TYPE_COMMENT			"comment"
 #define REPO_NODE_TYPE_LIGHT			"light"
 #define REPO_NODE_TYPE_LOCK				"lock"
+#define REPO_NODE_TYPE_MATERIAL			"material"
 #define REPO_NODE_TYPE_METADATA     	"meta"
 #define REPO_NODE_TYPE_REVISION			"revision"
 #define REPO_NODE_TYPE_SHADER			"shader"
@@ -0,0 +1,170 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "repo_path_index.h"
+#include "repo_node_abstract.h"
+
+//------------------------------------------------------------------------------
+// Bound to references by std::make_pair, hence it needs a definition
+const uint32_t repo::core::RepoPathIndex::NO_SEGMENT;
+
+//------------------------------------------------------------------------------
+//
+// Construction
+//
+//------------------------------------------------------------------------------
+
+repo::core::RepoPathIndex::RepoPathIndex(const RepoNodeAbstract *node)
+	: valid(true)
+{
+	add(node);
+}
+
+void repo::core::RepoPathIndex::add(const RepoNodeAbstract *node)
+{
+	if (!node || contains(node))
+		return;
+
+	//--------------------------------------------------------------------------
+	// Depth first towards the roots, a node is indexed once all of its
+	// parents are. Nodes on the stack are in the map with no segments yet.
+	std::vector<std::pair<const RepoNodeAbstract *, size_t> > stack;
+	stack.push_back(std::make_pair(node, 0));
+	ranges.insert(std::make_pair(node->getUniqueID(),
+		std::make_pair(NO_SEGMENT, 0u)));
+
+	while (!stack.empty())
+	{
+		const RepoNodeAbstract *current = stack.back().first;
+		const std::vector<const RepoNodeAbstract *> &parents =
+			current->getParents();
+		if (stack.back().second < parents.size())
+		{
+			const RepoNodeAbstract *parent = parents[stack.back().second++];
+			if (ranges.insert(std::make_pair(parent->getUniqueID(),
+				std::make_pair(NO_SEGMENT, 0u))).second)
+				stack.push_back(std::make_pair(parent, 0));
+		}
+		else
+		{
+			indexSegments(current);
+			stack.pop_back();
+		}
+	}
+}
+
+void repo::core::RepoPathIndex::indexSegments(const RepoNodeAbstract *node)
+{
+	uint32_t first = (uint32_t) segments.size();
+	const std::vector<const RepoNodeAbstract *> &parents = node->getParents();
+	if (parents.empty())
+	{
+		Segment segment = { node->getSharedID(), NO_SEGMENT, 0 };
+		segments.push_back(segment);
+	}
+	else
+	{
+		std::vector<const RepoNodeAbstract *>::const_iterator it;
+		for (it = parents.begin(); it != parents.end(); ++it)
+		{
+			// Parents on a cycle have no segments yet and are skipped
+			std::pair<uint32_t, uint32_t> range =
+				ranges.find((*it)->getUniqueID())->second;
+			for (uint32_t i = range.first; i < range.first + range.second; ++i)
+			{
+				Segment segment =
+					{ node->getSharedID(), i, segments[i].depth + 1 };
+				segments.push_back(segment);
+			}
+		}
+	}
+	ranges.find(node->getUniqueID())->second =
+		std::make_pair(first, (uint32_t) segments.size() - first);
+}
+
+void repo::core::RepoPathIndex::clear()
+{
+	segments.clear();
+	ranges.clear();
+	valid = true;
+}
+
+//------------------------------------------------------------------------------
+//
+// Getters
+//
+//------------------------------------------------------------------------------
+
+bool repo::core::RepoPathIndex::contains(const RepoNodeAbstract *node) const
+{
+	return ranges.end() != ranges.find(node->getUniqueID());
+}
+
+size_t repo::core::RepoPathIndex::getPathsCount(
+	const RepoNodeAbstract *node) const
+{
+	RepoUUIDMap<std::pair<uint32_t, uint32_t> >::const_iterator it =
+		ranges.find(node->getUniqueID());
+	return ranges.end() == it ? 0 : it->second.second;
+}
+
+std::vector<std::vector<boost::uuids::uuid> >
+	repo::core::RepoPathIndex::getPaths(const RepoNodeAbstract *node) const
+{
+	std::vector<std::vector<boost::uuids::uuid> > paths;
+	RepoUUIDMap<std::pair<uint32_t, uint32_t> >::const_iterator it =
+		ranges.find(node->getUniqueID());
+	if (ranges.end() != it)
+	{
+		paths.reserve(it->second.second);
+		for (uint32_t i = 0; i < it->second.second; ++i)
+			paths.push_back(getPath(it->second.first + i));
+	}
+	return paths;
+}
+
+std::vector<boost::uuids::uuid> repo::core::RepoPathIndex::getPath(
+	uint32_t segment) const
+{
+	std::vector<boost::uuids::uuid> path(segments[segment].depth + 1);
+	for (size_t i = path.size(); i-- > 0; segment = segments[segment].parent)
+		path[i] = segments[segment].sharedID;
+	return path;
+}
+
+//------------------------------------------------------------------------------
+//
+// Export
+//
+//------------------------------------------------------------------------------
+
+void repo::core::RepoPathIndex::appendPaths(
+	const std::string &label,
+	const RepoNodeAbstract *node,
+	mongo::BSONObjBuilder &builder) const
+{
+	RepoUUIDMap<std::pair<uint32_t, uint32_t> >::const_iterator it =
+		ranges.find(node->getUniqueID());
+	if (ranges.end() == it || 0 == it->second.second)
+		return;
+
+	mongo::BSONObjBuilder array;
+	for (uint32_t i = 0; i < it->second.second; ++i)
+		RepoTranscoderBSON::append(boost::lexical_cast<std::string>(i),
+			getPath(it->second.first + i), array);
+	builder.appendArray(label, array.obj());
+}
@@ -0,0 +1,148 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_PATH_INDEX_H
+#define REPO_PATH_INDEX_H
+
+//------------------------------------------------------------------------------
+#include <mongo/client/dbclient.h> // the MongoDB driver
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include <utility>
+#include <vector>
+//------------------------------------------------------------------------------
+#include <boost/uuid/uuid.hpp>
+//------------------------------------------------------------------------------
+#include "repo_uuid_map.h"
+#include "../repocoreglobal.h"
+
+namespace repo {
+namespace core {
+
+class RepoNodeAbstract;
+
+//! Paths from the roots to nodes of a graph computed once and shared.
+/*!
+ * Each path is stored as a single segment holding the shared ID of its last
+ * node and a pointer to the segment of the path of the parent it was
+ * extended from, hence paths with a common prefix share its storage. Nodes
+ * are visited once each, parents before children, and the paths of a node
+ * are the segments extending each path of each of its parents in order.
+ *
+ * Indices are invalidated by edge changes of any node attached to them,
+ * see RepoNodeAbstract::setPathIndex().
+ */
+class REPO_CORE_EXPORT RepoPathIndex
+{
+
+public :
+
+	//! Marks segments of root nodes which have no parent segment.
+	static const uint32_t NO_SEGMENT = 0xFFFFFFFF;
+
+	RepoPathIndex() : valid(true) {}
+
+	//! Indexes paths of the node and all of its ancestors.
+	explicit RepoPathIndex(const RepoNodeAbstract *node);
+
+	~RepoPathIndex() {}
+
+	//--------------------------------------------------------------------------
+	//
+	// Construction
+	//
+	//--------------------------------------------------------------------------
+
+	//! Indexes paths of the node and all of its ancestors not yet indexed.
+	void add(const RepoNodeAbstract *node);
+
+	//! Removes all paths and marks the index valid.
+	void clear();
+
+	//! Marks the index as out of date after the graph changed.
+	void invalidate() const { valid = false; }
+
+	//! Returns false if an attached node changed its edges since the build.
+	bool isValid() const { return valid; }
+
+	//--------------------------------------------------------------------------
+	//
+	// Getters
+	//
+	//--------------------------------------------------------------------------
+
+	//! Returns true if paths of the node are indexed.
+	bool contains(const RepoNodeAbstract *node) const;
+
+	//! Returns the number of paths leading to the node, 0 if not indexed.
+	size_t getPathsCount(const RepoNodeAbstract *node) const;
+
+	//! Returns shared IDs along all paths from a root to the node.
+	std::vector<std::vector<boost::uuids::uuid> > getPaths(
+		const RepoNodeAbstract *node) const;
+
+	//! Returns shared IDs along the path ending with the given segment.
+	std::vector<boost::uuids::uuid> getPath(uint32_t segment) const;
+
+	//! Returns the total number of segments, i.e. paths of all nodes.
+	size_t getSegmentsCount() const { return segments.size(); }
+
+	//! Returns bytes of heap memory held by the segments and their ranges.
+	size_t getHeapSize() const
+	{ return segments.capacity() * sizeof(Segment) + ranges.getHeapSize(); }
+
+	//--------------------------------------------------------------------------
+	//
+	// Export
+	//
+	//--------------------------------------------------------------------------
+
+	//! Appends paths of the node as an array of arrays of shared IDs.
+	/*!
+	 * Nothing is appended if the node is not indexed.
+	 */
+	void appendPaths(
+		const std::string &label,
+		const RepoNodeAbstract *node,
+		mongo::BSONObjBuilder &builder) const;
+
+private :
+
+	//! Last node of a path linked to the path of its parent.
+	struct Segment
+	{
+		boost::uuids::uuid sharedID;
+		uint32_t parent;
+		uint32_t depth;
+	};
+
+	//! Appends segments of the node, its parents have to be indexed.
+	void indexSegments(const RepoNodeAbstract *node);
+
+	std::vector<Segment> segments;
+
+	//! First segment and number of segments of each node by unique ID.
+	RepoUUIDMap<std::pair<uint32_t, uint32_t> > ranges;
+
+	mutable bool valid;
+
+}; // end class
+
+} // end namespace core
+} // end namespace repo
+
+#endif // end REPO_PATH_INDEX_H
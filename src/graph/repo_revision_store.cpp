@@ -0,0 +1,195 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "repo_revision_store.h"
+
+#include <algorithm>
+#include <iterator>
+
+//------------------------------------------------------------------------------
+
+repo::core::RepoRevisionStore::RepoRevisionStore(
+	unsigned int interval,
+	double change)
+	: interval(std::max(1u, interval))
+	, change(change)
+{}
+
+//------------------------------------------------------------------------------
+//
+// Revisions
+//
+//------------------------------------------------------------------------------
+
+bool repo::core::RepoRevisionStore::add(
+	const RepoNodeRevision &revision,
+	const boost::uuids::uuid &parent)
+{
+	return add(revision.getUniqueID(), parent,
+		revision.getCurrentUniqueIDs());
+}
+
+bool repo::core::RepoRevisionStore::add(
+	const boost::uuids::uuid &revision,
+	const boost::uuids::uuid &parent,
+	const std::set<boost::uuids::uuid> &currentUniqueIDs)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	if (entries.count(revision))
+		return false;
+
+	std::vector<boost::uuids::uuid> current(
+		currentUniqueIDs.begin(), currentUniqueIDs.end());
+	Entry entry;
+	entry.parent = boost::uuids::uuid();
+	entry.depth = 0;
+	entry.changes = 0;
+	entry.snapshotSize = current.size();
+
+	//--------------------------------------------------------------------------
+	// Delta against the parent unless the chain is too long or changed too much
+	std::map<boost::uuids::uuid, Entry>::const_iterator it =
+		entries.find(parent);
+	if (entries.end() != it && it->second.depth + 1 < interval)
+	{
+		std::vector<boost::uuids::uuid> previous;
+		materialise(it->second, previous);
+
+		std::vector<boost::uuids::uuid> added, removed;
+		std::set_difference(current.begin(), current.end(),
+			previous.begin(), previous.end(), std::back_inserter(added));
+		std::set_difference(previous.begin(), previous.end(),
+			current.begin(), current.end(), std::back_inserter(removed));
+
+		size_t changes = it->second.changes + added.size() + removed.size();
+		if (changes <= change * it->second.snapshotSize)
+		{
+			entry.parent = parent;
+			entry.depth = it->second.depth + 1;
+			entry.changes = changes;
+			entry.snapshotSize = it->second.snapshotSize;
+			current.swap(added);
+			entry.removed.swap(removed);
+		}
+	}
+
+	if (0 == entry.depth)
+		++statistics.snapshots;
+	else
+		++statistics.deltas;
+	entry.added.swap(current);
+	std::swap(entries[revision], entry);
+	return true;
+}
+
+bool repo::core::RepoRevisionStore::checkout(
+	const boost::uuids::uuid &revision,
+	std::set<boost::uuids::uuid> &currentUniqueIDs)
+{
+	std::vector<boost::uuids::uuid> uniqueIDs;
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		std::map<boost::uuids::uuid, Entry>::const_iterator it =
+			entries.find(revision);
+		if (entries.end() == it)
+			return false;
+		++statistics.checkouts;
+		statistics.replayedDeltas += materialise(it->second, uniqueIDs);
+	}
+	// Sorted input is inserted in linear time
+	currentUniqueIDs = std::set<boost::uuids::uuid>(
+		uniqueIDs.begin(), uniqueIDs.end());
+	return true;
+}
+
+bool repo::core::RepoRevisionStore::contains(
+	const boost::uuids::uuid &revision) const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return entries.count(revision) > 0;
+}
+
+void repo::core::RepoRevisionStore::clear()
+{
+	boost::mutex::scoped_lock lock(mutex);
+	entries.clear();
+}
+
+//------------------------------------------------------------------------------
+//
+// Getters
+//
+//------------------------------------------------------------------------------
+
+size_t repo::core::RepoRevisionStore::size() const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return entries.size();
+}
+
+unsigned long long repo::core::RepoRevisionStore::getHeapSize() const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	unsigned long long bytes = 0;
+	std::map<boost::uuids::uuid, Entry>::const_iterator it;
+	for (it = entries.begin(); it != entries.end(); ++it)
+		bytes += sizeof(*it)
+			+ (it->second.added.capacity() + it->second.removed.capacity())
+			* sizeof(boost::uuids::uuid);
+	return bytes;
+}
+
+repo::core::RepoRevisionStoreStatistics
+	repo::core::RepoRevisionStore::getStatistics() const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return statistics;
+}
+
+//------------------------------------------------------------------------------
+//
+// Private
+//
+//------------------------------------------------------------------------------
+
+unsigned int repo::core::RepoRevisionStore::materialise(
+	const Entry &entry,
+	std::vector<boost::uuids::uuid> &uniqueIDs) const
+{
+	//--------------------------------------------------------------------------
+	// Deltas back to the snapshot, then replayed in order
+	std::vector<const Entry *> chain(1, &entry);
+	while (chain.back()->depth > 0)
+		chain.push_back(&entries.find(chain.back()->parent)->second);
+
+	uniqueIDs = chain.back()->added;
+	std::vector<boost::uuids::uuid> remaining, next;
+	for (size_t i = chain.size() - 1; i-- > 0;)
+	{
+		const Entry *delta = chain[i];
+		remaining.clear();
+		std::set_difference(uniqueIDs.begin(), uniqueIDs.end(),
+			delta->removed.begin(), delta->removed.end(),
+			std::back_inserter(remaining));
+		next.clear();
+		std::set_union(remaining.begin(), remaining.end(),
+			delta->added.begin(), delta->added.end(),
+			std::back_inserter(next));
+		uniqueIDs.swap(next);
+	}
+	return static_cast<unsigned int>(chain.size() - 1);
+}
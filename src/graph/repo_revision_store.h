@@ -0,0 +1,189 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_REVISION_STORE_H
+#define REPO_REVISION_STORE_H
+
+//------------------------------------------------------------------------------
+#include <map>
+#include <set>
+#include <vector>
+//------------------------------------------------------------------------------
+#include <boost/thread/mutex.hpp>
+#include <boost/uuid/uuid.hpp>
+//------------------------------------------------------------------------------
+#include "repo_node_revision.h"
+#include "../repocoreglobal.h"
+
+//! Default maximum number of deltas replayed on top of a snapshot.
+#define REPO_REVISION_STORE_INTERVAL 16
+
+//! Default fraction of a snapshot changed by its deltas that forces a new one.
+#define REPO_REVISION_STORE_CHANGE 0.25
+
+namespace repo {
+namespace core {
+
+//! Work done by RepoRevisionStore since its construction.
+struct REPO_CORE_EXPORT RepoRevisionStoreStatistics
+{
+	unsigned long long snapshots; //!< Revisions stored in full
+	unsigned long long deltas; //!< Revisions stored as changes to their parent
+	unsigned long long checkouts; //!< Revisions materialised
+	unsigned long long replayedDeltas; //!< Deltas applied by the checkouts
+
+	RepoRevisionStoreStatistics()
+		: snapshots(0)
+		, deltas(0)
+		, checkouts(0)
+		, replayedDeltas(0) {}
+};
+
+//! Unique IDs of the nodes of revisions kept as snapshots and deltas.
+/*!
+ * Revisions are added parent first. A revision is stored as a delta, the
+ * unique IDs added and removed since its parent, unless it is the first of
+ * its history, its parent is unknown, it is the interval-th delta in a row,
+ * or the deltas since the last snapshot together changed more than the
+ * given fraction of it. It is then stored in full as a snapshot.
+ *
+ * Checkout of any revision replays at most interval - 1 deltas on top of
+ * its snapshot, their total size bounded by the change fraction, hence the
+ * worst case does not grow with the depth of the history while most
+ * revisions cost only the nodes they changed. IDs are kept in sorted
+ * vectors of 16 bytes each.
+ *
+ * The store is safe to use from multiple threads.
+ */
+class REPO_CORE_EXPORT RepoRevisionStore
+{
+
+public :
+
+	/*!
+	 * \param interval Maximum number of deltas in a row, 1 stores every
+	 * revision as a snapshot
+	 * \param change Fraction of the unique IDs of a snapshot that its deltas
+	 * may add or remove in total before a new snapshot is taken
+	 */
+	explicit RepoRevisionStore(
+		unsigned int interval = REPO_REVISION_STORE_INTERVAL,
+		double change = REPO_REVISION_STORE_CHANGE);
+
+	~RepoRevisionStore() {}
+
+	//--------------------------------------------------------------------------
+	//
+	// Revisions
+	//
+	//--------------------------------------------------------------------------
+
+	//! Stores the current unique IDs of the revision.
+	/*!
+	 * \param revision Revision identified by its unique ID
+	 * \param parent Unique ID of the parent revision, nil for the first one
+	 * \return False if the revision is already stored
+	 */
+	bool add(
+		const RepoNodeRevision &revision,
+		const boost::uuids::uuid &parent);
+
+	//! Stores the current unique IDs of the revision, see add().
+	bool add(
+		const boost::uuids::uuid &revision,
+		const boost::uuids::uuid &parent,
+		const std::set<boost::uuids::uuid> &currentUniqueIDs);
+
+	//! Retrieves the current unique IDs of the revision.
+	/*!
+	 * The result can be passed on to MongoClientWrapper::fetchByUniqueIDs()
+	 * to load the scene of the revision, as MongoClientWrapper::fetchRevision()
+	 * does. Revisions are added by it and by RepoCommitPipeline::commitDelta().
+	 *
+	 * \return False if the revision is not stored
+	 */
+	bool checkout(
+		const boost::uuids::uuid &revision,
+		std::set<boost::uuids::uuid> &currentUniqueIDs);
+
+	//! Returns true if the revision is stored.
+	bool contains(const boost::uuids::uuid &revision) const;
+
+	//! Forgets all revisions.
+	void clear();
+
+	//--------------------------------------------------------------------------
+	//
+	// Getters
+	//
+	//--------------------------------------------------------------------------
+
+	unsigned int getInterval() const { return interval; }
+
+	double getChange() const { return change; }
+
+	//! Returns the number of stored revisions.
+	size_t size() const;
+
+	//! Returns bytes of heap memory held by the stored IDs.
+	unsigned long long getHeapSize() const;
+
+	RepoRevisionStoreStatistics getStatistics() const;
+
+private :
+
+	//! Stored revision.
+	struct Entry
+	{
+		boost::uuids::uuid parent; //!< Nil for a snapshot
+		unsigned int depth; //!< Deltas from the snapshot, 0 for a snapshot
+		size_t changes; //!< IDs added and removed since the snapshot
+		size_t snapshotSize; //!< Number of IDs of the snapshot
+		std::vector<boost::uuids::uuid> added; //!< All IDs of a snapshot
+		std::vector<boost::uuids::uuid> removed; //!< Empty for a snapshot
+	};
+
+	//! Materialises the revision into sorted IDs, the lock has to be held.
+	/*!
+	 * Returns the number of replayed deltas.
+	 */
+	unsigned int materialise(
+		const Entry &entry,
+		std::vector<boost::uuids::uuid> &uniqueIDs) const;
+
+	RepoRevisionStore(const RepoRevisionStore &);
+
+	RepoRevisionStore &operator=(const RepoRevisionStore &);
+
+	unsigned int interval;
+
+	double change;
+
+	//! Revisions by their unique IDs.
+	std::map<boost::uuids::uuid, Entry> entries;
+
+	RepoRevisionStoreStatistics statistics;
+
+	//! Guards all of the above.
+	mutable boost::mutex mutex;
+
+}; // end class
+
+} // end namespace core
+} // end namespace repo
+
+#endif // end REPO_REVISION_STORE_H
@@ -0,0 +1,324 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "repo_scene_manager.h"
+#include "repo_node_mesh.h"
+
+//------------------------------------------------------------------------------
+
+repo::core::RepoSceneManager::RepoSceneManager(unsigned long long budget)
+	: budget(budget)
+	, usedBytes(0)
+{}
+
+//------------------------------------------------------------------------------
+//
+// Setters
+//
+//------------------------------------------------------------------------------
+
+void repo::core::RepoSceneManager::setLoaders(
+	const SceneLoader &sceneLoader,
+	const GeometryLoader &geometryLoader)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	this->sceneLoader = sceneLoader;
+	this->geometryLoader = geometryLoader;
+}
+
+void repo::core::RepoSceneManager::setBudget(unsigned long long budget)
+{
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		this->budget = budget;
+	}
+	trim();
+}
+
+//------------------------------------------------------------------------------
+//
+// Scenes
+//
+//------------------------------------------------------------------------------
+
+repo::core::RepoSceneHandle repo::core::RepoSceneManager::acquire(
+	const RepoSceneKey &key,
+	bool geometry)
+{
+	// Declared before the lock so that dropped scenes are deleted without it
+	std::vector<boost::shared_ptr<RepoGraphScene> > dropped;
+	boost::mutex::scoped_lock lock(mutex);
+
+	std::map<RepoSceneKey, Entry>::iterator it = entries.find(key);
+	while (entries.end() != it && it->second.loading)
+	{
+		loaded.wait(lock);
+		it = entries.find(key);
+	}
+
+	boost::shared_ptr<RepoGraphScene> scene;
+	RepoMemoryFootprint footprint;
+	if (entries.end() == it)
+	{
+		//----------------------------------------------------------------------
+		// Miss, the entry reserves the key while the scene is loading
+		++statistics.misses;
+		it = entries.insert(std::make_pair(key, Entry())).first;
+		it->second.bytes = it->second.geometryBytes = 0;
+		it->second.geometry = true;
+		it->second.loading = true;
+		it->second.recent = recent.insert(recent.begin(), key);
+		SceneLoader load = sceneLoader;
+
+		lock.unlock();
+		try
+		{
+			scene.reset(load(key));
+			if (scene)
+			{
+				prepare(scene.get());
+				footprint = scene->getFootprint();
+			}
+		}
+		catch (...)
+		{
+			lock.lock();
+			recent.erase(it->second.recent);
+			entries.erase(it);
+			loaded.notify_all();
+			throw;
+		}
+		lock.lock();
+
+		if (!scene)
+		{
+			recent.erase(it->second.recent);
+			entries.erase(it);
+		}
+		else
+		{
+			it->second.scene = scene;
+			it->second.loading = false;
+			measure(it->second, footprint);
+		}
+	}
+	else
+	{
+		scene = it->second.scene;
+		recent.splice(recent.begin(), recent, it->second.recent);
+		if (!geometry || it->second.geometry)
+		{
+			++statistics.hits;
+			return scene;
+		}
+
+		//----------------------------------------------------------------------
+		// Skeleton, held by this thread so that it cannot be evicted meanwhile
+		++statistics.geometryReloads;
+		it->second.loading = true;
+
+		lock.unlock();
+		try
+		{
+			reloadGeometry(key, scene.get());
+			footprint = scene->getFootprint();
+		}
+		catch (...)
+		{
+			lock.lock();
+			it->second.loading = false;
+			loaded.notify_all();
+			throw;
+		}
+		lock.lock();
+
+		it->second.loading = false;
+		it->second.geometry = true;
+		usedBytes -= it->second.bytes;
+		measure(it->second, footprint);
+	}
+	loaded.notify_all();
+	trim(dropped);
+	return scene;
+}
+
+bool repo::core::RepoSceneManager::contains(const RepoSceneKey &key) const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	std::map<RepoSceneKey, Entry>::const_iterator it = entries.find(key);
+	return entries.end() != it && !it->second.loading;
+}
+
+bool repo::core::RepoSceneManager::evict(const RepoSceneKey &key)
+{
+	boost::shared_ptr<RepoGraphScene> scene;
+	boost::mutex::scoped_lock lock(mutex);
+	std::map<RepoSceneKey, Entry>::iterator it = entries.find(key);
+	if (entries.end() == it || it->second.loading || !it->second.scene.unique())
+		return false;
+
+	++statistics.sceneEvictions;
+	usedBytes -= it->second.bytes;
+	scene.swap(it->second.scene);
+	recent.erase(it->second.recent);
+	entries.erase(it);
+	return true;
+}
+
+void repo::core::RepoSceneManager::trim()
+{
+	std::vector<boost::shared_ptr<RepoGraphScene> > dropped;
+	boost::mutex::scoped_lock lock(mutex);
+	trim(dropped);
+}
+
+void repo::core::RepoSceneManager::trim(
+	std::vector<boost::shared_ptr<RepoGraphScene> > &dropped)
+{
+	// Only the manager holds a scene whose pointer is unique, and new handles
+	// are only taken under the lock, hence it cannot be acquired meanwhile.
+	while (usedBytes > budget)
+	{
+		std::map<RepoSceneKey, Entry>::iterator victim = entries.end();
+		std::list<RepoSceneKey>::reverse_iterator rit;
+		for (rit = recent.rbegin(); rit != recent.rend(); ++rit)
+		{
+			Entry &entry = entries.find(*rit)->second;
+			if (!entry.loading && entry.geometry && entry.geometryBytes
+				&& entry.scene.unique())
+			{
+				releaseGeometry(entry);
+				victim = entries.find(*rit);
+				break;
+			}
+		}
+		if (entries.end() != victim)
+			continue;
+
+		for (rit = recent.rbegin(); rit != recent.rend(); ++rit)
+		{
+			std::map<RepoSceneKey, Entry>::iterator it = entries.find(*rit);
+			if (!it->second.loading && it->second.scene.unique())
+			{
+				victim = it;
+				break;
+			}
+		}
+		if (entries.end() == victim)
+			break;
+
+		++statistics.sceneEvictions;
+		usedBytes -= victim->second.bytes;
+		dropped.push_back(victim->second.scene);
+		recent.erase(victim->second.recent);
+		entries.erase(victim);
+	}
+}
+
+//------------------------------------------------------------------------------
+//
+// Getters
+//
+//------------------------------------------------------------------------------
+
+unsigned long long repo::core::RepoSceneManager::getBudget() const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return budget;
+}
+
+unsigned long long repo::core::RepoSceneManager::getUsedBytes() const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return usedBytes;
+}
+
+size_t repo::core::RepoSceneManager::size() const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return entries.size();
+}
+
+repo::core::RepoSceneManagerStatistics
+	repo::core::RepoSceneManager::getStatistics() const
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return statistics;
+}
+
+//------------------------------------------------------------------------------
+//
+// Private
+//
+//------------------------------------------------------------------------------
+
+void repo::core::RepoSceneManager::measure(
+	Entry &entry,
+	const RepoMemoryFootprint &footprint)
+{
+	entry.bytes = footprint.getTotal();
+	entry.geometryBytes = footprint.geometry + footprint.topology;
+	usedBytes += entry.bytes;
+}
+
+void repo::core::RepoSceneManager::releaseGeometry(Entry &entry)
+{
+	++statistics.geometryEvictions;
+	RepoNodeAbstractSet meshes = entry.scene->getMeshes();
+	for (RepoNodeAbstract *mesh : meshes)
+		static_cast<RepoNodeMesh *>(mesh)->releaseGeometry();
+
+	entry.geometry = false;
+	entry.bytes -= entry.geometryBytes;
+	usedBytes -= entry.geometryBytes;
+	entry.geometryBytes = 0;
+}
+
+void repo::core::RepoSceneManager::reloadGeometry(
+	const RepoSceneKey &key,
+	RepoGraphScene *scene) const
+{
+	RepoNodeAbstractSet meshes = scene->getMeshes();
+	std::vector<boost::uuids::uuid> uniqueIDs;
+	uniqueIDs.reserve(meshes.size());
+	for (const RepoNodeAbstract *mesh : meshes)
+		uniqueIDs.push_back(mesh->getUniqueID());
+
+	// The loader is only replaced under the lock which is not held here
+	GeometryLoader load;
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		load = geometryLoader;
+	}
+	std::vector<mongo::BSONObj> documents;
+	load(key, uniqueIDs, documents);
+
+	for (const mongo::BSONObj &document : documents)
+	{
+		RepoNodeMesh decoded(document);
+		RepoNodeMesh *mesh = RepoNodeAbstract::castNode<RepoNodeMesh *>(
+			scene->getNodeByUniqueID(decoded.getUniqueID()));
+		if (mesh)
+			mesh->takeGeometry(decoded);
+	}
+}
+
+void repo::core::RepoSceneManager::prepare(const RepoGraphScene *scene)
+{
+	scene->updateWorld();
+	scene->getPathIndex();
+}
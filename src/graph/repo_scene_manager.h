@@ -0,0 +1,244 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_SCENE_MANAGER_H
+#define REPO_SCENE_MANAGER_H
+
+//------------------------------------------------------------------------------
+#include <mongo/client/dbclient.h> // the MongoDB driver
+//------------------------------------------------------------------------------
+#include <functional>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+//------------------------------------------------------------------------------
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/uuid/uuid.hpp>
+//------------------------------------------------------------------------------
+#include "repo_graph_scene.h"
+#include "../repocoreglobal.h"
+
+//! Default number of bytes scenes of a RepoSceneManager may occupy, 1 GiB.
+#define REPO_SCENE_MANAGER_BUDGET (1ull << 30)
+
+namespace repo {
+namespace core {
+
+//! Identifies a scene at a revision of a project.
+struct REPO_CORE_EXPORT RepoSceneKey
+{
+	std::string database;
+	std::string project;
+	boost::uuids::uuid revision; //!< Unique ID of the revision node
+
+	RepoSceneKey() : revision() {}
+
+	RepoSceneKey(
+		const std::string &database,
+		const std::string &project,
+		const boost::uuids::uuid &revision)
+		: database(database)
+		, project(project)
+		, revision(revision) {}
+
+	bool operator<(const RepoSceneKey &other) const
+	{
+		if (database != other.database)
+			return database < other.database;
+		if (project != other.project)
+			return project < other.project;
+		return revision < other.revision;
+	}
+};
+
+//! Scene held by a user of RepoSceneManager, it is never evicted while held.
+typedef boost::shared_ptr<const RepoGraphScene> RepoSceneHandle;
+
+//! Work done by RepoSceneManager since its construction.
+struct REPO_CORE_EXPORT RepoSceneManagerStatistics
+{
+	unsigned long long hits; //!< Requests served by a resident scene
+	unsigned long long misses; //!< Requests that loaded the scene
+	unsigned long long geometryReloads; //!< Requests that reloaded the meshes
+	unsigned long long geometryEvictions; //!< Scenes reduced to their skeleton
+	unsigned long long sceneEvictions; //!< Scenes dropped altogether
+
+	RepoSceneManagerStatistics()
+		: hits(0)
+		, misses(0)
+		, geometryReloads(0)
+		, geometryEvictions(0)
+		, sceneEvictions(0) {}
+};
+
+//! Cache of loaded scenes bounded by a memory budget.
+/*!
+ * Scenes are loaded on first request by the scene loader and stay resident
+ * until the bytes reported by RepoGraphAbstract::getFootprint() exceed the
+ * budget. Scenes not held by any handle are then evicted in least recently
+ * used order, first by releasing the buffers of their meshes so that the
+ * hierarchy, bounding boxes and metadata remain resident, and only then
+ * altogether. Meshes of a skeleton are reloaded by the geometry loader the
+ * next time the scene is requested with its geometry.
+ *
+ * Scenes handed out are shared between threads and must only be read. Caches
+ * computed lazily by const methods, such as world matrices and paths, are
+ * brought up to date before a scene is handed out. The budget is enforced
+ * whenever a scene is loaded and on trim(), handles released in between
+ * may leave it exceeded.
+ *
+ * The manager is safe to use from multiple threads, loaders are called
+ * without holding its lock and requests for a scene being loaded wait for
+ * the load to finish.
+ */
+class REPO_CORE_EXPORT RepoSceneManager
+{
+
+public :
+
+	//! Returns a newly allocated scene of the key, NULL if it does not exist.
+	typedef std::function<RepoGraphScene *(const RepoSceneKey &)> SceneLoader;
+
+	//! Appends BSON documents of meshes of the key with the given unique IDs.
+	typedef std::function<void (
+		const RepoSceneKey &,
+		const std::vector<boost::uuids::uuid> &,
+		std::vector<mongo::BSONObj> &)> GeometryLoader;
+
+	//! Creates an empty manager, loaders have to be set before use.
+	explicit RepoSceneManager(
+		unsigned long long budget = REPO_SCENE_MANAGER_BUDGET);
+
+	//! Deletes all scenes not held by a handle.
+	~RepoSceneManager() {}
+
+	//--------------------------------------------------------------------------
+	//
+	// Setters
+	//
+	//--------------------------------------------------------------------------
+
+	//! Sets functions loading scenes and meshes, typically from a database.
+	void setLoaders(
+		const SceneLoader &sceneLoader,
+		const GeometryLoader &geometryLoader);
+
+	//! Sets the number of bytes resident scenes may occupy and trims to it.
+	void setBudget(unsigned long long budget);
+
+	//--------------------------------------------------------------------------
+	//
+	// Scenes
+	//
+	//--------------------------------------------------------------------------
+
+	//! Returns the scene of the key, loading it if not resident.
+	/*!
+	 * \param key Scene to return, revisions of resident scenes never change
+	 * \param geometry If false, a resident skeleton is returned as is and
+	 * its meshes must not be accessed
+	 * \return Handle to the scene, empty if the scene loader returned NULL
+	 */
+	RepoSceneHandle acquire(const RepoSceneKey &key, bool geometry = true);
+
+	//! Returns true if the scene of the key is resident.
+	bool contains(const RepoSceneKey &key) const;
+
+	//! Drops the scene of the key, returns false if it is held or absent.
+	bool evict(const RepoSceneKey &key);
+
+	//! Evicts scenes not held by a handle until the budget is met.
+	void trim();
+
+	//--------------------------------------------------------------------------
+	//
+	// Getters
+	//
+	//--------------------------------------------------------------------------
+
+	unsigned long long getBudget() const;
+
+	//! Returns the bytes occupied by resident scenes.
+	unsigned long long getUsedBytes() const;
+
+	//! Returns the number of resident scenes, skeletons included.
+	size_t size() const;
+
+	RepoSceneManagerStatistics getStatistics() const;
+
+private :
+
+	//! Resident scene and its position in the least recently used order.
+	struct Entry
+	{
+		boost::shared_ptr<RepoGraphScene> scene;
+		unsigned long long bytes; //!< Footprint of the scene
+		unsigned long long geometryBytes; //!< Part of the bytes held by meshes
+		bool geometry; //!< False once the meshes have been released
+		bool loading; //!< True while a loader is running for the entry
+		std::list<RepoSceneKey>::iterator recent;
+	};
+
+	//! Accounts the footprint of the scene of the entry.
+	void measure(Entry &entry, const RepoMemoryFootprint &footprint);
+
+	//! Evicts until the budget is met, dropped scenes are appended.
+	void trim(std::vector<boost::shared_ptr<RepoGraphScene> > &dropped);
+
+	//! Releases the meshes of the scene of the entry.
+	void releaseGeometry(Entry &entry);
+
+	//! Reloads the meshes of the scene of the entry.
+	void reloadGeometry(const RepoSceneKey &key, RepoGraphScene *scene) const;
+
+	//! Brings lazily computed caches of the scene up to date.
+	static void prepare(const RepoGraphScene *scene);
+
+	RepoSceneManager(const RepoSceneManager &);
+
+	RepoSceneManager &operator=(const RepoSceneManager &);
+
+	SceneLoader sceneLoader;
+
+	GeometryLoader geometryLoader;
+
+	std::map<RepoSceneKey, Entry> entries;
+
+	//! Keys of resident entries, most recently used first.
+	std::list<RepoSceneKey> recent;
+
+	unsigned long long budget;
+
+	unsigned long long usedBytes;
+
+	RepoSceneManagerStatistics statistics;
+
+	//! Guards all of the above.
+	mutable boost::mutex mutex;
+
+	//! Signalled whenever an entry finishes loading.
+	boost::condition_variable loaded;
+
+}; // end class
+
+} // end namespace core
+} // end namespace repo
+
+#endif // end REPO_SCENE_MANAGER_H
@@ -0,0 +1,94 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "repo_scene_snapshots.h"
+
+//------------------------------------------------------------------------------
+
+repo::core::RepoSceneSnapshots::RepoSceneSnapshots(
+	RepoGraphScene *scene,
+	bool spatialIndex)
+	: version(0)
+	, spatialIndex(spatialIndex)
+{
+	prepare(scene);
+	latest.reset(scene);
+}
+
+//------------------------------------------------------------------------------
+//
+// Readers
+//
+//------------------------------------------------------------------------------
+
+repo::core::RepoSceneSnapshot repo::core::RepoSceneSnapshots::pin(
+	uint64_t *version) const
+{
+	boost::mutex::scoped_lock lock(latestMutex);
+	if (version)
+		*version = this->version;
+	return latest;
+}
+
+uint64_t repo::core::RepoSceneSnapshots::getVersion() const
+{
+	boost::mutex::scoped_lock lock(latestMutex);
+	return version;
+}
+
+//------------------------------------------------------------------------------
+//
+// Writers
+//
+//------------------------------------------------------------------------------
+
+uint64_t repo::core::RepoSceneSnapshots::modify(const Edit &edit)
+{
+	boost::mutex::scoped_lock writeLock(writeMutex);
+
+	// Only writers replace the latest version, hence it cannot change here
+	boost::shared_ptr<RepoGraphScene> scene(new RepoGraphScene(*pin()));
+	edit(scene.get());
+	prepare(scene.get());
+	return swap(scene);
+}
+
+uint64_t repo::core::RepoSceneSnapshots::publish(RepoGraphScene *scene)
+{
+	boost::mutex::scoped_lock writeLock(writeMutex);
+	RepoSceneSnapshot next(scene);
+	prepare(scene);
+	return swap(next);
+}
+
+uint64_t repo::core::RepoSceneSnapshots::swap(const RepoSceneSnapshot &next)
+{
+	// The previous version is released outside of the lock if not pinned
+	RepoSceneSnapshot previous(next);
+	boost::mutex::scoped_lock lock(latestMutex);
+	previous.swap(latest);
+	return ++version;
+}
+
+void repo::core::RepoSceneSnapshots::prepare(RepoGraphScene *scene) const
+{
+	scene->shareBuffers();
+	scene->updateWorld();
+	scene->getPathIndex();
+	if (spatialIndex)
+		scene->getBVH();
+}
@@ -0,0 +1,144 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_SCENE_SNAPSHOTS_H
+#define REPO_SCENE_SNAPSHOTS_H
+
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include <functional>
+//------------------------------------------------------------------------------
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+//------------------------------------------------------------------------------
+#include "repo_graph_scene.h"
+#include "../repocoreglobal.h"
+
+namespace repo {
+namespace core {
+
+//! Immutable version of a scene pinned by a reader.
+typedef boost::shared_ptr<const RepoGraphScene> RepoSceneSnapshot;
+
+//! Versions of a scene shared between concurrent readers and writers.
+/*!
+ * Readers pin the latest version and read it without any lock, it stays
+ * valid and unchanged for as long as they hold it. Writers edit a copy of
+ * the latest version which is published once the edit returns, hence
+ * readers never wait for writers and writers wait only for each other.
+ *
+ * This is not structural sharing: nodes link to their parents, so no node
+ * can be shared by two versions and every modify() copies every node and
+ * edge of the scene, however small the edit, while other writers wait.
+ * Only the buffers of meshes and textures are shared, so a version costs
+ * the hierarchy of the scene plus the geometry it modified, see
+ * RepoGraphScene(const RepoGraphScene &). Batch edits into one modify()
+ * on large scenes.
+ *
+ * Buffers are handed to shared owners and caches computed lazily by const
+ * methods, such as world matrices, paths and optionally the spatial index,
+ * are brought up to date before a version is published, so that readers
+ * and the copies made by writers only ever read it.
+ */
+class REPO_CORE_EXPORT RepoSceneSnapshots
+{
+
+public :
+
+	//! Edit applied by a writer to its own copy of the latest version.
+	typedef std::function<void (RepoGraphScene *)> Edit;
+
+	//! Takes ownership of the scene and publishes it as the first version.
+	/*!
+	 * \param scene Scene to share, it must not be modified directly from now on
+	 * \param spatialIndex If true, every version has its RepoBVH built before
+	 * it is published, otherwise readers must not call getBVH()
+	 */
+	explicit RepoSceneSnapshots(
+		RepoGraphScene *scene,
+		bool spatialIndex = false);
+
+	~RepoSceneSnapshots() {}
+
+	//--------------------------------------------------------------------------
+	//
+	// Readers
+	//
+	//--------------------------------------------------------------------------
+
+	//! Returns the latest version, kept alive while the snapshot is held.
+	/*!
+	 * \param version If given, receives the number of the returned version
+	 */
+	RepoSceneSnapshot pin(uint64_t *version = NULL) const;
+
+	//! Returns the number of the latest version, the first one being 0.
+	uint64_t getVersion() const;
+
+	//--------------------------------------------------------------------------
+	//
+	// Writers
+	//
+	//--------------------------------------------------------------------------
+
+	//! Applies the edit to a copy of the latest version and publishes it.
+	/*!
+	 * Writers are serialised so that no edit is lost. The copy duplicates
+	 * every node of the scene and is made while other writers wait. If the
+	 * edit throws, the copy is discarded and the latest version remains
+	 * unchanged.
+	 *
+	 * \return Number of the published version
+	 */
+	uint64_t modify(const Edit &edit);
+
+	//! Publishes the scene as the latest version and takes its ownership.
+	uint64_t publish(RepoGraphScene *scene);
+
+private :
+
+	//! Replaces the latest version, returns the number of the next one.
+	uint64_t swap(const RepoSceneSnapshot &next);
+
+	//! Shares buffers and brings lazily computed caches of the scene up to
+	//! date, so that readers and copies only ever read a published version.
+	void prepare(RepoGraphScene *scene) const;
+
+	RepoSceneSnapshots(const RepoSceneSnapshots &);
+
+	RepoSceneSnapshots &operator=(const RepoSceneSnapshots &);
+
+	//! Latest version.
+	RepoSceneSnapshot latest;
+
+	//! Number of the latest version.
+	uint64_t version;
+
+	//! Guards the latest version and its number, held only to swap or copy.
+	mutable boost::mutex latestMutex;
+
+	//! Serialises writers.
+	boost::mutex writeMutex;
+
+	bool spatialIndex;
+
+}; // end class
+
+} // end namespace core
+} // end namespace repo
+
+#endif // end REPO_SCENE_SNAPSHOTS_H
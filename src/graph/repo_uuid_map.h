@@ -0,0 +1,214 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_UUID_MAP_H
+#define REPO_UUID_MAP_H
+
+//------------------------------------------------------------------------------
+#include <cstring>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+//------------------------------------------------------------------------------
+#include <boost/uuid/uuid.hpp>
+
+namespace repo {
+namespace core {
+
+//! Hash map keyed on uuids with open addressing.
+/*!
+ * Entries are stored densely in a vector and a power of two table of
+ * linearly probed slots indexes into it, kept at most half full. Iteration
+ * follows the order of insertion (erase moves the last entry into the gap)
+ * and therefore does not depend on memory addresses. Iterators and
+ * references are invalidated by insert and erase.
+ *
+ * The interface mirrors the subset of std::map used by the graphs.
+ */
+template <class T>
+class RepoUUIDMap
+{
+
+public :
+
+	typedef std::pair<boost::uuids::uuid, T> value_type;
+	typedef typename std::vector<value_type>::iterator iterator;
+	typedef typename std::vector<value_type>::const_iterator const_iterator;
+
+	RepoUUIDMap() : mask(0) {}
+
+	//! Preallocates space for the given number of entries.
+	void reserve(size_t count)
+	{
+		entries.reserve(count);
+		if (2 * count > slots.size())
+			rehash(2 * count);
+	}
+
+	size_t size() const { return entries.size(); }
+
+	bool empty() const { return entries.empty(); }
+
+	//! Returns the number of bytes allocated for entries and slots.
+	size_t getHeapSize() const
+	{
+		return entries.capacity() * sizeof(value_type)
+			+ slots.capacity() * sizeof(uint32_t);
+	}
+
+	void clear()
+	{
+		entries.clear();
+		slots.assign(slots.size(), 0);
+	}
+
+	iterator begin() { return entries.begin(); }
+	iterator end() { return entries.end(); }
+	const_iterator begin() const { return entries.begin(); }
+	const_iterator end() const { return entries.end(); }
+
+	iterator find(const boost::uuids::uuid &key)
+	{
+		size_t slot = findSlot(key);
+		return slots.empty() || !slots[slot]
+			? entries.end() : entries.begin() + (slots[slot] - 1);
+	}
+
+	const_iterator find(const boost::uuids::uuid &key) const
+	{
+		size_t slot = findSlot(key);
+		return slots.empty() || !slots[slot]
+			? entries.end() : entries.begin() + (slots[slot] - 1);
+	}
+
+	//! Inserts the value unless the key is already present, same as std::map.
+	std::pair<iterator, bool> insert(const value_type &value)
+	{
+		if (2 * (entries.size() + 1) > slots.size())
+			rehash(2 * (entries.size() + 1));
+
+		size_t slot = findSlot(value.first);
+		if (slots[slot])
+			return std::make_pair(entries.begin() + (slots[slot] - 1), false);
+
+		entries.push_back(value);
+		slots[slot] = (uint32_t) entries.size();
+		return std::make_pair(entries.end() - 1, true);
+	}
+
+	template <class InputIterator>
+	void insert(InputIterator first, InputIterator last)
+	{
+		for (; first != last; ++first)
+			insert(value_type(first->first, first->second));
+	}
+
+	//! Removes the key if present and returns the number of erased entries.
+	size_t erase(const boost::uuids::uuid &key)
+	{
+		if (slots.empty())
+			return 0;
+
+		size_t slot = findSlot(key);
+		if (!slots[slot])
+			return 0;
+
+		uint32_t index = slots[slot] - 1;
+		removeSlot(slot);
+
+		// Fill the gap with the last entry to keep the entries dense
+		uint32_t last = (uint32_t) entries.size() - 1;
+		if (index != last)
+		{
+			slots[findSlot(entries[last].first)] = index + 1;
+			entries[index] = entries[last];
+		}
+		entries.pop_back();
+		return 1;
+	}
+
+	//! Returns a hash of a uuid mixing both of its 64-bit halves.
+	static uint64_t hash(const boost::uuids::uuid &key)
+	{
+		uint64_t a, b;
+		memcpy(&a, key.data, sizeof(a));
+		memcpy(&b, key.data + sizeof(a), sizeof(b));
+		uint64_t h = a ^ (b * 0x9E3779B97F4A7C15ULL);
+		return h ^ (h >> 32);
+	}
+
+private :
+
+	//! Returns the slot holding the key or the empty slot it would go to.
+	size_t findSlot(const boost::uuids::uuid &key) const
+	{
+		if (slots.empty())
+			return 0;
+		size_t slot = hash(key) & mask;
+		while (slots[slot] && !(entries[slots[slot] - 1].first == key))
+			slot = (slot + 1) & mask;
+		return slot;
+	}
+
+	//! Empties a slot shifting back the entries of its probe sequence.
+	void removeSlot(size_t hole)
+	{
+		size_t slot = hole;
+		while (true)
+		{
+			slot = (slot + 1) & mask;
+			if (!slots[slot])
+				break;
+
+			// Move the entry to the hole unless its home lies cyclically
+			// within (hole, slot]
+			size_t home = hash(entries[slots[slot] - 1].first) & mask;
+			if (((slot - home) & mask) >= ((slot - hole) & mask))
+			{
+				slots[hole] = slots[slot];
+				hole = slot;
+			}
+		}
+		slots[hole] = 0;
+	}
+
+	void rehash(size_t minimum)
+	{
+		size_t capacity = 16;
+		while (capacity < minimum)
+			capacity <<= 1;
+
+		slots.assign(capacity, 0);
+		mask = capacity - 1;
+		for (uint32_t i = 0; i < entries.size(); ++i)
+			slots[findSlot(entries[i].first)] = i + 1;
+	}
+
+	//! Entries in the order of insertion.
+	std::vector<value_type> entries;
+
+	//! Indices into entries offset by one, zero marks an empty slot.
+	std::vector<uint32_t> slots;
+
+	size_t mask;
+
+}; // end class
+
+} // end namespace core
+} // end namespace repo
+
+#endif // end REPO_UUID_MAP_H
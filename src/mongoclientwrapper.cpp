@@ -4,8 +4,13 @@
 #include "conversion/repo_transcoder_string.h"
 #include "repologger.h"
 #include "primitives/reposeverity.h"
+#include "conversion/repo_transcoder_bson.h"
+#include "graph/repo_node_types.h"
+#include "graph/repo_revision_store.h"
 
+#include <algorithm>
 #include <iostream>
+#include <set>
 #include <sstream>
 #include <string>
 #include <cstring>
@@ -679,6 +684,165 @@ mongo::BSONObj repo::core::MongoClientWrapper::findOneBySharedID(
 }
 
 
+bool repo::core::MongoClientWrapper::fetchSubgraph(
+	const std::string &database,
+	const std::string &collection,
+	const boost::uuids::uuid &sharedID,
+	const std::set<boost::uuids::uuid> &currentUniqueIDs,
+	int depth,
+	std::vector<mongo::BSONObj> &ret)
+{
+	size_t retrieved = ret.size();
+	try
+	{
+		std::string ns = getNamespace(database, collection);
+
+		//----------------------------------------------------------------------
+		// Breadth first, the frontier holds shared IDs of the previous level.
+		// The paths field is an array of arrays which a multikey index cannot
+		// serve, hence children are found by their parents instead. Nodes
+		// with several parents in the subgraph are retrieved only once.
+		// Versions of other revisions match the same shared IDs and are
+		// skipped, so children deleted in the revision are not followed.
+		std::set<boost::uuids::uuid> uniqueIDs;
+		std::set<boost::uuids::uuid> sharedIDs;
+		std::vector<boost::uuids::uuid> frontier(1, sharedID);
+		for (int level = 0; !frontier.empty(); ++level)
+		{
+			std::vector<boost::uuids::uuid> next;
+			for (size_t i = 0; i < frontier.size(); i += REPO_SUBGRAPH_BATCH_SIZE)
+			{
+				std::vector<boost::uuids::uuid> batch(frontier.begin() + i,
+					frontier.begin() + std::min(frontier.size(),
+						i + REPO_SUBGRAPH_BATCH_SIZE));
+
+				mongo::BSONObjBuilder ids;
+				RepoTranscoderBSON::append("$in", batch, ids);
+				mongo::BSONObjBuilder query;
+				query << (0 == level
+					? REPO_NODE_LABEL_SHARED_ID
+					: REPO_NODE_LABEL_PARENTS) << ids.obj();
+				if (depth >= 0 && level > depth)
+					query << REPO_NODE_LABEL_TYPE << BSON("$in" << BSON_ARRAY(
+						REPO_NODE_TYPE_MATERIAL << REPO_NODE_TYPE_TEXTURE));
+
+				std::auto_ptr<mongo::DBClientCursor> cursor =
+					clientConnection.query(ns, query.obj());
+				while (cursor.get() && cursor->more())
+				{
+					mongo::BSONObj obj = cursor->next();
+					boost::uuids::uuid uniqueID = retrieveUUID(obj.getField(ID));
+					if (currentUniqueIDs.count(uniqueID)
+						&& uniqueIDs.insert(uniqueID).second)
+					{
+						ret.push_back(obj.copy());
+						boost::uuids::uuid id =
+							retrieveUUID(obj.getField(REPO_NODE_LABEL_SHARED_ID));
+						if (sharedIDs.insert(id).second)
+							next.push_back(id);
+					}
+				}
+			}
+			frontier.swap(next);
+		}
+		checkForError();
+	}
+	catch (mongo::DBException& e)
+	{
+		log(std::string(e.what()));
+	}
+	return ret.size() > retrieved;
+}
+
+bool repo::core::MongoClientWrapper::ensureSubgraphIndexes(
+	const std::string &database,
+	const std::string &collection)
+{
+	bool success = true;
+	try
+	{
+		std::string ns = getNamespace(database, collection);
+		clientConnection.ensureIndex(ns, BSON(REPO_NODE_LABEL_SHARED_ID << 1));
+		clientConnection.ensureIndex(ns, BSON(REPO_NODE_LABEL_PARENTS << 1));
+		checkForError();
+	}
+	catch (mongo::DBException& e)
+	{
+		log(std::string(e.what()));
+		success = false;
+	}
+	return success;
+}
+
+
+bool repo::core::MongoClientWrapper::fetchByUniqueIDs(
+	const std::string &database,
+	const std::string &collection,
+	const std::set<boost::uuids::uuid> &uniqueIDs,
+	const std::list<std::string> &fields,
+	std::vector<mongo::BSONObj> &ret)
+{
+	bool success = true;
+	try
+	{
+		std::string ns = getNamespace(database, collection);
+		mongo::BSONObj fieldsObj = fieldsToReturn(fields, !fields.empty());
+		std::vector<boost::uuids::uuid> batch;
+		batch.reserve(std::min<size_t>(uniqueIDs.size(), REPO_SUBGRAPH_BATCH_SIZE));
+		std::set<boost::uuids::uuid>::const_iterator it = uniqueIDs.begin();
+		while (it != uniqueIDs.end())
+		{
+			batch.clear();
+			for (; it != uniqueIDs.end()
+				&& batch.size() < REPO_SUBGRAPH_BATCH_SIZE; ++it)
+				batch.push_back(*it);
+
+			mongo::BSONObjBuilder ids;
+			RepoTranscoderBSON::append("$in", batch, ids);
+			mongo::BSONObjBuilder query;
+			query << ID << ids.obj();
+
+			std::auto_ptr<mongo::DBClientCursor> cursor =
+				clientConnection.query(ns, query.obj(), 0, 0, &fieldsObj);
+			while (cursor.get() && cursor->more())
+				ret.push_back(cursor->next().copy());
+		}
+		success = checkForError();
+	}
+	catch (mongo::DBException& e)
+	{
+		log(std::string(e.what()));
+		success = false;
+	}
+	return success;
+}
+
+bool repo::core::MongoClientWrapper::fetchRevision(
+	const std::string &database,
+	const std::string &project,
+	const boost::uuids::uuid &revision,
+	RepoRevisionStore &store,
+	std::vector<mongo::BSONObj> &ret)
+{
+	std::set<boost::uuids::uuid> uniqueIDs;
+	if (!store.checkout(revision, uniqueIDs))
+	{
+		mongo::BSONObj obj = findOneByUniqueID(database,
+			getHistoryCollectionName(project), uuidToString(revision),
+			std::list<std::string>());
+		if (obj.isEmpty())
+			return false;
+
+		// Stored as a delta if the parent revision is in the store already
+		RepoNodeRevision node(obj);
+		std::vector<boost::uuids::uuid> parents = node.getParentSharedIDs();
+		store.add(node, parents.empty() ? boost::uuids::uuid() : parents[0]);
+		uniqueIDs = node.getCurrentUniqueIDs();
+	}
+	return fetchByUniqueIDs(database, getSceneCollectionName(project),
+		uniqueIDs, std::list<std::string>(), ret);
+}
+
 mongo::BSONElement repo::core::MongoClientWrapper::eval(
         const std::string &database,
         const std::string &jscode)
@@ -942,6 +1106,23 @@ void repo::core::MongoClientWrapper::insertRecords(
 			insertRecord(database, collection, objs[i]);		
 }
 
+bool repo::core::MongoClientWrapper::insertBatch(
+	const std::string &database,
+	const std::string &collection,
+	const std::vector<mongo::BSONObj> &objs)
+{
+	try
+	{
+		clientConnection.insert(getNamespace(database, collection), objs);
+	}
+	catch (mongo::DBException& e)
+	{
+		log(std::string(e.what()));
+		return false;
+	}
+	return checkForError();
+}
+
 void repo::core::MongoClientWrapper::updateRecord(
         const std::string &database,
         const std::string &collection,
@@ -35,9 +35,17 @@
 
 #include "repocoreglobal.h"
 
+//! Depth of fetchSubgraph() which loads all descendants of the root.
+#define REPO_SUBGRAPH_UNLIMITED_DEPTH -1
+
+//! Maximum number of shared IDs in a single query of fetchSubgraph().
+#define REPO_SUBGRAPH_BATCH_SIZE 1000
+
 namespace repo {
 namespace core {
 
+class RepoRevisionStore;
+
 class REPO_CORE_EXPORT MongoClientWrapper
 {
 
@@ -299,6 +307,58 @@ public:
 		const std::string& sortField,
 		const std::list<std::string>& fields);
 
+    /*! Populates the ret vector with the node of a given shared ID and its
+     * descendants down to the given depth, the root being at depth 0.
+     * Materials and textures of the loaded nodes are retrieved regardless of
+     * the depth so that the subgraph can be displayed. Each level of the
+     * hierarchy is a single query on the parents field per batch of
+     * REPO_SUBGRAPH_BATCH_SIZE shared IDs, see ensureSubgraphIndexes().
+     * Only documents among the current unique IDs of the revision are
+     * returned and followed, see RepoRevisionStore::checkout(), as the
+     * collection holds the nodes of all revisions. Returns true if the root
+     * was found.
+     */
+    bool fetchSubgraph(
+        const std::string &database,
+        const std::string &collection,
+        const boost::uuids::uuid &sharedID,
+        const std::set<boost::uuids::uuid> &currentUniqueIDs,
+        int depth,
+        std::vector<mongo::BSONObj> &ret);
+
+    //! Creates the indexes used by fetchSubgraph() unless they exist.
+    /*!
+     * Meant to be called once per scene collection, for instance when the
+     * project is created, rather than before every fetch.
+     */
+    bool ensureSubgraphIndexes(
+        const std::string &database,
+        const std::string &collection);
+
+    /*! Populates the ret vector with the given fields of the documents of
+     * the given unique IDs, the _id field is returned only if listed. Whole
+     * documents are returned if no fields are listed. Each batch of
+     * REPO_SUBGRAPH_BATCH_SIZE IDs is a single query. Returns false on error.
+     */
+    bool fetchByUniqueIDs(
+        const std::string &database,
+        const std::string &collection,
+        const std::set<boost::uuids::uuid> &uniqueIDs,
+        const std::list<std::string> &fields,
+        std::vector<mongo::BSONObj> &ret);
+
+    /*! Populates the ret vector with the nodes of the given revision from
+     * project.scene. Its current unique IDs are checked out of the store,
+     * otherwise read from the revision in project.history and added to the
+     * store. Returns false if the revision is not found or on error.
+     */
+    bool fetchRevision(
+        const std::string &database,
+        const std::string &project,
+        const boost::uuids::uuid &revision,
+        RepoRevisionStore &store,
+        std::vector<mongo::BSONObj> &ret);
+
     //! Run db.eval command on the specified database.
     mongo::BSONElement eval(const std::string &database,
             const std::string &jscode);
@@ -380,6 +440,14 @@ public:
 		const std::vector<mongo::BSONObj> &objs, 
 		bool inReverse = false);
 
+	/*! Inserts all objects in a single round trip, returns false on error.
+	 * The objects together have to fit into a single wire message.
+	 */
+	bool insertBatch(
+		const std::string &database,
+		const std::string &collection,
+		const std::vector<mongo::BSONObj> &objs);
+
     void upsertRecord(const std::string &database,
                       const std::string &collection,
                       const mongo::BSONObj &obj)
@@ -0,0 +1,542 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "repocommitpipeline.h"
+
+#include "compute/repo_parallel.h"
+#include "graph/repo_uuid_map.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <set>
+#include <boost/thread.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+
+//------------------------------------------------------------------------------
+
+//! Returns milliseconds elapsed since the given time point.
+inline double millisecondsSince(
+    const std::chrono::high_resolution_clock::time_point &start)
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+}
+
+//! Bounded queue of batches between encoders and writers.
+class repo::core::RepoCommitPipeline::Queue
+{
+
+public :
+
+    Queue(size_t capacity, unsigned int producers)
+        : capacity(std::max<size_t>(1, capacity))
+        , producers(producers) {}
+
+    //! Appends the batch, waiting while the queue is full.
+    /*!
+     * \return Milliseconds spent waiting
+     */
+    double push(std::vector<mongo::BSONObj> &batch)
+    {
+        std::chrono::high_resolution_clock::time_point start =
+            std::chrono::high_resolution_clock::now();
+        boost::mutex::scoped_lock lock(mutex);
+        while (batches.size() >= capacity)
+            notFull.wait(lock);
+        double waited = millisecondsSince(start);
+
+        batches.push_back(std::vector<mongo::BSONObj>());
+        batches.back().swap(batch);
+        notEmpty.notify_one();
+        return waited;
+    }
+
+    //! Takes the oldest batch, waiting while the queue is empty.
+    /*!
+     * \return False once the queue is empty and all producers have finished
+     */
+    bool pop(std::vector<mongo::BSONObj> &batch, double &waited)
+    {
+        std::chrono::high_resolution_clock::time_point start =
+            std::chrono::high_resolution_clock::now();
+        boost::mutex::scoped_lock lock(mutex);
+        while (batches.empty() && producers > 0)
+            notEmpty.wait(lock);
+        waited += millisecondsSince(start);
+        if (batches.empty())
+            return false;
+
+        batch.swap(batches.front());
+        batches.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    //! Marks one producer as finished, writers stop once all have.
+    void finish()
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (0 == --producers)
+            notEmpty.notify_all();
+    }
+
+    //! Calls finish() on leaving the scope of a producer, however it is left.
+    class Producer
+    {
+
+    public :
+
+        explicit Producer(Queue &queue) : queue(queue) {}
+
+        ~Producer() { queue.finish(); }
+
+    private :
+
+        Queue &queue;
+
+    };
+
+private :
+
+    std::deque<std::vector<mongo::BSONObj> > batches;
+
+    size_t capacity;
+
+    unsigned int producers;
+
+    boost::mutex mutex;
+
+    boost::condition_variable notFull;
+
+    boost::condition_variable notEmpty;
+
+};
+
+//------------------------------------------------------------------------------
+
+repo::core::RepoCommitPipeline::RepoCommitPipeline(
+    const MongoClientWrapper &connection,
+    unsigned int encoders,
+    unsigned int writers,
+    size_t queueCapacity)
+    : connection(connection)
+    , encoders(encoders)
+    , writers(std::max(1u, writers))
+    , queueCapacity(queueCapacity)
+    , revisionStore(NULL)
+{}
+
+bool repo::core::RepoCommitPipeline::commit(
+    const std::string &database,
+    const std::string &collection,
+    const RepoGraphAbstract &graph)
+{
+    graph.getPathIndex();
+    RepoNodeAbstractSet set = graph.getNodes();
+    return commit(database, collection,
+        std::vector<const RepoNodeAbstract *>(set.begin(), set.end()));
+}
+
+bool repo::core::RepoCommitPipeline::commit(
+    const std::string &database,
+    const std::string &collection,
+    const std::vector<const RepoNodeAbstract *> &nodes)
+{
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+    statistics = RepoCommitStatistics();
+    statistics.nodes = nodes.size();
+
+    if (!connect())
+    {
+        statistics.failedNodes = nodes.size();
+        statistics.totalMilliseconds = millisecondsSince(start);
+        return false;
+    }
+    statistics.connectMilliseconds = millisecondsSince(start);
+
+    unsigned int encoderThreads = std::max<unsigned int>(1,
+        std::min<size_t>(RepoParallel::getThreadCount(encoders), nodes.size()));
+
+    // Threads add their counters to the statistics once they finish
+    Queue queue(queueCapacity, encoderThreads);
+    boost::mutex statisticsMutex;
+    std::atomic<size_t> next(0);
+
+    //--------------------------------------------------------------------------
+    // Encoders pull the next node index and flush full batches to the queue
+    auto encode = [&]()
+    {
+        Queue::Producer producer(queue);
+        RepoCommitStatistics local;
+        std::vector<mongo::BSONObj> batch;
+        size_t batchBytes = 0;
+        for (size_t i = next++; i < nodes.size(); i = next++)
+        {
+            std::chrono::high_resolution_clock::time_point encodeStart =
+                std::chrono::high_resolution_clock::now();
+            mongo::BSONObj obj;
+            try
+            {
+                mongo::BSONObj node = nodes[i]->toBSONObj();
+                mongo::BSONObjBuilder builder;
+                builder.appendElements(node);
+                builder << REPO_NODE_LABEL_FINGERPRINT
+                    << RepoNodeAbstract::computeFingerprint(node);
+                obj = builder.obj();
+            }
+            catch (...)
+            {
+                // Any node failing to encode must not stall the writers
+                ++local.failedNodes;
+                continue;
+            }
+            local.encodeMilliseconds += millisecondsSince(encodeStart);
+
+            size_t size = obj.objsize();
+            if (!batch.empty() && (batch.size() >= REPO_COMMIT_BATCH_SIZE
+                || batchBytes + size > REPO_COMMIT_BATCH_BYTES))
+            {
+                local.backpressureMilliseconds += queue.push(batch);
+                batch.clear();
+                batchBytes = 0;
+            }
+            batch.push_back(obj);
+            batchBytes += size;
+        }
+        if (!batch.empty())
+            local.backpressureMilliseconds += queue.push(batch);
+
+        boost::mutex::scoped_lock lock(statisticsMutex);
+        statistics.failedNodes += local.failedNodes;
+        statistics.encodeMilliseconds += local.encodeMilliseconds;
+        statistics.backpressureMilliseconds +=
+            local.backpressureMilliseconds;
+    };
+
+    //--------------------------------------------------------------------------
+    // Writers insert one batch per round trip on their own connection
+    auto write = [&](MongoClientWrapper *writer)
+    {
+        RepoCommitStatistics local;
+        std::vector<mongo::BSONObj> batch;
+        while (queue.pop(batch, local.starvationMilliseconds))
+        {
+            std::chrono::high_resolution_clock::time_point writeStart =
+                std::chrono::high_resolution_clock::now();
+            bool success = writer->insertBatch(database, collection, batch);
+            local.writeMilliseconds += millisecondsSince(writeStart);
+
+            ++local.batches;
+            if (!success)
+                ++local.failedBatches;
+            else
+            {
+                local.documents += batch.size();
+                for (size_t i = 0; i < batch.size(); ++i)
+                    local.bytes += batch[i].objsize();
+            }
+            batch.clear();
+        }
+
+        boost::mutex::scoped_lock lock(statisticsMutex);
+        statistics.documents += local.documents;
+        statistics.bytes += local.bytes;
+        statistics.batches += local.batches;
+        statistics.failedBatches += local.failedBatches;
+        statistics.writeMilliseconds += local.writeMilliseconds;
+        statistics.starvationMilliseconds += local.starvationMilliseconds;
+    };
+
+    RepoParallel::run(encoderThreads + writers, [&](unsigned int worker)
+    {
+        if (worker < encoderThreads)
+            encode();
+        else
+            write(pool[worker - encoderThreads].get());
+    });
+
+    statistics.totalMilliseconds = millisecondsSince(start);
+    return 0 == statistics.failedNodes && 0 == statistics.failedBatches;
+}
+
+bool repo::core::RepoCommitPipeline::commitDelta(
+    const std::string &database,
+    const std::string &collection,
+    RepoGraphAbstract &graph,
+    const RepoNodeRevision &parent,
+    RepoNodeRevision &revision,
+    const std::map<boost::uuids::uuid, boost::uuids::uuid> &correspondence)
+{
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+    size_t nodeCount = graph.getNodes().size();
+
+    //--------------------------------------------------------------------------
+    // Identity and fingerprint of the nodes of the parent revision
+    std::list<std::string> fields;
+    fields.push_back(REPO_NODE_LABEL_ID);
+    fields.push_back(REPO_NODE_LABEL_SHARED_ID);
+    fields.push_back(REPO_NODE_LABEL_PARENTS);
+    fields.push_back(REPO_NODE_LABEL_FINGERPRINT);
+    std::vector<mongo::BSONObj> documents;
+    if (!connect() || !pool[0]->fetchByUniqueIDs(database, collection,
+        parent.getCurrentUniqueIDs(), fields, documents))
+    {
+        statistics = RepoCommitStatistics();
+        statistics.nodes = statistics.failedNodes = nodeCount;
+        statistics.totalMilliseconds = millisecondsSince(start);
+        return false;
+    }
+
+    std::vector<RepoCommitParentNode> parentNodes(documents.size());
+    for (size_t i = 0; i < documents.size(); ++i)
+    {
+        const mongo::BSONObj &obj = documents[i];
+        RepoCommitParentNode &node = parentNodes[i];
+        node.uniqueID = RepoTranscoderBSON::retrieve(
+            obj.getField(REPO_NODE_LABEL_ID));
+        node.sharedID = RepoTranscoderBSON::retrieve(
+            obj.getField(REPO_NODE_LABEL_SHARED_ID));
+        if (obj.hasField(REPO_NODE_LABEL_PARENTS))
+            node.parents = RepoTranscoderBSON::retrieveUUIDs(
+                obj.getField(REPO_NODE_LABEL_PARENTS));
+        if (obj.hasField(REPO_NODE_LABEL_FINGERPRINT))
+            node.fingerprint =
+                obj.getField(REPO_NODE_LABEL_FINGERPRINT).String();
+    }
+    documents.clear();
+
+    std::vector<RepoNodeAbstract *> changed =
+        getDelta(graph, parentNodes, revision, encoders, correspondence);
+    double deltaMilliseconds = millisecondsSince(start);
+
+    //--------------------------------------------------------------------------
+    // Adopted shared IDs and new unique IDs of changed nodes invalidated the
+    // paths shared by the encoders, the rebuild indexes them by the new keys
+    graph.getPathIndex();
+    bool success = commit(database, collection,
+        std::vector<const RepoNodeAbstract *>(changed.begin(), changed.end()));
+
+    if (success && revisionStore)
+    {
+        if (!revisionStore->contains(parent.getUniqueID()))
+        {
+            std::vector<boost::uuids::uuid> ancestors =
+                parent.getParentSharedIDs();
+            revisionStore->add(parent, ancestors.empty()
+                ? boost::uuids::uuid() : ancestors[0]);
+        }
+        revisionStore->add(revision, parent.getUniqueID());
+    }
+
+    statistics.unmodifiedNodes = nodeCount - changed.size();
+    statistics.deltaMilliseconds = deltaMilliseconds;
+    statistics.totalMilliseconds = millisecondsSince(start);
+    return success;
+}
+
+std::vector<repo::core::RepoNodeAbstract *>
+    repo::core::RepoCommitPipeline::getDelta(
+    RepoGraphAbstract &graph,
+    const std::vector<RepoCommitParentNode> &parentNodes,
+    RepoNodeRevision &revision,
+    unsigned int threads,
+    const std::map<boost::uuids::uuid, boost::uuids::uuid> &correspondence)
+{
+    RepoNodeAbstractSet set = graph.getNodes();
+    std::vector<RepoNodeAbstract *> nodes(set.begin(), set.end());
+
+    //--------------------------------------------------------------------------
+    // Fingerprints encode every node, hence in parallel with shared paths
+    graph.getPathIndex();
+    std::vector<std::string> fingerprints(nodes.size());
+    RepoParallel::forEach(nodes.size(), threads, [&](size_t i)
+    {
+        try
+        {
+            fingerprints[i] = nodes[i]->getFingerprint();
+        }
+        catch (...)
+        {
+            // Left empty, the node counts as modified
+        }
+    });
+
+    //--------------------------------------------------------------------------
+    // Parents before children so that adopted shared IDs are in place when
+    // the parents of a node are compared
+    std::map<const RepoNodeAbstract *, size_t> indices;
+    for (size_t i = 0; i < nodes.size(); ++i)
+        indices[nodes[i]] = i;
+
+    std::vector<size_t> pending(nodes.size(), 0);
+    std::vector<size_t> order;
+    order.reserve(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        for (const RepoNodeAbstract *p : nodes[i]->getParents())
+            if (indices.count(p))
+                ++pending[i];
+        if (0 == pending[i])
+            order.push_back(i);
+    }
+    for (size_t k = 0; k < order.size(); ++k)
+        for (const RepoNodeAbstract *child : nodes[order[k]]->getChildren())
+        {
+            std::map<const RepoNodeAbstract *, size_t>::const_iterator it =
+                indices.find(child);
+            if (indices.end() != it && pending[it->second] > 0
+                && child->hasParent(nodes[order[k]])
+                && 0 == --pending[it->second])
+                order.push_back(it->second);
+        }
+    // Nodes on a cycle are compared last, their paths count as changed
+    for (size_t i = 0; i < nodes.size(); ++i)
+        if (pending[i] > 0)
+            order.push_back(i);
+
+    //--------------------------------------------------------------------------
+    // Stored nodes by shared ID and by fingerprint. Stored shared IDs still
+    // present in the graph can only be matched by the node carrying them.
+    RepoUUIDMap<size_t> bySharedID;
+    bySharedID.reserve(parentNodes.size());
+    std::multimap<std::string, size_t> byFingerprint;
+    std::set<boost::uuids::uuid> parentUniqueIDs;
+    for (size_t j = 0; j < parentNodes.size(); ++j)
+    {
+        bySharedID.insert(std::make_pair(parentNodes[j].sharedID, j));
+        if (!parentNodes[j].fingerprint.empty())
+            byFingerprint.insert(std::make_pair(parentNodes[j].fingerprint, j));
+        parentUniqueIDs.insert(parentNodes[j].uniqueID);
+    }
+    std::set<boost::uuids::uuid> sharedIDs;
+    for (const RepoNodeAbstract *node : nodes)
+        sharedIDs.insert(node->getSharedID());
+
+    revision.setCurrentUniqueIDs(std::set<boost::uuids::uuid>());
+    revision.setAddedSharedIDs(std::set<boost::uuids::uuid>());
+    revision.setDeletedSharedIDs(std::set<boost::uuids::uuid>());
+    revision.setModifiedSharedIDs(std::set<boost::uuids::uuid>());
+    revision.setUnmodifiedSharedIDs(std::set<boost::uuids::uuid>());
+
+    //--------------------------------------------------------------------------
+    std::vector<bool> claimed(parentNodes.size(), false);
+    std::vector<bool> unchangedPaths(nodes.size(), false);
+    std::vector<RepoNodeAbstract *> changed;
+    for (size_t i : order)
+    {
+        RepoNodeAbstract *node = nodes[i];
+        std::vector<boost::uuids::uuid> parentIDs;
+        bool parentsUnchanged = true;
+        for (const RepoNodeAbstract *p : node->getParents())
+        {
+            parentIDs.push_back(p->getSharedID());
+            std::map<const RepoNodeAbstract *, size_t>::const_iterator it =
+                indices.find(p);
+            parentsUnchanged = parentsUnchanged
+                && indices.end() != it && unchangedPaths[it->second];
+        }
+
+        size_t match = parentNodes.size();
+        RepoUUIDMap<size_t>::const_iterator sit =
+            bySharedID.find(node->getSharedID());
+        std::map<boost::uuids::uuid, boost::uuids::uuid>::const_iterator cit;
+        if (bySharedID.end() == sit
+            && correspondence.end() !=
+                (cit = correspondence.find(node->getSharedID()))
+            && !sharedIDs.count(cit->second)
+            && bySharedID.end() != (sit = bySharedID.find(cit->second))
+            && !claimed[sit->second])
+            node->setSharedID(cit->second);
+        sit = bySharedID.find(node->getSharedID());
+        if (bySharedID.end() != sit)
+            match = claimed[sit->second] ? parentNodes.size() : sit->second;
+        else if (!fingerprints[i].empty())
+        {
+            std::pair<std::multimap<std::string, size_t>::const_iterator,
+                std::multimap<std::string, size_t>::const_iterator> range =
+                byFingerprint.equal_range(fingerprints[i]);
+            for (; range.first != range.second; ++range.first)
+            {
+                const RepoCommitParentNode &candidate =
+                    parentNodes[range.first->second];
+                if (!claimed[range.first->second]
+                    && !sharedIDs.count(candidate.sharedID)
+                    && candidate.parents == parentIDs)
+                {
+                    match = range.first->second;
+                    node->setSharedID(candidate.sharedID);
+                    break;
+                }
+            }
+        }
+
+        if (parentNodes.size() == match)
+        {
+            revision.addAddedSharedID(node->getSharedID());
+            changed.push_back(node);
+            continue;
+        }
+
+        const RepoCommitParentNode &stored = parentNodes[match];
+        claimed[match] = true;
+        unchangedPaths[i] = parentsUnchanged && stored.parents == parentIDs;
+        if (unchangedPaths[i] && !fingerprints[i].empty()
+            && stored.fingerprint == fingerprints[i])
+        {
+            graph.setNodeUniqueID(node, stored.uniqueID);
+            revision.addUnmodifiedSharedID(stored.sharedID);
+            revision.addCurrentUniqueID(stored.uniqueID);
+        }
+        else
+        {
+            revision.addModifiedSharedID(stored.sharedID);
+            changed.push_back(node);
+        }
+    }
+
+    for (size_t j = 0; j < parentNodes.size(); ++j)
+        if (!claimed[j])
+            revision.addDeletedSharedID(parentNodes[j].sharedID);
+
+    //--------------------------------------------------------------------------
+    // Stored documents are immutable, changed nodes need unique IDs of their own
+    for (RepoNodeAbstract *node : changed)
+    {
+        if (parentUniqueIDs.count(node->getUniqueID()))
+            graph.setNodeUniqueID(node, boost::uuids::random_generator()());
+        revision.addCurrentUniqueID(node->getUniqueID());
+    }
+    return changed;
+}
+
+bool repo::core::RepoCommitPipeline::connect()
+{
+    while (pool.size() < writers)
+    {
+        boost::shared_ptr<MongoClientWrapper> writer(
+            new MongoClientWrapper(connection));
+        if (!writer->reconnectAndReauthenticate())
+            return false;
+        pool.push_back(writer);
+    }
+    return true;
+}
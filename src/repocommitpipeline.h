@@ -0,0 +1,256 @@
+/**
+ *  Copyright (C) 2015 3D Repo Ltd
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPO_COMMIT_PIPELINE_H
+#define REPO_COMMIT_PIPELINE_H
+
+//------------------------------------------------------------------------------
+#include <map>
+#include <string>
+#include <vector>
+//------------------------------------------------------------------------------
+#include <boost/shared_ptr.hpp>
+#include <boost/uuid/uuid.hpp>
+//------------------------------------------------------------------------------
+#include "mongoclientwrapper.h"
+#include "graph/repo_graph_abstract.h"
+#include "graph/repo_node_revision.h"
+#include "graph/repo_revision_store.h"
+#include "repocoreglobal.h"
+
+//! Default number of writer threads, each with its own connection.
+#define REPO_COMMIT_WRITERS 4
+
+//! Default number of batches encoded ahead of the writers.
+#define REPO_COMMIT_QUEUE_CAPACITY 16
+
+//! Maximum number of documents inserted in a single round trip.
+#define REPO_COMMIT_BATCH_SIZE 1000
+
+//! Maximum BSON bytes inserted in a single round trip, below the wire limit.
+#define REPO_COMMIT_BATCH_BYTES (16 * 1024 * 1024)
+
+namespace repo {
+namespace core {
+
+//! Work done by the last call to RepoCommitPipeline::commit.
+/*!
+ * Times of a stage are summed over its threads, hence encoding and writing
+ * overlapped if together they exceed the total.
+ */
+struct REPO_CORE_EXPORT RepoCommitStatistics
+{
+    unsigned long long nodes; //!< Nodes given to commit
+    unsigned long long documents; //!< Documents inserted successfully
+    unsigned long long bytes; //!< BSON bytes inserted successfully
+    unsigned long long batches; //!< Round trips to the database
+    unsigned long long failedNodes; //!< Nodes that could not be encoded
+    unsigned long long failedBatches; //!< Round trips that reported an error
+    unsigned long long unmodifiedNodes; //!< Nodes referenced from the parent
+    double deltaMilliseconds; //!< Fetching and matching the parent revision
+    double connectMilliseconds; //!< Establishing the pooled connections
+    double encodeMilliseconds; //!< Encoders calling toBSONObj()
+    double backpressureMilliseconds; //!< Encoders waiting for a full queue
+    double writeMilliseconds; //!< Writers inserting batches
+    double starvationMilliseconds; //!< Writers waiting for an empty queue
+    double totalMilliseconds; //!< Wall clock time of the commit
+
+    RepoCommitStatistics()
+        : nodes(0)
+        , documents(0)
+        , bytes(0)
+        , batches(0)
+        , failedNodes(0)
+        , failedBatches(0)
+        , unmodifiedNodes(0)
+        , deltaMilliseconds(0.0)
+        , connectMilliseconds(0.0)
+        , encodeMilliseconds(0.0)
+        , backpressureMilliseconds(0.0)
+        , writeMilliseconds(0.0)
+        , starvationMilliseconds(0.0)
+        , totalMilliseconds(0.0) {}
+};
+
+//! Node of a parent revision as compared by RepoCommitPipeline::getDelta().
+struct REPO_CORE_EXPORT RepoCommitParentNode
+{
+    boost::uuids::uuid uniqueID;
+    boost::uuids::uuid sharedID;
+    std::vector<boost::uuids::uuid> parents; //!< Parent shared IDs as stored
+    std::string fingerprint; //!< Empty if stored without one
+};
+
+//! Encodes nodes and inserts them into a collection in parallel.
+/*!
+ * A pool of encoder threads calls toBSONObj() on the nodes, including the
+ * packing of their binary buffers, and groups the documents into batches.
+ * Batches are handed over through a bounded queue to writer threads which
+ * insert each batch in a single round trip, every writer on a connection of
+ * its own. Encoders block while the queue is full so that memory held by
+ * encoded documents stays bounded when the network is the bottleneck.
+ *
+ * Connections are copies of the given one, established and authenticated
+ * on the first commit and reused by the following ones. Documents are
+ * inserted in no particular order, each with the content fingerprint of its
+ * node, see RepoNodeAbstract::computeFingerprint(), so that a later
+ * commitDelta() can tell which nodes changed.
+ */
+class REPO_CORE_EXPORT RepoCommitPipeline
+{
+
+public :
+
+    /*!
+     * \param connection Authenticated connection whose credentials are used
+     * for the pooled connections
+     * \param encoders Number of encoder threads, 0 uses the hardware
+     * concurrency
+     * \param writers Number of writer threads and pooled connections
+     * \param queueCapacity Number of batches that can await a writer
+     */
+    RepoCommitPipeline(
+        const MongoClientWrapper &connection,
+        unsigned int encoders = 0,
+        unsigned int writers = REPO_COMMIT_WRITERS,
+        size_t queueCapacity = REPO_COMMIT_QUEUE_CAPACITY);
+
+    ~RepoCommitPipeline() {}
+
+    //! Inserts BSON representations of the nodes into the collection.
+    /*!
+     * Returns true if all nodes were encoded and inserted.
+     */
+    bool commit(
+        const std::string &database,
+        const std::string &collection,
+        const std::vector<const RepoNodeAbstract *> &nodes);
+
+    //! Inserts all nodes of the graph, see commit().
+    /*!
+     * The path index of the graph is built beforehand so that encoders share
+     * it instead of computing paths of each node.
+     */
+    bool commit(
+        const std::string &database,
+        const std::string &collection,
+        const RepoGraphAbstract &graph);
+
+    //! Inserts only nodes of the graph changed since the parent revision.
+    /*!
+     * Fingerprints stored with the nodes of the parent revision are compared
+     * to those of the graph and the added, deleted, modified and unmodified
+     * shared IDs of the revision are set accordingly, see getDelta(). Only
+     * added and modified nodes are inserted, unmodified ones are recorded by
+     * the unique IDs of their stored documents in the current unique IDs of
+     * the revision. The revision itself is not inserted.
+     *
+     * \param parent Revision the graph was checked out from, or the latest
+     * revision of the branch the graph is imported into
+     * \param revision New revision, any of its ID sets are replaced
+     * \param correspondence Shared IDs of nodes of the graph mapped to those
+     * of nodes of the parent, see getDelta()
+     * \return True if all changed nodes were inserted, in which case the
+     * revision is added to the revision store if set, see setRevisionStore()
+     */
+    bool commitDelta(
+        const std::string &database,
+        const std::string &collection,
+        RepoGraphAbstract &graph,
+        const RepoNodeRevision &parent,
+        RepoNodeRevision &revision,
+        const std::map<boost::uuids::uuid, boost::uuids::uuid> &correspondence
+            = std::map<boost::uuids::uuid, boost::uuids::uuid>());
+
+    //! Sets the store the revisions of successful commitDelta() calls are
+    //! added to, such as RepoCore::getRevisionStore(), NULL for none.
+    /*!
+     * A parent not yet in the store is added first, so that the committed
+     * revision is stored as a delta of it.
+     */
+    void setRevisionStore(RepoRevisionStore *store) { revisionStore = store; }
+
+    //! Returns statistics of the last commit.
+    const RepoCommitStatistics &getStatistics() const { return statistics; }
+
+    //! Matches nodes of the graph to those of the parent revision.
+    /*!
+     * Nodes are matched top-down, by shared ID first. Nodes whose shared ID
+     * is not in the parent, as when a model is imported anew, are matched to
+     * a stored node with the same fingerprint and the same parents and adopt
+     * its shared ID. A matched node is unmodified if its fingerprint, parents
+     * and thereby all its stored paths are unchanged, in which case it takes
+     * the unique ID of the stored document. Unmatched stored nodes are
+     * deleted. Changed nodes whose unique ID is taken by a stored document
+     * are given a new one.
+     *
+     * A node whose shared ID is not in the parent but in the correspondence
+     * adopts the stored shared ID it is mapped to before being matched, such
+     * as a mesh paired up by RepoSimilarityIndex::match() or Repo3DDiff.
+     *
+     * \param threads Number of threads computing fingerprints, 0 uses the
+     * hardware concurrency
+     * \param correspondence Shared IDs of nodes of the graph mapped to those
+     * of stored nodes
+     * \return Added and modified nodes which have to be inserted
+     */
+    static std::vector<RepoNodeAbstract *> getDelta(
+        RepoGraphAbstract &graph,
+        const std::vector<RepoCommitParentNode> &parentNodes,
+        RepoNodeRevision &revision,
+        unsigned int threads = 0,
+        const std::map<boost::uuids::uuid, boost::uuids::uuid> &correspondence
+            = std::map<boost::uuids::uuid, boost::uuids::uuid>());
+
+private :
+
+    //! Encoded documents awaiting a writer.
+    class Queue;
+
+    //! Connects the pool if not yet connected, returns false on failure.
+    /*!
+     * Pooled connections authenticate with all credentials of the original.
+     */
+    bool connect();
+
+    RepoCommitPipeline(const RepoCommitPipeline &);
+
+    RepoCommitPipeline &operator=(const RepoCommitPipeline &);
+
+    //! Connection the pool is copied from.
+    MongoClientWrapper connection;
+
+    //! Connections of the writers.
+    std::vector<boost::shared_ptr<MongoClientWrapper> > pool;
+
+    unsigned int encoders;
+
+    unsigned int writers;
+
+    size_t queueCapacity;
+
+    //! Store of committed revisions, NULL if not set.
+    RepoRevisionStore *revisionStore;
+
+    RepoCommitStatistics statistics;
+
+}; // end class
+
+} // end namespace core
+} // end namespace repo
+
+#endif // end REPO_COMMIT_PIPELINE_H
@@ -21,6 +21,8 @@
 
 //------------------------------------------------------------------------------
 #include "repocoreglobal.h"
+#include "graph/repo_revision_store.h"
+#include "graph/repo_scene_manager.h"
 //------------------------------------------------------------------------------
 
 namespace repo {
@@ -35,6 +37,18 @@ public:
 
     ~RepoCore();
 
+    //! Returns the cache of loaded scenes shared by users of this core.
+    RepoSceneManager &getSceneManager() { return sceneManager; }
+
+    //! Returns the snapshots and deltas of revisions used for checkouts.
+    RepoRevisionStore &getRevisionStore() { return revisionStore; }
+
+private:
+
+    RepoSceneManager sceneManager;
+
+    RepoRevisionStore revisionStore;
+
 }; // end class
 
 } // end namespace core